@@ -81,14 +81,8 @@ void GlobalMapWindow::DrawRect(QPainter &Painter, QPen Pen, QBrush Brush, int X,
   Painter.restore();
 }
 
-void GlobalMapWindow::DrawTile(QPainter &Painter, int X, int Y,
-                               std::vector<Id<Squad>> &Squads) noexcept {
-  const auto &Tile = GlobalMap_.GetTile(CurrentLayer_, X, Y);
-  if (Tile.Squad_.IsValid()) {
-    Squads.push_back(Tile.Squad_);
-  }
-  QBrush Brush =
-      Tile.Terrain_.IsValid() ? Brushes_[Tile.Terrain_] : QBrush{Qt::gray, Qt::SolidPattern};
+void GlobalMapWindow::DrawTile(QPainter &Painter, int X, int Y, Id<Terrain> TerrainId) noexcept {
+  QBrush Brush = TerrainId.IsValid() ? Brushes_[TerrainId] : QBrush{Qt::gray, Qt::SolidPattern};
   DrawRect(Painter, QPen{Qt::yellow}, Brush, X, Y, 1, 1);
 }
 
@@ -127,6 +121,15 @@ void GlobalMapWindow::DrawSquads(QPainter &Painter, const std::vector<Id<Squad>>
   }
 }
 
+void GlobalMapWindow::DrawReachableArea(QPainter &Painter, const DistanceField &Area) noexcept {
+  if (Area.GetSource().Layer != CurrentLayer_) {
+    return;
+  }
+  Area.ForEachTile([&](Coord3D Coord, Size /*Cost*/) {
+    DrawRect(Painter, QPen{Qt::NoPen}, QBrush{QColor{255, 255, 255, 60}}, Coord.X, Coord.Y, 1, 1);
+  });
+}
+
 void GlobalMapWindow::DrawPath(QPainter &Painter, const Path &Path) noexcept {
   const auto H = GlobalMap_.GetHeight();
   float Coef = 0.2;
@@ -185,11 +188,23 @@ void GlobalMapWindow::DrawMap() noexcept {
   Painter.setRenderHint(QPainter::SmoothPixmapTransform, true);
   Painter.setRenderHints(QPainter::TextAntialiasing, true);
 
-  std::vector<Id<Squad>> Squads;
-  for (Size X = 0, XE = GlobalMap_.GetWidth(); X < XE; ++X) {
-    for (Size Y = 0, YE = GlobalMap_.GetHeight(); Y < YE; ++Y) {
-      DrawTile(Painter, X, Y, Squads);
+  // In the order the tiles are stored.
+  const auto TerrainIds = GlobalMap_.GetTerrainIds(CurrentLayer_);
+  const auto First = GlobalMap_.GetFirstIndex(CurrentLayer_);
+  for (size_t I = 0; I < TerrainIds.size(); ++I) {
+    const auto Coord = GlobalMap_.IndexToCoord3D(First + I);
+    if (!GlobalMap_.IsValid(Coord)) {
+      continue;
     }
+    DrawTile(Painter, Coord.X, Coord.Y, TerrainIds[I]);
+  }
+  // The whole layer is drawn into the pixmap, so the viewport is the layer.
+  std::vector<Id<Squad>> Squads;
+  GlobalMap_.GetSquadIndex().ForEachInRect(
+      CurrentLayer_, Coord{0, 0}, Dims2D{GlobalMap_.GetWidth(), GlobalMap_.GetHeight()},
+      [&](const SpatialIndex<Squad>::Entry &E) { Squads.push_back(E.Item); });
+  if (ReachableArea_) {
+    DrawReachableArea(Painter, *ReachableArea_);
   }
   for (auto ObjId : GlobalMap_.GetObjectsOnLayer(CurrentLayer_)) {
     DrawObject(Painter, GlobalMap_.GetObject(ObjId));
@@ -233,6 +248,17 @@ void GlobalMapWindow::OnMapMouseMove(QMouseEvent *Event) {
 
   Scene_.addEllipse(Left, Top, 2 * Coef * kDX, 2 * Coef * kDY, QPen{Qt::blue});
 
+  const Coord3D Hovered{static_cast<Size>(MapX), static_cast<Size>(MapY), CurrentLayer_};
+  if (const auto HoveredPath = ReachableArea_ ? ReachableArea_->BuildPath(Hovered) : std::nullopt) {
+    const float PathCoef = 0.1;
+    for (const auto &Pt : HoveredPath->Waypoints) {
+      Scene_.addEllipse(kBorderWidth + (H + Pt.Coord.X - Pt.Coord.Y - PathCoef) * kDX,
+                        kBorderWidth + (Pt.Coord.X + Pt.Coord.Y - PathCoef + 1) * kDY,
+                        2 * PathCoef * kDX, 2 * PathCoef * kDY, QPen{Qt::white},
+                        QBrush{Qt::blue});
+    }
+  }
+
   const auto &Tile = GlobalMap_.GetTile(CurrentLayer_, MapX, MapY);
   const std::string *Name = nullptr;
   const std::string *Description = nullptr;
@@ -303,6 +329,7 @@ bool GlobalMapWindow::TrySelect(QPoint MapCoord, Id<MapObject> ObjectId) noexcep
       }
     }
     SelectedObject_ = ObjectId;
+    ReachableArea_.reset();
     UI_->lblSelection->setText(QString::fromStdString(Obj.GetTitle()));
     return true;
   }
@@ -316,7 +343,7 @@ bool GlobalMapWindow::TrySelect(QPoint MapCoord, Id<MapObject> ObjectId) noexcep
   }
 }
 
-void GlobalMapWindow::HandleTileClick(QPoint MapCoord, const Tile &Tile) noexcept {
+void GlobalMapWindow::HandleTileClick(QPoint MapCoord, ConstTileRef Tile) noexcept {
   const auto *SelectedSquad = std::get_if<Id<Squad>>(&SelectedObject_);
   if (!SelectedSquad) {
     return;
@@ -330,11 +357,14 @@ void GlobalMapWindow::HandleTileClick(QPoint MapCoord, const Tile &Tile) noexcep
 
   const auto &Systems = State_.SavedState.Map.Systems;
 
+  if (ReachableArea_ && ReachableArea_->Contains(Target)) {
+    CurrentPath = ReachableArea_->BuildPath(Target);
+    return;
+  }
+
   const auto &Squad = Systems.Squads.GetComponent(*SelectedSquad);
-  auto Path = TryBuildPath(Squad.Position, Target, State_.SavedState.Map.GlobalMap, Systems, Mod_,
-                           Squad.GetLeader());
-  assert(Path);
-  SquadPath_[*SelectedSquad] = std::move(*Path);
+  CurrentPath = TryBuildPath(Squad.Position, Target, State_.SavedState.Map.GlobalMap, Systems, Mod_,
+                             Squad.GetLeader());
 }
 
 void GlobalMapWindow::HandleSquadClick(QPoint MapCoord, Id<Squad> SquadId) noexcept {
@@ -350,6 +380,7 @@ void GlobalMapWindow::HandleSquadClick(QPoint MapCoord, Id<Squad> SquadId) noexc
     const auto &Leader = Systems.Units.GetComponent(Squad.GetLeader());
     const auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
     UI_->lblSelection->setText(QString::fromStdString(LeaderData.Name));
+    UpdateReachableArea();
   }
 }
 
@@ -402,13 +433,19 @@ void GlobalMapWindow::DoSquadWalk(Id<Squad> SquadId, Path &Path) noexcept {
   std::cerr << Response.GetValue().MovePointsRemaining << " " << Response.GetValue().NumSteps
             << '\n';
 
-  if (Response.GetValue().NumSteps == Path.Waypoints.size() - 1) {
+  const auto SquadAttacked = Response.GetValue().SquadAttacked;
+  if (Response.GetValue().NumSteps == Path.Waypoints.size() - 1 || SquadAttacked.IsValid()) {
     SquadPath_[SquadId].reset();
   } else {
+    // The rest of the march is continued by the engine in the next turns.
     Path.Walk(Response.GetValue().NumSteps);
+    auto Order = Engine_.SetMoveOrder(Player_.MapId, SquadId, Path);
+    assert(Order.IsSuccess());
   }
 
-  if (auto SquadAttacked = Response.GetValue().SquadAttacked; SquadAttacked.IsValid()) {
+  UpdateReachableArea();
+
+  if (SquadAttacked.IsValid()) {
     auto &Systems = State_.SavedState.Map.Systems;
     auto &Attacker = Systems.Squads.GetComponent(SquadId);
     auto &Defender = Systems.Squads.GetComponent(SquadAttacked);
@@ -417,13 +454,36 @@ void GlobalMapWindow::DoSquadWalk(Id<Squad> SquadId, Path &Path) noexcept {
   }
 }
 
+void GlobalMapWindow::UpdateReachableArea() noexcept {
+  const auto *SelectedSquad = std::get_if<Id<Squad>>(&SelectedObject_);
+  if (!SelectedSquad) {
+    ReachableArea_.reset();
+    return;
+  }
+  const auto &Systems = State_.SavedState.Map.Systems;
+  const auto &Squad = Systems.Squads.GetComponent(*SelectedSquad);
+  ReachableArea_ = ComputeReachableArea(Squad, GlobalMap_, Systems);
+}
+
 void GlobalMapWindow::OpenCapitalScreen() {
   auto W = new CapitalViewWindow{Mod_,    State_.SavedState.Map.Systems, Engine_,
                                  Player_, Id<CapitalComponent>{0},       this};
   W->show();
 }
 
+void GlobalMapWindow::on_btnEndTurn_clicked() {
+  auto Result = Engine_.EndTurn(Player_);
+  assert(Result.IsSuccess());
+}
+
 void GlobalMapWindow::OnPlayerNewTurn(const NotAGame::NewTurnEvent &Event) noexcept {
+  if (Event.Player == Player_.MapId) {
+    for (const auto &Moved : Event.SquadsMoved) {
+      const auto *Order = Engine_.GetMoveOrder(Player_.MapId, Moved.SquadId);
+      SquadPath_[Moved.SquadId] = Order ? std::optional<Path>{*Order} : std::nullopt;
+    }
+  }
+  UpdateReachableArea();
   if (Event.Player == 0) { // FIXME: pass player id from start window
     Resources_->SetValue(State_.SavedState.PlayerStates[0].ResourcesGained);
     NewTurnDialog dlg{Mod_, this};
@@ -52,6 +52,7 @@ public slots:
   void OnMapMouseDown(QMouseEvent *ev);
   void OnMapMouseUp(QMouseEvent *ev);
   void OpenCapitalScreen();
+  void on_btnEndTurn_clicked();
 
 private:
   struct MapMouseState {
@@ -65,19 +66,21 @@ private:
   void DrawRect(QPainter &Painter, QPen Pen, QBrush Brush, int X, int Y, int Width,
                 int Height) noexcept;
   void DrawTile(QPainter &Painter, int X, int Y,
-                std::vector<NotAGame::Id<NotAGame::Squad>> &Squads) noexcept;
+                NotAGame::Id<NotAGame::Terrain> TerrainId) noexcept;
   void DrawObject(QPainter &Painter, const NotAGame::MapObject &Object) noexcept;
   void DrawPath(QPainter &Painter, const NotAGame::Path &Path) noexcept;
+  void DrawReachableArea(QPainter &Painter, const NotAGame::DistanceField &Area) noexcept;
   void DrawSquads(QPainter &Painter,
                   const std::vector<NotAGame::Id<NotAGame::Squad>> &Squads) noexcept;
 
-  void HandleTileClick(QPoint MapCoord, const NotAGame::Tile &Tile) noexcept;
+  void HandleTileClick(QPoint MapCoord, NotAGame::ConstTileRef Tile) noexcept;
   void HandleObjectClick(QPoint MapCoord, NotAGame::Id<NotAGame::MapObject> Object) noexcept;
   void HandleSquadClick(QPoint MapCoord, NotAGame::Id<NotAGame::Squad> Squad) noexcept;
   bool TrySelect(QPoint MapCoord, NotAGame::Id<NotAGame::MapObject> ObjectId) noexcept;
   bool TrySelectSquad(NotAGame::Id<NotAGame::Squad> SquadId) noexcept;
 
   void DoSquadWalk(NotAGame::Id<NotAGame::Squad> SquadId, NotAGame::Path &Path) noexcept;
+  void UpdateReachableArea() noexcept;
 
   std::optional<QPoint> GetMapCoord(QPoint MousePos) const noexcept;
 
@@ -92,6 +95,8 @@ private:
   std::vector<QBrush> Brushes_;
 
   std::unordered_map<NotAGame::Id<NotAGame::Squad>, std::optional<NotAGame::Path>> SquadPath_;
+  // Tiles the selected squad can reach this turn.
+  std::optional<NotAGame::DistanceField> ReachableArea_;
 
   QPixmap MapPixmap_;
 
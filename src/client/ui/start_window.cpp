@@ -25,7 +25,7 @@ MapState StartWindow::CreateMap() noexcept {
   for (Size Layer = 0, LayerE = M.GetNumLayers(); Layer < LayerE; ++Layer) {
     for (Size X = 0, XE = M.GetWidth(); X < XE; ++X) {
       for (Size Y = 0, YE = M.GetHeight(); Y < YE; ++Y) {
-        M.GetTile(Layer, X, Y).Terrain_ = std::rand() % NumTerrains;
+        M.SetTerrain(Coord3D{X, Y, Layer}, std::rand() % NumTerrains);
       }
     }
   }
@@ -55,6 +55,12 @@ MapState StartWindow::CreateMap() noexcept {
   VisibilityRange CapRange{
       .Player = 0, .Origin = Cap.GetPosition(), .OriginSize = Cap.GetSize(), .Radius = 7};
   Cap.VisibilityRangeTrait = Systems.Visibility.AddComponent(CapRange).ComponentId;
+  LandPropagation CapLand{.Player = 0,
+                          .TilesPerTurn = Mod_.GetLandPropagationSettings().CapitalPropagation,
+                          .Origin = Cap.GetPosition(),
+                          .OriginSize = Cap.GetSize()};
+  Cap.LandPropagationTrait =
+      Systems.LandPropagation.AddComponentAndPropagate(M, CapLand).ComponentId;
 
   Resources R{Mod_.GetResources()};
   R.SetAmountByName("gold", 100);
@@ -80,7 +86,7 @@ MapState StartWindow::CreateMap() noexcept {
   assert(S.GetGrid().TrySetUnit(Goblin.ComponentId, &Goblin, Coord{1, 1}));
 
   auto &Squad = Systems.Squads.AddComponent(S);
-  M.GetTile(0, 14, 14).Squad_ = Squad.ComponentId;
+  M.SetSquad(S.Position, Squad.ComponentId);
 
   return MapState{.GlobalMap = std::move(M), .Systems = std::move(Systems)};
 }
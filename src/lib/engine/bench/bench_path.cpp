@@ -0,0 +1,455 @@
+#include "engine/delta_stepping.h"
+#include "engine/flow_field.h"
+#include "engine/incremental_path.h"
+#include "engine/landmarks.h"
+#include "engine/path.h"
+#include "engine/path_hierarchy.h"
+#include "engine/path_search.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <tuple>
+
+using namespace NotAGame;
+
+namespace {
+
+enum class TerrainMix {
+  Uniform, // Roads only.
+  Noise,   // Every tile is random.
+  Patches, // Random 8x8 patches, like forests and swamps.
+};
+
+enum class QueryKind { Short, Medium, Cross };
+
+struct MapParams {
+  Size Width;
+  Size Layers;
+  TerrainMix Mix;
+  Size ObjectPercent;
+
+  auto operator<=>(const MapParams &) const noexcept = default;
+};
+
+constexpr size_t kNumQueries = 64;
+
+struct BenchMap {
+  explicit BenchMap(const MapParams &Params) noexcept
+      : Params{Params}, Map{Params.Layers, Params.Width, Params.Width} {
+    Terrains.AddObject("road", Terrain{Named{"road", "Road", "road"}, 1});
+    Terrains.AddObject("plain", Terrain{Named{"plain", "Plain", "plain"}, 2});
+    Terrains.AddObject("forest", Terrain{Named{"forest", "Forest", "forest"}, 3});
+    Terrains.AddObject("swamp", Terrain{Named{"swamp", "Swamp", "swamp"}, 4});
+
+    std::mt19937 Random{Params.Width * 31 + Params.Layers * 7 + Params.ObjectPercent};
+    const Size NumTerrains = Terrains.size();
+    for (Dim Z = 0; Z < Params.Layers; ++Z) {
+      for (Dim Y = 0; Y < Params.Width; ++Y) {
+        for (Dim X = 0; X < Params.Width; ++X) {
+          Id<Terrain> TerrainId = 0;
+          switch (Params.Mix) {
+          case TerrainMix::Uniform:
+            break;
+          case TerrainMix::Noise:
+            TerrainId = static_cast<Size>(Random() % NumTerrains);
+            break;
+          case TerrainMix::Patches:
+            // Cheap deterministic hash of the patch.
+            TerrainId = ((X / 8) * 73856093u ^ (Y / 8) * 19349663u ^ Z * 83492791u) % NumTerrains;
+            break;
+          }
+          Map.SetTerrain(Coord3D{X, Y, Z}, TerrainId);
+        }
+      }
+    }
+
+    // Objects of 1x1 to 3x3 tiles until the requested share of the map is covered.
+    const size_t NumTiles = size_t{Params.Width} * Params.Width * Params.Layers;
+    const size_t Covered = NumTiles * Params.ObjectPercent / 100;
+    size_t NumCovered = 0;
+    for (size_t Attempt = 0; NumCovered < Covered && Attempt < NumTiles; ++Attempt) {
+      const Dims2D Extent{static_cast<Dim>(1 + Random() % 3), static_cast<Dim>(1 + Random() % 3)};
+      if (Extent.Width > Params.Width || Extent.Height > Params.Width) {
+        continue;
+      }
+      const Coord3D Pos{static_cast<Dim>(Random() % (Params.Width - Extent.Width + 1)),
+                        static_cast<Dim>(Random() % (Params.Width - Extent.Height + 1)),
+                        static_cast<Dim>(Random() % Params.Layers)};
+      const auto Key = "object" + std::to_string(Attempt);
+      MapObject Object{Named{Key, Key, Key}, MapObject::Other, Pos, Extent, std::nullopt, false,
+                       false};
+      if (Map.AddObject(Key, std::move(Object)).IsSuccess()) {
+        NumCovered += Extent.Width * Extent.Height;
+      }
+    }
+    Map.BuildNavigation(Terrains);
+  }
+
+  const std::vector<std::pair<Coord3D, Coord3D>> &GetQueries(QueryKind Kind) noexcept {
+    auto &Queries = QueriesByKind[static_cast<size_t>(Kind)];
+    if (!Queries.empty()) {
+      return Queries;
+    }
+
+    const auto &Nav = Map.GetNavigation();
+    const Size Width = Map.GetWidth();
+    std::mt19937 Random{static_cast<uint32_t>(Kind) + 1};
+    auto RandomIn = [&](Dim Min, Dim Max) {
+      return static_cast<Dim>(Min + Random() % (Max - Min));
+    };
+    auto IsFree = [&](Coord3D Pos) { return Nav.IsPassable(Nav.ToIndex(Pos)); };
+
+    while (Queries.size() < kNumQueries) {
+      const Dim Layer = static_cast<Dim>(Random() % Map.GetNumLayers());
+      Coord3D From, To;
+      switch (Kind) {
+      case QueryKind::Short:
+      case QueryKind::Medium: {
+        const Dim Distance = Kind == QueryKind::Short ? std::min<Dim>(8, Width / 2) : Width / 4;
+        From = Coord3D{RandomIn(0, Width), RandomIn(0, Width), Layer};
+        const int DX = static_cast<int>(Random() % 3) - 1;
+        const int DY = DX == 0 ? (Random() % 2 ? 1 : -1) : static_cast<int>(Random() % 3) - 1;
+        auto Shift = [&](Dim Value, int Direction) {
+          const int Shifted = static_cast<int>(Value) + Direction * static_cast<int>(Distance);
+          return static_cast<Dim>(std::clamp(Shifted, 0, static_cast<int>(Width) - 1));
+        };
+        To = Coord3D{Shift(From.X, DX), Shift(From.Y, DY), Layer};
+        break;
+      }
+      case QueryKind::Cross: {
+        const Dim Margin = std::max<Dim>(Width / 8, 1);
+        From = Coord3D{RandomIn(0, Margin), RandomIn(0, Margin), Layer};
+        To = Coord3D{RandomIn(Width - Margin, Width), RandomIn(Width - Margin, Width), Layer};
+        break;
+      }
+      }
+      if (From != To && IsFree(From) && IsFree(To)) {
+        Queries.emplace_back(From, To);
+      }
+    }
+    return Queries;
+  }
+
+  PathHierarchy &GetHierarchy() noexcept {
+    if (!Hierarchy) {
+      Hierarchy = std::make_unique<PathHierarchy>(Map);
+    }
+    return *Hierarchy;
+  }
+
+  // Landmarks change what TryBuildPath does, so every benchmark states whether it wants them.
+  void UseLandmarks(bool IsUsed) noexcept {
+    if (!IsUsed) {
+      Map.SetLandmarks(kBaseMovement, nullptr);
+      return;
+    }
+    if (!Map.GetNavigation().GetLandmarks(kBaseMovement)) {
+      Landmarks = BuildLandmarks(Map);
+    }
+  }
+
+  MapParams Params;
+  Utils::Registry<Terrain, 8> Terrains;
+  GlobalMap Map;
+  std::unique_ptr<PathHierarchy> Hierarchy;
+  LandmarkStats Landmarks;
+  std::vector<std::pair<Coord3D, Coord3D>> QueriesByKind[3];
+};
+
+// Big maps take a while to generate, the last one is kept for the next benchmark.
+BenchMap &GetMap(const MapParams &Params) noexcept {
+  static std::unique_ptr<BenchMap> Cached;
+  if (!Cached || Cached->Params != Params) {
+    Cached.reset();
+    Cached = std::make_unique<BenchMap>(Params);
+  }
+  return *Cached;
+}
+
+std::tuple<MapParams, QueryKind> GetParams(const benchmark::State &State) noexcept {
+  return {MapParams{.Width = static_cast<Size>(State.range(0)),
+                    .Layers = static_cast<Size>(State.range(1)),
+                    .Mix = static_cast<TerrainMix>(State.range(2)),
+                    .ObjectPercent = static_cast<Size>(State.range(3))},
+          static_cast<QueryKind>(State.range(4))};
+}
+
+void MapArguments(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"size", "layers", "mix", "objects", "query"});
+  for (const int64_t Width : {16, 64, 256, 1024, 2048}) {
+    // Four layers of the biggest map do not fit into a reasonable amount of memory.
+    for (const int64_t Layers : {1, 4}) {
+      if (Width == 2048 && Layers > 1) {
+        continue;
+      }
+      for (const int64_t Mix : {0, 1, 2}) {
+        for (const int64_t Objects : {0, 5, 20}) {
+          for (const int64_t Query : {0, 1, 2}) {
+            B->Args({Width, Layers, Mix, Objects, Query});
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Fn> void RunQueries(benchmark::State &State, Fn &&Query) noexcept {
+  const auto [Params, Kind] = GetParams(State);
+  auto &Bench = GetMap(Params);
+  const auto &Queries = Bench.GetQueries(Kind);
+
+  size_t I = 0, NumFound = 0;
+  for (auto _ : State) {
+    const auto &[From, To] = Queries[I++ % Queries.size()];
+    NumFound += Query(Bench, From, To);
+  }
+  State.counters["found"] =
+      benchmark::Counter(static_cast<double>(NumFound), benchmark::Counter::kAvgIterations);
+}
+
+void RunAStarQueries(benchmark::State &State) noexcept {
+  size_t NodesExpanded = 0, PeakHeapSize = 0, MemoryUsage = 0;
+  RunQueries(State, [&](BenchMap &Bench, Coord3D From, Coord3D To) {
+    SearchStats Stats;
+    auto P = TryBuildPath(From, To, Bench.Map, kBaseMovement, &Stats);
+    benchmark::DoNotOptimize(P);
+    NodesExpanded += Stats.NodesExpanded;
+    PeakHeapSize = std::max(PeakHeapSize, Stats.PeakHeapSize);
+    MemoryUsage = std::max(MemoryUsage, Stats.MemoryUsage);
+    return P.has_value();
+  });
+  State.counters["expanded"] =
+      benchmark::Counter(static_cast<double>(NodesExpanded), benchmark::Counter::kAvgIterations);
+  State.counters["peak_heap"] = static_cast<double>(PeakHeapSize);
+  State.counters["scratch_bytes"] = benchmark::Counter(
+      static_cast<double>(MemoryUsage), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+
+} // namespace
+
+static void BM_AStar(benchmark::State &State) {
+  GetMap(std::get<MapParams>(GetParams(State))).UseLandmarks(false);
+  RunAStarQueries(State);
+}
+BENCHMARK(BM_AStar)->Apply(MapArguments);
+
+static void BM_Landmarks(benchmark::State &State) {
+  // Preprocessing is done once per map and reported separately from the queries.
+  auto &Bench = GetMap(std::get<MapParams>(GetParams(State)));
+  Bench.UseLandmarks(true);
+  RunAStarQueries(State);
+  State.counters["landmarks"] = static_cast<double>(Bench.Landmarks.NumLandmarks);
+  State.counters["landmark_bytes"] =
+      benchmark::Counter(static_cast<double>(Bench.Landmarks.MemoryUsage),
+                         benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+  State.counters["landmark_build_expanded"] =
+      static_cast<double>(Bench.Landmarks.NodesExpanded);
+  State.counters["landmark_build_s"] = Bench.Landmarks.BuildTime.count();
+}
+BENCHMARK(BM_Landmarks)->Apply(MapArguments);
+
+static void BM_Hierarchy(benchmark::State &State) {
+  // The clusters are built once per map, only the queries are measured.
+  auto &Bench = GetMap(std::get<MapParams>(GetParams(State)));
+  Bench.UseLandmarks(false);
+  Bench.GetHierarchy();
+  RunQueries(State, [](BenchMap &Bench, Coord3D From, Coord3D To) {
+    auto P = Bench.GetHierarchy().TryBuildPath(From, To);
+    benchmark::DoNotOptimize(P);
+    return P.has_value();
+  });
+}
+BENCHMARK(BM_Hierarchy)->Apply(MapArguments);
+
+static void BM_Incremental(benchmark::State &State) {
+  // The routes are built up front, only the repair after a squad steps onto one is measured. As
+  // many routes are held as standing orders of a big game, the queries are reused for them. A
+  // route across a big map touches most of it, fewer of them fit into the memory budget.
+  constexpr size_t kNumRoutes = 256;
+  constexpr size_t kMemoryBudget = size_t{2} << 30;
+  const auto [Params, Kind] = GetParams(State);
+  auto &Bench = GetMap(Params);
+  Bench.UseLandmarks(false);
+  const auto &Queries = Bench.GetQueries(Kind);
+  std::vector<std::pair<IncrementalPath, Coord3D>> Routes;
+  size_t MemoryUsage = 0;
+  for (size_t Q = 0;
+       Q < kNumRoutes * 4 && Routes.size() < kNumRoutes && MemoryUsage < kMemoryBudget; ++Q) {
+    const auto &[From, To] = Queries[Q % Queries.size()];
+    IncrementalPath Route{Bench.Map, From, To};
+    if (const auto P = Route.Update(); P && P->Waypoints.size() > 2) {
+      MemoryUsage += Route.GetMemoryUsage();
+      Routes.emplace_back(std::move(Route), P->Waypoints[P->Waypoints.size() / 2].Coord);
+    }
+  }
+  if (Routes.empty()) {
+    State.SkipWithError("No route to repair");
+    return;
+  }
+
+  size_t I = 0, NodesExpanded = 0, NumFound = 0;
+  for (auto _ : State) {
+    auto &[Route, Blocked] = Routes[I++ % Routes.size()];
+    Bench.Map.SetSquad(Blocked, Id<Squad>{0});
+    const auto NumExpanded = Route.GetNumExpanded();
+    auto P = Route.Update();
+    benchmark::DoNotOptimize(P);
+    NodesExpanded += Route.GetNumExpanded() - NumExpanded;
+    NumFound += P.has_value();
+
+    // Every route catches up with the cleared tile, the next repair sees a single change.
+    State.PauseTiming();
+    Bench.Map.SetSquad(Blocked, NullId);
+    for (auto &Other : Routes) {
+      Other.first.Update();
+    }
+    State.ResumeTiming();
+  }
+  State.counters["found"] =
+      benchmark::Counter(static_cast<double>(NumFound), benchmark::Counter::kAvgIterations);
+  State.counters["expanded"] =
+      benchmark::Counter(static_cast<double>(NodesExpanded), benchmark::Counter::kAvgIterations);
+  MemoryUsage = 0;
+  for (const auto &[Route, Blocked] : Routes) {
+    MemoryUsage += Route.GetMemoryUsage();
+  }
+  State.counters["routes"] = static_cast<double>(Routes.size());
+  State.counters["route_bytes"] =
+      benchmark::Counter(static_cast<double>(MemoryUsage) / static_cast<double>(Routes.size()),
+                         benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_Incremental)->Apply(MapArguments);
+
+namespace {
+
+void SharedTargetArguments(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"size", "layers", "mix", "objects", "query"});
+  for (const int64_t Width : {64, 256, 1024}) {
+    for (const int64_t Mix : {0, 1, 2}) {
+      B->Args({Width, 1, Mix, 5, static_cast<int64_t>(QueryKind::Cross)});
+    }
+  }
+}
+
+// Every squad heads to the first object of the map, as AI squads converging on a capital.
+template <typename Fn> void RunSharedTarget(benchmark::State &State, Fn &&Route) noexcept {
+  const auto [Params, Kind] = GetParams(State);
+  auto &Bench = GetMap(Params);
+  Bench.UseLandmarks(false);
+  const auto Target = Bench.Map.GetObjectsOnLayer(0)[0];
+  const auto Layer = Bench.Map.GetObject(Target).GetLayer();
+  std::vector<Coord3D> Squads;
+  for (const auto &[From, To] : Bench.GetQueries(Kind)) {
+    Squads.push_back(Coord3D{From.X, From.Y, Layer});
+  }
+
+  Route(State, Bench, Target, Squads);
+  State.counters["squads"] = static_cast<double>(Squads.size());
+}
+
+} // namespace
+
+static void BM_SharedTargetSearches(benchmark::State &State) {
+  RunSharedTarget(State, [](benchmark::State &State, BenchMap &Bench, MapObjectId Target,
+                            const std::vector<Coord3D> &Squads) {
+    // The same tiles next to the object the flow field leads to.
+    FlowFieldCache Cache{Bench.Map};
+    std::vector<std::pair<Coord3D, Coord3D>> Queries;
+    for (const auto From : Squads) {
+      if (const auto P = Cache.Get(Target).BuildPath(From)) {
+        Queries.emplace_back(From, P->Target);
+      }
+    }
+    for (auto _ : State) {
+      for (const auto &[From, To] : Queries) {
+        auto P = TryBuildPath(From, To, Bench.Map);
+        benchmark::DoNotOptimize(P);
+      }
+    }
+  });
+}
+BENCHMARK(BM_SharedTargetSearches)->Apply(SharedTargetArguments);
+
+static void BM_SharedTargetFlowField(benchmark::State &State) {
+  RunSharedTarget(State, [](benchmark::State &State, BenchMap &Bench, MapObjectId Target,
+                            const std::vector<Coord3D> &Squads) {
+    for (auto _ : State) {
+      FlowFieldCache Cache{Bench.Map};
+      const auto &Field = Cache.Get(Target);
+      for (const auto From : Squads) {
+        auto P = Field.BuildPath(From);
+        benchmark::DoNotOptimize(P);
+      }
+    }
+  });
+}
+BENCHMARK(BM_SharedTargetFlowField)->Apply(SharedTargetArguments);
+
+namespace {
+
+void FullFieldArguments(benchmark::internal::Benchmark *B, bool HasThreads) {
+  B->ArgNames({"size", "mix", "threads"});
+  for (const int64_t Width : {1024, 2048, 4096}) {
+    for (const int64_t Mix : {1, 2}) {
+      if (!HasThreads) {
+        B->Args({Width, Mix, 1});
+        continue;
+      }
+      for (const int64_t Threads : {1, 2, 4, 8, 16}) {
+        B->Args({Width, Mix, Threads});
+      }
+    }
+  }
+  B->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+// A full field from the center of a single layer map, as the landmarks and the AI need them.
+template <typename Fn> void RunFullField(benchmark::State &State, Fn &&Search) noexcept {
+  auto &Bench = GetMap(MapParams{.Width = static_cast<Size>(State.range(0)),
+                                 .Layers = 1,
+                                 .Mix = static_cast<TerrainMix>(State.range(1)),
+                                 .ObjectPercent = 5});
+  const auto &Nav = Bench.Map.GetNavigation();
+  const auto Costs = Nav.GetCosts(kBaseMovement);
+  const auto Width = static_cast<Dim>(State.range(0));
+  auto Start = Nav.ToIndex(Coord3D{Width / 2, Width / 2, 0});
+  while (!Costs.IsPassable(Start)) {
+    ++Start;
+  }
+
+  SearchStats Stats;
+  for (auto _ : State) {
+    Search(Nav, Costs, Start, Stats);
+  }
+  State.counters["expanded"] = static_cast<double>(Stats.NodesExpanded);
+  State.counters["tiles_per_s"] = benchmark::Counter(
+      static_cast<double>(Stats.NodesExpanded), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+} // namespace
+
+static void BM_FullFieldDijkstra(benchmark::State &State) {
+  RunFullField(State, [](const NavigationGrid &Nav, const MovementCosts &Costs, size_t Start,
+                         SearchStats &Stats) {
+    auto &Scratch = GetSearchScratch();
+    RunDijkstra(Nav, Costs, Scratch, Start, MAX_SIZE, false, [](size_t) { return true; });
+    Scratch.FillStats(Stats);
+  });
+}
+BENCHMARK(BM_FullFieldDijkstra)->Apply([](auto *B) { FullFieldArguments(B, false); });
+
+static void BM_FullFieldDeltaStepping(benchmark::State &State) {
+  // Scaling is measured against BM_FullFieldDijkstra on the same maps.
+  Utils::ThreadPool Pool{static_cast<size_t>(State.range(2))};
+  DeltaStepping Search{Pool};
+  RunFullField(State, [&](const NavigationGrid &Nav, const MovementCosts &Costs, size_t Start,
+                          SearchStats &Stats) {
+    Search.Run(Nav, Costs, Start, MAX_SIZE, false);
+    Search.FillStats(Stats);
+  });
+  State.counters["phases"] = static_cast<double>(Search.GetNumPhases());
+}
+BENCHMARK(BM_FullFieldDeltaStepping)->Apply([](auto *B) { FullFieldArguments(B, true); });
@@ -0,0 +1,131 @@
+#include "engine/delta_stepping.h"
+
+#include <algorithm>
+
+namespace NotAGame {
+
+namespace {
+
+// Buckets as wide as a few steps over the cheapest terrain keep enough tiles in a phase for the
+// threads while few of them are expanded before their final cost is known.
+constexpr Size kStepsPerBucket = 4;
+
+// Big enough for the resets to be worth a task.
+constexpr size_t kResetChunkSize = size_t{1} << 16;
+
+} // namespace
+
+void DeltaStepping::Reset(size_t NumTiles) noexcept {
+  if (NumLabels_ < NumTiles) {
+    Labels_ = std::make_unique<std::atomic<uint64_t>[]>(NumTiles);
+    NumLabels_ = NumTiles;
+    QueuedIn_.resize(NumTiles);
+  }
+  Pool_.ParallelFor((NumTiles + kResetChunkSize - 1) / kResetChunkSize, [&](size_t Chunk) {
+    const size_t End = std::min(NumTiles, (Chunk + 1) * kResetChunkSize);
+    for (size_t I = Chunk * kResetChunkSize; I < End; ++I) {
+      Labels_[I].store(kUnreached, std::memory_order_relaxed);
+      QueuedIn_[I] = kNotQueued;
+    }
+  });
+  NumExpanded_ = 0;
+  NumPhases_ = 0;
+  PeakFrontier_ = 0;
+}
+
+void DeltaStepping::Run(const NavigationGrid &Nav, const MovementCosts &Costs, size_t Start,
+                        Size Budget, bool IsReverse) noexcept {
+  Reset(Nav.GetNumTiles());
+  const Size Delta = Delta_ ? Delta_ : std::max<Size>(Costs.GetMinCost(), 1) * kStepsPerBucket;
+  const size_t NumBuckets = MovementCosts::kMaxCost / Delta + 2;
+  Buckets_.resize(NumBuckets);
+  for (auto &Bucket : Buckets_) {
+    Bucket.clear();
+  }
+
+  Labels_[Start].store(Pack(0, Start), std::memory_order_relaxed);
+  Buckets_[0].push_back(static_cast<uint32_t>(Start));
+  QueuedIn_[Start] = 0;
+  size_t NumQueued = 1;
+
+  for (Size Bucket = 0; NumQueued != 0 && uint64_t{Bucket} * Delta < Budget; ++Bucket) {
+    auto &Slot = Buckets_[Bucket % NumBuckets];
+    // Cheap steps land in the same bucket, so it is expanded until nothing falls into it.
+    while (!Slot.empty()) {
+      NumQueued -= Slot.size();
+      Frontier_.swap(Slot);
+      Slot.clear();
+      PeakFrontier_ = std::max(PeakFrontier_, Frontier_.size());
+      ++NumPhases_;
+
+      const size_t NumChunks = (Frontier_.size() + kChunkSize - 1) / kChunkSize;
+      if (Improved_.size() < NumChunks) {
+        Improved_.resize(NumChunks);
+      }
+      std::atomic<size_t> NumExpanded{0};
+      Pool_.ParallelFor(NumChunks, [&](size_t Chunk) {
+        auto &Improved = Improved_[Chunk];
+        Improved.clear();
+        size_t Expanded = 0;
+        const size_t End = std::min(Frontier_.size(), (Chunk + 1) * kChunkSize);
+        for (size_t I = Chunk * kChunkSize; I < End; ++I) {
+          const size_t Node = Frontier_[I];
+          QueuedIn_[Node] = kNotQueued;
+          const auto Distance = GetDistance(Node);
+          if (Distance / Delta != Bucket || Distance >= Budget) {
+            continue; // Stale entry, the tile was expanded in an earlier bucket.
+          }
+          ++Expanded;
+          Nav.ForEachNeighbour(Node, [&](size_t Next) {
+            if (!Costs.IsPassable(Next)) {
+              return;
+            }
+            const auto NewDistance =
+                Distance + (IsReverse ? Costs.GetStepCost(Next, Node)
+                                      : Costs.GetStepCost(Node, Next));
+            const auto Label = Pack(NewDistance, Node);
+            auto &Target = Labels_[Next];
+            for (auto Old = Target.load(std::memory_order_relaxed); Label < Old;) {
+              if (Target.compare_exchange_weak(Old, Label, std::memory_order_relaxed)) {
+                // A lower predecessor alone does not change the costs behind the tile.
+                if (NewDistance < (Old >> 32)) {
+                  Improved.push_back(static_cast<uint32_t>(Next));
+                }
+                break;
+              }
+            }
+          });
+        }
+        NumExpanded += Expanded;
+      });
+      NumExpanded_ += NumExpanded;
+
+      for (size_t Chunk = 0; Chunk < NumChunks; ++Chunk) {
+        for (const auto Node : Improved_[Chunk]) {
+          const Size Target = GetDistance(Node) / Delta;
+          if (QueuedIn_[Node] != Target) {
+            QueuedIn_[Node] = Target;
+            Buckets_[Target % NumBuckets].push_back(Node);
+            ++NumQueued;
+          }
+        }
+      }
+    }
+  }
+}
+
+void DeltaStepping::FillStats(SearchStats &Stats) const noexcept {
+  Stats.NodesExpanded = NumExpanded_;
+  Stats.PeakHeapSize = PeakFrontier_;
+  size_t NumQueueEntries = Frontier_.capacity();
+  for (const auto &Bucket : Buckets_) {
+    NumQueueEntries += Bucket.capacity();
+  }
+  for (const auto &Improved : Improved_) {
+    NumQueueEntries += Improved.capacity();
+  }
+  Stats.MemoryUsage = NumLabels_ * sizeof(uint64_t) + QueuedIn_.capacity() * sizeof(Size) +
+                      NumQueueEntries * sizeof(uint32_t);
+}
+
+} // namespace NotAGame
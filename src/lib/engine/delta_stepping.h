@@ -0,0 +1,74 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/navigation.h"
+#include "util/thread_pool.h"
+#include "util/types.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace NotAGame {
+
+// Parallel single-source shortest paths (delta-stepping). Tiles are kept in buckets of Delta wide
+// cost ranges, and all the tiles of the lowest bucket are expanded at once on the pool threads,
+// over and over until the bucket stays empty. The relaxations are lock-free: the cost and the
+// predecessor of a tile are packed into one atomic word, so ties resolve to the lowest
+// predecessor and the result does not depend on the schedule.
+//
+// Worth it on full fields of big maps only, a phase costs a round trip through the pool. Must not
+// be run from the pool threads.
+class DeltaStepping {
+public:
+  // A Delta of 0 picks one from the cheapest terrain of the search.
+  explicit DeltaStepping(Utils::ThreadPool &Pool = Utils::ThreadPool::GetDefault(),
+                         Size Delta = 0) noexcept
+      : Pool_{Pool}, Delta_{Delta} {}
+
+  // Same contract as RunDijkstra without a filter.
+  void Run(const NavigationGrid &Nav, const MovementCosts &Costs, size_t Start, Size Budget,
+           bool IsReverse) noexcept;
+
+  Size GetDistance(size_t Node) const noexcept {
+    return static_cast<Size>(Labels_[Node].load(std::memory_order_relaxed) >> 32);
+  }
+  size_t GetPred(size_t Node) const noexcept {
+    return static_cast<uint32_t>(Labels_[Node].load(std::memory_order_relaxed));
+  }
+
+  // Work done by the last search, PeakHeapSize is the largest set of tiles expanded at once.
+  void FillStats(SearchStats &Stats) const noexcept;
+  size_t GetNumPhases() const noexcept { return NumPhases_; }
+
+private:
+  static constexpr uint64_t kUnreached = UINT64_MAX;
+  static constexpr size_t kChunkSize = 1024;
+  static constexpr Size kNotQueued = MAX_SIZE;
+
+  static uint64_t Pack(Size Distance, size_t Pred) noexcept {
+    return uint64_t{Distance} << 32 | static_cast<uint32_t>(Pred);
+  }
+
+  void Reset(size_t NumTiles) noexcept;
+
+  Utils::ThreadPool &Pool_;
+  Size Delta_;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> Labels_;
+  size_t NumLabels_ = 0;
+  // The bucket a tile is waiting in, so it is queued once per bucket.
+  std::vector<Size> QueuedIn_;
+  // A ring of buckets, a step never jumps further than the most expensive terrain.
+  std::vector<std::vector<uint32_t>> Buckets_;
+  std::vector<uint32_t> Frontier_;
+  // Tiles improved by every chunk of the frontier.
+  std::vector<std::vector<uint32_t>> Improved_;
+
+  size_t NumExpanded_ = 0;
+  size_t NumPhases_ = 0;
+  size_t PeakFrontier_ = 0;
+};
+
+} // namespace NotAGame
@@ -1,9 +1,51 @@
 #include "engine/engine.h"
+#include "util/logger.h"
+
+#include <bitset>
 
 namespace NotAGame {
 
-Engine::Engine(Mod &M, MapState &MapState) noexcept
-    : Mod_{M}, MapState_{MapState}, State_{PrepareGameState{M, MapState.GlobalMap}} {}
+namespace {
+
+// Below that many tiles a layer, the phases of a parallel search cost more than they save.
+constexpr size_t kParallelFieldTiles = size_t{1} << 20;
+
+} // namespace
+
+Engine::Engine(Mod &M, MapState &MapState, const LandmarkSettings &Landmarks) noexcept
+    : Mod_{M}, MapState_{MapState}, State_{PrepareGameState{M, MapState.GlobalMap}},
+      FlowFields_{MapState.GlobalMap} {
+  MapState_.GlobalMap.BuildNavigation(Mod_.GetTerrains());
+
+  const auto MapSize = MapState_.GlobalMap.GetNavigation().GetSize();
+  const size_t LayerTiles = size_t{MapSize.Width} * MapSize.Height;
+  if (!Landmarks.IsEnabled || !Landmarks.NumPerLayer || LayerTiles < Landmarks.MinTilesPerLayer) {
+    return;
+  }
+
+  // Terrain does not change during the game, landmarks are computed for every profile a leader
+  // may have.
+  const auto Algorithm =
+      LayerTiles >= kParallelFieldTiles ? FieldAlgorithm::DeltaStepping : FieldAlgorithm::Dijkstra;
+  std::bitset<kNumMovementProfiles> Profiles;
+  Profiles.set(kBaseMovement);
+  for (const auto &Leader : Mod_.GetLeaderPresets()) {
+    Profiles.set(Leader.Movement);
+  }
+  for (size_t Profile = 0; Profile < Profiles.size(); ++Profile) {
+    if (Profiles.test(Profile)) {
+      const auto Stats = BuildLandmarks(MapState_.GlobalMap, Landmarks.NumPerLayer,
+                                        static_cast<MovementProfile>(Profile), Algorithm);
+      LandmarkStats_.NumLandmarks += Stats.NumLandmarks;
+      LandmarkStats_.NodesExpanded += Stats.NodesExpanded;
+      LandmarkStats_.MemoryUsage += Stats.MemoryUsage;
+      LandmarkStats_.BuildTime += Stats.BuildTime;
+    }
+  }
+  LOG(INFO) << "Landmarks: " << LandmarkStats_.NumLandmarks << " for " << Profiles.count()
+            << " profiles, " << LandmarkStats_.MemoryUsage / 1024 << " KiB, built in "
+            << LandmarkStats_.BuildTime.count() << " s\n";
+}
 
 template <typename State, typename Fn>
 auto Engine::CheckStateAndCall(Fn &&Func, const char *FnName) noexcept
@@ -93,15 +135,153 @@ NewTurnEvent Engine::NewTurn() noexcept {
   const auto PlayerId = State.Players[PlayerIdx].MapId;
 
   NewTurnEvent Event{.TurnNo = State.SavedState.Turn, .Player = PlayerId};
+  if (PlayerId.IsInvalid()) { // The neutral player owns nothing on the map.
+    return Event;
+  }
   auto Income = State.SavedState.Map.Systems.Resources.GetTotalIncome(PlayerId);
   Event.Income = std::move(Income);
 
   auto CellsGained = State.SavedState.Map.Systems.LandPropagation.Propagate(
       State.SavedState.Map.GlobalMap, PlayerId);
   Event.CellsGained = std::move(CellsGained);
+
+  RestoreMovePoints(PlayerId);
+  ExecuteMoveOrders(PlayerId, Event);
   return Event;
 }
 
+void Engine::RestoreMovePoints(PlayerId PlayerId) noexcept {
+  auto &Systems = MapState_.Systems;
+  Systems.Squads.ForEach([&](Squad &Squad) {
+    if (Squad.Player_ != PlayerId) {
+      return;
+    }
+    auto &Leader = Systems.Units.GetComponent(Squad.GetLeader());
+    auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
+    LeaderData.Steps.SetValue(LeaderData.Steps.GetEffectiveValue());
+  });
+}
+
+void Engine::ExecuteMoveOrders(PlayerId PlayerId, NewTurnEvent &Event) noexcept {
+  auto &State = std::get<OnlineGameState>(State_);
+  auto &Orders = State.SavedState.PlayerStates[PlayerId].MoveOrders;
+  auto &Systems = MapState_.Systems;
+  const auto &Nav = MapState_.GlobalMap.GetNavigation();
+
+  for (auto It = Orders.begin(); It != Orders.end();) {
+    auto &[SquadId, Order] = *It;
+    auto *Squad = Systems.Squads.GetComponentOrNull(SquadId);
+    if (!Squad || Order.Waypoints.empty() || Order.Waypoints[0].Coord != Squad->Position) {
+      OrderRoutes_.erase(SquadId);
+      It = Orders.erase(It);
+      continue;
+    }
+    auto &Leader = Systems.Units.GetComponent(Squad->GetLeader());
+    auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
+    const auto Costs = Nav.GetCosts(LeaderData.Movement);
+
+    // Tiles patched since the last turn only re-expand the part of the search they affect. The
+    // incremental search is confined to one layer, routes through portals are planned anew.
+    std::optional<Path> Repaired;
+    if (Order.Target.Layer == Squad->Position.Layer) {
+      auto RouteIt = OrderRoutes_.find(SquadId);
+      if (RouteIt == OrderRoutes_.end() || RouteIt->second.GetTarget() != Order.Target) {
+        OrderRoutes_.erase(SquadId);
+        const auto Target = Order.Target;
+        RouteIt = OrderRoutes_
+                      .try_emplace(SquadId, MapState_.GlobalMap, Squad->Position, Target,
+                                   LeaderData.Movement)
+                      .first;
+      }
+      RouteIt->second.SetStart(Squad->Position);
+      Repaired = RouteIt->second.Update();
+    }
+    if (!Repaired) {
+      Repaired =
+          TryBuildPath(Squad->Position, Order.Target, MapState_.GlobalMap, LeaderData.Movement);
+    }
+    if (!Repaired) {
+      Event.SquadsMoved.push_back(SquadMovedEvent{.SquadId = SquadId,
+                                                  .From = Squad->Position,
+                                                  .To = Squad->Position,
+                                                  .IsOrderFinished = true});
+      OrderRoutes_.erase(SquadId);
+      It = Orders.erase(It);
+      continue;
+    }
+    Order = std::move(*Repaired);
+
+    // Every step is still checked against the current map.
+    auto MovePointsRemaining = LeaderData.Steps.GetValue();
+    size_t Steps = 0;
+    bool IsBlocked = false;
+    for (size_t I = 1; I < Order.Waypoints.size() && MovePointsRemaining > 0; ++I, ++Steps) {
+      const auto From = Nav.ToIndex(Order.Waypoints[I - 1].Coord);
+      const auto To = Nav.ToIndex(Order.Waypoints[I].Coord);
+      const bool IsStep =
+          IsValidStep(Order.Waypoints[I - 1].Coord, Order.Waypoints[I].Coord, MapState_.GlobalMap);
+      if (!IsStep || !Costs.IsPassable(To)) {
+        IsBlocked = true;
+        break;
+      }
+      MovePointsRemaining -= std::min(MovePointsRemaining, Costs.GetStepCost(From, To));
+      if (FindOpponent(Squad->Player_, Order.Waypoints[I].Coord)) {
+        ++Steps;
+        break;
+      }
+    }
+
+    const auto From = Squad->Position;
+    if (Steps > 0) {
+      PlaceSquad(*Squad, Order.Waypoints[Steps].Coord);
+      LeaderData.Steps.SetValue(MovePointsRemaining);
+    }
+
+    // Battles are never started on behalf of the player, the march stops next to the enemy.
+    const bool IsFinished =
+        IsBlocked || Steps == Order.Waypoints.size() - 1 || FindOpponent(*Squad) != nullptr;
+    if (Steps > 0 || IsFinished) {
+      Event.SquadsMoved.push_back(SquadMovedEvent{
+          .SquadId = SquadId, .From = From, .To = Squad->Position, .IsOrderFinished = IsFinished});
+    }
+    if (IsFinished) {
+      OrderRoutes_.erase(SquadId);
+      It = Orders.erase(It);
+      continue;
+    }
+    Order.Walk(Steps);
+    SplitPathByDays(Order, MovePointsRemaining, LeaderData.Steps.GetEffectiveValue());
+    ++It;
+  }
+}
+
+void Engine::PlaceSquad(Squad &Moving, Coord3D Position) noexcept {
+  auto &Map = MapState_.GlobalMap;
+  if (Moving.GuardId.IsValid()) { // Leaving.
+    auto &Guard = MapState_.Systems.Guards.GetComponent(Moving.GuardId);
+    Guard.SquadId = NullId;
+    Moving.GuardId = NullId;
+    Moving.Position = Position;
+    Map.SetSquad(Moving.Position, Moving.ComponentId);
+    return;
+  }
+  Map.MoveSquad(Moving.ComponentId, Moving.Position, Position);
+  Moving.Position = Position;
+}
+
+Squad *Engine::FindOpponent(const Squad &Moving) noexcept {
+  return FindOpponent(Moving.Player_, Moving.Position);
+}
+
+Squad *Engine::FindOpponent(PlayerId Player, Coord3D Position) noexcept {
+  auto &Squads = MapState_.Systems.Squads;
+  const auto Opponent = MapState_.GlobalMap.GetSquadIndex().FindNearest(
+      Position, 1, [&](const SpatialIndex<Squad>::Entry &E) {
+        return Squads.GetComponent(E.Item).Player_ != Player;
+      });
+  return Opponent ? &Squads.GetComponent(Opponent->Item) : nullptr;
+}
+
 const StartGameResponse &Engine::StartGame(LobbyPlayerId LobbyPlayerId) noexcept {
   if (!StartGameResponse_) {
     auto NeutralId = EnsureStateAndCall<PrepareGameState>(
@@ -450,51 +630,29 @@ ErrorOr<MoveSquadResponse> Engine::MoveSquad(PlayerId PlayerId, Id<Squad> SquadI
     return Status::Error(ErrorCode::WrongState, "Wrong start point!");
   }
 
-  auto IsReachable = [](Coord3D From, Coord3D To) {
-    auto DX = std::max(From.X, To.X) - std::min(From.X, To.X);
-    auto DY = std::max(From.Y, To.Y) - std::min(From.Y, To.Y);
-    return DX <= 1 && DY <= 1;
-  };
   auto MovePointsRemaining = LeaderComponent->Steps.GetValue();
   auto &Map = MapState_.GlobalMap;
+  const auto &Nav = Map.GetNavigation();
+  const auto Costs = Nav.GetCosts(LeaderComponent->Movement);
   // Dry run.
   size_t Steps = 0;
   for (size_t I = 1; I < Path.Waypoints.size(); ++I, ++Steps) {
     if (MovePointsRemaining == 0) {
       break;
     }
-    if (!IsReachable(Path.Waypoints[I - 1].Coord, Path.Waypoints[I].Coord)) {
+    if (!IsValidStep(Path.Waypoints[I - 1].Coord, Path.Waypoints[I].Coord, Map)) {
       return Status::Error(ErrorCode::WrongState, "Unreachable jump");
     }
-    auto Cost = ComputeMoveCost(Path.Waypoints[I - 1].Coord, Path.Waypoints[I].Coord, Map, Mod_);
+    auto Cost = Costs.GetStepCost(Nav.ToIndex(Path.Waypoints[I - 1].Coord),
+                                  Nav.ToIndex(Path.Waypoints[I].Coord));
     MovePointsRemaining -= std::min(MovePointsRemaining, Cost);
   }
 
-  if (Squad->GuardId.IsValid()) { // Leaving.
-    auto &Guard = Systems.Guards.GetComponent(Squad->GuardId);
-    Guard.SquadId = NullId;
-  } else {
-    Map.GetTile(Squad->Position).Squad_ = NullId;
-  }
-
-  Squad->Position = Path.Waypoints[Steps].Coord;
-  Map.GetTile(Squad->Position).Squad_ = SquadId;
+  CancelMoveOrder(PlayerId, SquadId);
+  PlaceSquad(*Squad, Path.Waypoints[Steps].Coord);
   LeaderComponent->Steps.SetValue(MovePointsRemaining);
 
-  NotAGame::Squad *OpponentSquad = nullptr;
-  for (const auto Neighboor : GetPlaneNeighboors(Squad->Position)) {
-    if (!Map.IsValid(Neighboor)) {
-      continue;
-    }
-    if (const auto NeighboorSquadId = Map.GetTile(Neighboor).Squad_; NeighboorSquadId.IsValid()) {
-      auto &NeighboorSquad = Systems.Squads.GetComponent(NeighboorSquadId);
-      if (NeighboorSquad.Player_ != PlayerId) {
-        OpponentSquad = &NeighboorSquad;
-        break;
-      }
-    }
-  }
-
+  auto *OpponentSquad = FindOpponent(*Squad);
   if (OpponentSquad) {
     CreateBattleState(*Squad, *OpponentSquad);
   }
@@ -505,4 +663,70 @@ ErrorOr<MoveSquadResponse> Engine::MoveSquad(PlayerId PlayerId, Id<Squad> SquadI
                            .SquadAttacked = OpponentSquad ? OpponentSquad->ComponentId : NullId};
 }
 
+Status Engine::SetMoveOrder(PlayerId PlayerId, Id<Squad> SquadId, Path Path) noexcept {
+  auto &State = std::get<OnlineGameState>(State_);
+  auto *Squad = State.SavedState.Map.Systems.Squads.GetComponentOrNull(SquadId);
+  if (!Squad) {
+    return Status::Error(ErrorCode::WrongState, "Non-existing squad id!");
+  }
+  if (Squad->Player_ != PlayerId) {
+    return Status::Error(ErrorCode::WrongPlayer, "Not this player's squad!");
+  }
+  if (Path.Waypoints.size() < 2) {
+    return Status::Error(ErrorCode::WrongState, "Empty path!");
+  }
+  if (Path.Waypoints[0].Coord != Squad->Position) {
+    return Status::Error(ErrorCode::WrongState, "Wrong start point!");
+  }
+
+  const auto &Systems = State.SavedState.Map.Systems;
+  const auto &Leader = Systems.Units.GetComponent(Squad->GetLeader());
+  const auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
+  SplitPathByDays(Path, LeaderData.Steps.GetValue(), LeaderData.Steps.GetEffectiveValue());
+  OrderRoutes_.erase(SquadId);
+  OrderRoutes_.try_emplace(SquadId, MapState_.GlobalMap, Squad->Position, Path.Target,
+                           LeaderData.Movement);
+  State.SavedState.PlayerStates[PlayerId].MoveOrders.insert_or_assign(SquadId, std::move(Path));
+  return Status::Success();
+}
+
+void Engine::CancelMoveOrder(PlayerId PlayerId, Id<Squad> SquadId) noexcept {
+  auto &State = std::get<OnlineGameState>(State_);
+  State.SavedState.PlayerStates[PlayerId].MoveOrders.erase(SquadId);
+  OrderRoutes_.erase(SquadId);
+}
+
+Status Engine::EndTurn(const Player &Player) noexcept {
+  auto *State = std::get_if<OnlineGameState>(&State_);
+  if (!State) {
+    return Status::Error(ErrorCode::WrongState, "Game is not started!");
+  }
+  const auto &Players = State->Players;
+  if (Players[State->SavedState.CurrentPlayerIdx].MapId != Player.MapId) {
+    return Status::Error(ErrorCode::WrongPlayer, "Not this player's turn!");
+  }
+
+  // AI players do not act yet, their turns only continue their move orders.
+  for (size_t I = 0; I < Players.size(); ++I) {
+    auto Event = NewTurn();
+    if (Event.Income) {
+      State->SavedState.PlayerStates[Event.Player].ResourcesGained += *Event.Income;
+    }
+    if (EventListener_) {
+      EventListener_->OnPlayerNewTurn(Event);
+    }
+    if (Players[State->SavedState.CurrentPlayerIdx].Source != PlayerKind::AI) {
+      break;
+    }
+  }
+  return Status::Success();
+}
+
+const Path *Engine::GetMoveOrder(PlayerId PlayerId, Id<Squad> SquadId) const noexcept {
+  const auto &State = std::get<OnlineGameState>(State_);
+  const auto &Orders = State.SavedState.PlayerStates[PlayerId].MoveOrders;
+  const auto It = Orders.find(SquadId);
+  return It != Orders.end() ? &It->second : nullptr;
+}
+
 } // namespace NotAGame
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "engine/event.h"
+#include "engine/flow_field.h"
+#include "engine/incremental_path.h"
+#include "engine/landmarks.h"
 #include "engine/path.h"
 #include "engine/player.h"
 #include "entities/global_map.h"
@@ -13,10 +16,18 @@ struct PlayerAddResult {
   Size PlayerId;
 };
 
+struct SquadMovedEvent {
+  Id<Squad> SquadId;
+  Coord3D From;
+  Coord3D To;
+  bool IsOrderFinished; // Either the target is reached or the order cannot be continued.
+};
+
 struct NewTurnEvent : public Event {
   Size TurnNo;
   PlayerId Player;
   std::vector<Coord3D> CellsGained;
+  std::vector<SquadMovedEvent> SquadsMoved; // By the move orders of the player.
   std::optional<Resources> Income; // Only for the player becoming active.
 };
 
@@ -72,6 +83,16 @@ struct AttackOption {
   Id<Unit> UnitId;
 };
 
+// ALT preprocessing of the map when the engine is created, off by default. The table takes
+// 4 bytes per tile, landmark, layer and movement profile, and every landmark costs two searches
+// over its layer while the game loads.
+struct LandmarkSettings {
+  bool IsEnabled = false;
+  size_t NumPerLayer = 8;
+  // Searches on smaller layers are fast enough without landmarks.
+  size_t MinTilesPerLayer = size_t{512} * 512;
+};
+
 class EventListener {
 public:
   virtual void OnPlayerNewTurn(const NewTurnEvent &Event) noexcept = 0;
@@ -79,7 +100,10 @@ public:
 
 class Engine {
 public:
-  Engine(Mod &M, MapState &MapState) noexcept;
+  Engine(Mod &M, MapState &MapState, const LandmarkSettings &Landmarks = {}) noexcept;
+
+  // Summed over the movement profiles, empty when landmarks were not built.
+  const LandmarkStats &GetLandmarkStats() const noexcept { return LandmarkStats_; }
 
   ErrorOr<LobbyPlayerId> PlayerConnect(PlayerKind PlayerKind) noexcept;
   Status PlayerDisconnect(LobbyPlayerId Id) noexcept;
@@ -100,13 +124,25 @@ public:
 
   ErrorOr<MoveSquadResponse> MoveSquad(PlayerId PlayerId, Id<Squad> SquadId,
                                        const Path &Path) noexcept;
+
+  // Move orders are executed for all squads of the player at once, at the start of each of
+  // their turns. A manual move of the squad cancels its order.
+  Status SetMoveOrder(PlayerId PlayerId, Id<Squad> SquadId, Path Path) noexcept;
+  void CancelMoveOrder(PlayerId PlayerId, Id<Squad> SquadId) noexcept;
+  const Path *GetMoveOrder(PlayerId PlayerId, Id<Squad> SquadId) const noexcept;
   void PerformAction(GameplaySystems &Systems, Unit &U,
                      const AttackOption &AttackOpt) noexcept;
 
+  // Starts the turn of the next human player, the move orders of the players in between are
+  // executed on the way.
   Status EndTurn(const Player &Player) noexcept;
 
   void SetEventListener(EventListener *Listener) noexcept { EventListener_ = Listener; }
 
+  // Routes to map objects shared by all squads heading there, e.g. by AI players converging on a
+  // capital.
+  FlowFieldCache &GetFlowFields() noexcept { return FlowFields_; }
+
   OnlineGameState *GetOnlineState() { return std::get_if<OnlineGameState>(&State_); }
 
 private:
@@ -125,6 +161,11 @@ private:
       -> decltype(Func(static_cast<State *>(nullptr)));
 
   NewTurnEvent NewTurn() noexcept;
+  void RestoreMovePoints(PlayerId PlayerId) noexcept;
+  void ExecuteMoveOrders(PlayerId PlayerId, NewTurnEvent &Event) noexcept;
+  void PlaceSquad(Squad &Moving, Coord3D Position) noexcept;
+  Squad *FindOpponent(const Squad &Moving) noexcept;
+  Squad *FindOpponent(PlayerId Player, Coord3D Position) noexcept;
 
   void CreateBattleState(Squad &Attacker, Squad &Defender) noexcept;
   void NewBattleRound(BattleState &BattleState, Squad &Attacker, Squad &Defender) noexcept;
@@ -139,8 +180,12 @@ private:
   Mod &Mod_;
   MapState &MapState_;
   GameState State_;
-  EventListener *EventListener_;
+  EventListener *EventListener_ = nullptr;
   std::optional<StartGameResponse> StartGameResponse_;
+  // Search state of the move orders, repaired instead of replanned when the map changes.
+  std::unordered_map<Id<Squad>, IncrementalPath> OrderRoutes_;
+  FlowFieldCache FlowFields_;
+  LandmarkStats LandmarkStats_;
 
   using OutstandingUpdates = SmallVector<std::unique_ptr<Event>, 16>;
   SmallVector<OutstandingUpdates, kMaxPlayers> OutstandingUpdates_;
@@ -0,0 +1,234 @@
+#include "engine/flow_field.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace NotAGame {
+
+std::optional<std::pair<size_t, Size>> FlowField::GetBestStep(size_t From) const noexcept {
+  const auto &Nav = Map_->GetNavigation();
+  const auto Costs = Nav.GetCosts(Profile_);
+  std::optional<std::pair<size_t, Size>> Best;
+  Nav.ForEachNeighbour(From, [&](size_t Next) {
+    const auto Remaining = Costs_[Next - First_];
+    if (Remaining == MAX_SIZE) {
+      return;
+    }
+    const auto Cost = Costs.GetStepCost(From, Next) + Remaining;
+    if (!Best || Cost < Best->second) {
+      Best = {Next, Cost};
+    }
+  });
+  return Best;
+}
+
+std::optional<Size> FlowField::GetCost(Coord3D From) const noexcept {
+  if (!Map_->IsValid(From) || From.Layer != Layer_) {
+    return std::nullopt;
+  }
+  const auto Start = Map_->GetNavigation().ToIndex(From);
+  if (const auto Cost = Costs_[Start - First_]; Cost != MAX_SIZE) {
+    return Cost;
+  }
+  const auto Step = GetBestStep(Start);
+  return Step ? std::optional<Size>{Step->second} : std::nullopt;
+}
+
+std::optional<Path> FlowField::BuildPath(Coord3D From) const noexcept {
+  if (!GetCost(From)) {
+    return std::nullopt;
+  }
+
+  const auto &Nav = Map_->GetNavigation();
+  Path P;
+  P.Start = From;
+  P.Waypoints.push_back(Waypoint{.Coord = From, .Cost = 0});
+  for (auto Node = Nav.ToIndex(From); Costs_[Node - First_] != 0;) {
+    const auto Step = GetBestStep(Node);
+    // The costs strictly decrease downhill, a longer walk means the field is broken.
+    if (!Step || P.Waypoints.size() > Costs_.size()) {
+      return std::nullopt;
+    }
+    const auto Cost = P.Waypoints.back().Cost + (Step->second - Costs_[Step->first - First_]);
+    P.Waypoints.push_back(Waypoint{.Coord = Nav.ToCoord(Step->first), .Cost = Cost});
+    Node = Step->first;
+  }
+  P.Target = P.Waypoints.back().Coord;
+  return std::move(P);
+}
+
+const FlowField &FlowFieldCache::Get(MapObjectId Target, MovementProfile Profile) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto [It, IsNew] = Fields_.try_emplace(GetKey(Target, Profile));
+  auto &Field = It->second;
+  if (IsNew) {
+    const auto &Object = Map_.GetObject(Target);
+    Field.Map_ = &Map_;
+    Field.Target_ = Target;
+    Field.Profile_ = Profile;
+    Field.Layer_ = Object.GetLayer();
+    Field.First_ = Nav.GetFirstIndex(Field.Layer_);
+    Field.Costs_.resize(Nav.GetPlaneSize());
+    Compute(Field);
+    return Field;
+  }
+
+  if (Field.Revision_ == Nav.GetRevision()) {
+    return Field;
+  }
+  std::vector<size_t> Changes;
+  if (Nav.GetChangesSince(Field.Revision_, Changes)) {
+    Repair(Field, Changes);
+  } else {
+    Compute(Field);
+  }
+  return Field;
+}
+
+void FlowFieldCache::Compute(FlowField &Field) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto Costs = Nav.GetCosts(Field.Profile_);
+  const auto &Object = Map_.GetObject(Field.Target_);
+  const auto MapSize = Nav.GetSize();
+
+  // Squads come next to the entrance, or to any tile of an object without one.
+  Coord Origin{Object.GetX(), Object.GetY()};
+  Dims2D Extent = Object.GetSize();
+  if (const auto Entrance = Object.GetEntrancePosAbsolute()) {
+    Origin = Coord{Entrance->X, Entrance->Y};
+    Extent = Dims2D{1, 1};
+  }
+  Field.Goals_.clear();
+  const Dim MinX = Origin.X - std::min<Dim>(Origin.X, 1);
+  const Dim MinY = Origin.Y - std::min<Dim>(Origin.Y, 1);
+  const Dim MaxX = std::min<Dim>(Origin.X + Extent.Width, MapSize.Width - 1);
+  const Dim MaxY = std::min<Dim>(Origin.Y + Extent.Height, MapSize.Height - 1);
+  for (Dim Y = MinY; Y <= MaxY; ++Y) {
+    for (Dim X = MinX; X <= MaxX; ++X) {
+      if (const auto Tile = Nav.ToIndex(Coord3D{X, Y, Field.Layer_}); Costs.IsPassable(Tile)) {
+        Field.Goals_.push_back(Tile);
+      }
+    }
+  }
+
+  std::fill(Field.Costs_.begin(), Field.Costs_.end(), MAX_SIZE);
+  std::vector<std::pair<Size, size_t>> Heap;
+  for (const auto Goal : Field.Goals_) {
+    Field.Costs_[Goal - Field.First_] = 0;
+    Heap.emplace_back(0, Goal);
+  }
+  Propagate(Field, Heap);
+  Field.Revision_ = Nav.GetRevision();
+  ++NumComputed_;
+}
+
+void FlowFieldCache::Repair(FlowField &Field, const std::vector<size_t> &Changes) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto &Object = Map_.GetObject(Field.Target_);
+  const auto Origin = Object.GetPosition();
+  const auto Extent = Object.GetSize();
+  auto IsNearTarget = [&](Coord3D Tile) {
+    return Tile.X + 1 >= Origin.X && Tile.X <= Origin.X + Extent.Width &&
+           Tile.Y + 1 >= Origin.Y && Tile.Y <= Origin.Y + Extent.Height;
+  };
+
+  // A patched tile changes the steps into it and out of it: the tiles whose best route may have
+  // entered it are its neighbours farther from the target, and the tile itself left through one.
+  const auto Costs = Nav.GetCosts(Field.Profile_);
+  std::vector<std::pair<Size, size_t>> Invalid;
+  for (const auto Tile : Changes) {
+    const auto Coord = Nav.ToCoord(Tile);
+    if (Coord.Layer != Field.Layer_) {
+      continue;
+    }
+    if (IsNearTarget(Coord)) {
+      Compute(Field); // The goals themselves may have changed.
+      return;
+    }
+    const auto Cost = Field.Costs_[Tile - Field.First_];
+    if (Cost == MAX_SIZE) {
+      continue;
+    }
+    Invalid.emplace_back(Cost, Tile);
+    Nav.ForEachNeighbour(Tile, [&](size_t Prev) {
+      if (const auto PrevCost = Field.Costs_[Prev - Field.First_];
+          PrevCost != MAX_SIZE && PrevCost >= Cost) {
+        Invalid.emplace_back(PrevCost, Prev);
+      }
+    });
+  }
+  Field.Revision_ = Nav.GetRevision();
+
+  // Walk the routes outwards: a tile whose cost was reached through an invalid tile is invalid
+  // too. Costs are cleared as tiles are found, the worklist keeps their old values.
+  for (const auto &[Cost, Tile] : Invalid) {
+    Field.Costs_[Tile - Field.First_] = MAX_SIZE;
+  }
+  for (size_t I = 0; I < Invalid.size(); ++I) {
+    const auto [Cost, Node] = Invalid[I];
+    Nav.ForEachNeighbour(Node, [&, Cost = Cost, Node = Node](size_t Prev) {
+      auto &PrevCost = Field.Costs_[Prev - Field.First_];
+      if (PrevCost != MAX_SIZE && PrevCost == Cost + Costs.GetStepCost(Prev, Node)) {
+        Invalid.emplace_back(PrevCost, Prev);
+        PrevCost = MAX_SIZE;
+      }
+    });
+  }
+
+  // The settled neighbours of the cleared tiles and of the patched ones restart the search, the
+  // latter may have opened a cheaper route.
+  std::vector<std::pair<Size, size_t>> Heap;
+  auto AddSettledNeighbours = [&](size_t Tile) {
+    Nav.ForEachNeighbour(Tile, [&](size_t Next) {
+      if (const auto Cost = Field.Costs_[Next - Field.First_]; Cost != MAX_SIZE) {
+        Heap.emplace_back(Cost, Next);
+      }
+    });
+  };
+  for (const auto &[Cost, Tile] : Invalid) {
+    AddSettledNeighbours(Tile);
+  }
+  for (const auto Tile : Changes) {
+    if (Nav.ToCoord(Tile).Layer == Field.Layer_) {
+      AddSettledNeighbours(Tile);
+    }
+  }
+  if (Heap.empty()) {
+    return;
+  }
+  std::sort(Heap.begin(), Heap.end());
+  Heap.erase(std::unique(Heap.begin(), Heap.end()), Heap.end());
+  std::make_heap(Heap.begin(), Heap.end(), std::greater<>{});
+  Propagate(Field, Heap);
+  ++NumRepaired_;
+}
+
+void FlowFieldCache::Propagate(FlowField &Field,
+                               std::vector<std::pair<Size, size_t>> &Heap) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto Costs = Nav.GetCosts(Field.Profile_);
+  // Reverse Dijkstra: the cost of a tile is the cost of the path from it to the goals.
+  while (!Heap.empty()) {
+    std::pop_heap(Heap.begin(), Heap.end(), std::greater<>{});
+    const auto [Distance, Node] = Heap.back();
+    Heap.pop_back();
+    if (Distance != Field.Costs_[Node - Field.First_]) {
+      continue; // Stale entry.
+    }
+    ++NumExpanded_;
+    Nav.ForEachNeighbour(Node, [&, Distance = Distance, Node = Node](size_t Prev) {
+      if (!Costs.IsPassable(Prev)) {
+        return;
+      }
+      const auto NewDistance = Distance + Costs.GetStepCost(Prev, Node);
+      auto &PrevDistance = Field.Costs_[Prev - Field.First_];
+      if (NewDistance < PrevDistance) {
+        PrevDistance = NewDistance;
+        Heap.emplace_back(NewDistance, Prev);
+        std::push_heap(Heap.begin(), Heap.end(), std::greater<>{});
+      }
+    });
+  }
+}
+
+} // namespace NotAGame
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/global_map.h"
+#include "entities/movement.h"
+#include "util/id.h"
+#include "util/types.h"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace NotAGame {
+
+// Costs from every tile of a layer to a map object, i.e. to the tiles next to its entrance, or
+// next to any of its tiles if it has none. A squad follows the field downhill, so one field serves
+// every squad heading to the object.
+class FlowField {
+public:
+  MapObjectId GetTarget() const noexcept { return Target_; }
+  MovementProfile GetProfile() const noexcept { return Profile_; }
+
+  // From a tile the field does not cover, like a squad's own tile or an object it stands in, the
+  // cheapest step into the field is taken.
+  std::optional<Size> GetCost(Coord3D From) const noexcept;
+  std::optional<Path> BuildPath(Coord3D From) const noexcept;
+
+private:
+  friend class FlowFieldCache;
+
+  // The neighbour to step to and the total cost through it.
+  std::optional<std::pair<size_t, Size>> GetBestStep(size_t From) const noexcept;
+
+  const GlobalMap *Map_ = nullptr;
+  MapObjectId Target_;
+  MovementProfile Profile_ = kBaseMovement;
+  Dim Layer_ = 0;
+  size_t First_ = 0; // Index of the first tile of the layer.
+  NavigationGrid::Revision Revision_ = 0;
+  std::vector<size_t> Goals_;
+  std::vector<Size> Costs_;
+};
+
+// Flow fields keyed by target object and movement profile. A field is computed on first use and
+// on later uses pulls the tiles patched since then from the navigation journal: only the tiles
+// whose route ran through the patched ones are searched again. Not thread-safe.
+class FlowFieldCache {
+public:
+  explicit FlowFieldCache(const GlobalMap &Map) noexcept : Map_{Map} {}
+
+  const FlowField &Get(MapObjectId Target, MovementProfile Profile = kBaseMovement) noexcept;
+
+  void Clear() noexcept { Fields_.clear(); }
+  size_t GetNumFields() const noexcept { return Fields_.size(); }
+
+  // Work done by the cache so far.
+  size_t GetNumComputed() const noexcept { return NumComputed_; }
+  size_t GetNumRepaired() const noexcept { return NumRepaired_; }
+  size_t GetNumExpanded() const noexcept { return NumExpanded_; }
+
+private:
+  static uint64_t GetKey(MapObjectId Target, MovementProfile Profile) noexcept {
+    return uint64_t{Target.GetValue()} << 8 | Profile;
+  }
+
+  void Compute(FlowField &Field) noexcept;
+  void Repair(FlowField &Field, const std::vector<size_t> &Changes) noexcept;
+  // Continues the search from the tiles already settled and queued.
+  void Propagate(FlowField &Field, std::vector<std::pair<Size, size_t>> &Heap) noexcept;
+
+  const GlobalMap &Map_;
+  std::unordered_map<uint64_t, FlowField> Fields_;
+  size_t NumComputed_ = 0;
+  size_t NumRepaired_ = 0;
+  size_t NumExpanded_ = 0;
+};
+
+} // namespace NotAGame
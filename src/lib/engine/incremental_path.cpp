@@ -0,0 +1,259 @@
+#include "engine/incremental_path.h"
+#include "engine/path_search.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace NotAGame {
+
+IncrementalPath::IncrementalPath(const GlobalMap &Map, Coord3D From, Coord3D To,
+                                 MovementProfile Profile) noexcept
+    : Map_{Map}, Profile_{Profile} {
+  const auto &Nav = Map_.GetNavigation();
+  Start_ = LastStart_ = Nav.ToIndex(From);
+  Target_ = Nav.ToIndex(To);
+  FirstIndex_ = Nav.GetFirstIndex(To.Layer);
+  Stride_ = Nav.GetStride();
+  PagesPerRow_ = (Stride_ + kPageMask) >> kPageShift;
+  const auto NumRows = (Nav.GetPlaneSize() / Stride_ + kPageMask) >> kPageShift;
+  Pages_.resize(PagesPerRow_ * NumRows);
+  Reset();
+}
+
+void IncrementalPath::Reset() noexcept {
+  if (++Generation_ == 0) {
+    for (auto &P : Pages_) {
+      if (P) {
+        P->Stamps.fill(0);
+      }
+    }
+    Generation_ = 1;
+  }
+  Heap_.clear();
+  KeyModifier_ = 0;
+  LastStart_ = Start_;
+  Revision_ = Map_.GetNavigation().GetRevision();
+
+  Touch(Target_).Rhs = 0;
+  Heap_.push_back({CalculateKey(Target_), Target_});
+}
+
+void IncrementalPath::SetStart(Coord3D From) noexcept {
+  const auto Start = Map_.GetNavigation().ToIndex(From);
+  if (Start == Start_) {
+    return;
+  }
+  const auto OldStart = Start_;
+  Start_ = Start;
+  // Keys computed for the old start stay valid lower bounds once the difference is added.
+  KeyModifier_ += GetHeuristic(LastStart_);
+  LastStart_ = Start_;
+  // The start is the only tile the squad may leave while standing on it.
+  UpdateVertex(OldStart);
+  UpdateVertex(Start_);
+}
+
+auto IncrementalPath::Touch(size_t Node) noexcept -> NodeState & {
+  const auto [PageIndex, Offset] = Locate(Node);
+  auto &P = Pages_[PageIndex];
+  if (!P) {
+    P = std::make_unique<Page>();
+    ++NumPages_;
+  }
+  if (P->Stamps[Offset] != Generation_) {
+    P->Stamps[Offset] = Generation_;
+    P->States[Offset] = NodeState{};
+  }
+  return P->States[Offset];
+}
+
+size_t IncrementalPath::GetMemoryUsage() const noexcept {
+  return sizeof(*this) + Pages_.capacity() * sizeof(Pages_[0]) + NumPages_ * sizeof(Page) +
+         Heap_.capacity() * sizeof(HeapItem);
+}
+
+bool IncrementalPath::IsUsable(size_t Node) const noexcept {
+  return Node == Start_ || GetCosts().IsPassable(Node);
+}
+
+Size IncrementalPath::GetHeuristic(size_t Node) const noexcept {
+  // One step less than the octile distance: the first step out of an object is free.
+  const auto &Nav = Map_.GetNavigation();
+  const auto From = Nav.ToCoord(Start_), To = Nav.ToCoord(Node);
+  const auto Distance = std::max(AbsDiff(From.X, To.X), AbsDiff(From.Y, To.Y));
+  return GetCosts().GetMinCost() * (Distance ? Distance - 1 : 0);
+}
+
+auto IncrementalPath::CalculateKey(size_t Node) const noexcept -> Key {
+  const auto State = GetState(Node);
+  const uint64_t Cost = std::min(State.G, State.Rhs);
+  return {Cost + GetHeuristic(Node) + KeyModifier_, Cost};
+}
+
+void IncrementalPath::UpdateVertex(size_t Node) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (Nav.ToCoord(Node).Layer != Nav.ToCoord(Target_).Layer) {
+    return;
+  }
+
+  if (Node != Target_) {
+    const auto Costs = GetCosts();
+    Size Rhs = MAX_SIZE;
+    if (IsUsable(Node)) {
+      Nav.ForEachNeighbour(Node, [&](size_t Next) {
+        const auto G = GetState(Next).G;
+        if (G != MAX_SIZE && Costs.IsPassable(Next)) {
+          Rhs = std::min(Rhs, G + Costs.GetStepCost(Node, Next));
+        }
+      });
+    }
+    if (Rhs == MAX_SIZE && !IsTouched(Node)) {
+      return; // Never reached and still unreachable.
+    }
+    Touch(Node).Rhs = Rhs;
+  }
+
+  const auto State = GetState(Node);
+  if (State.G != State.Rhs) {
+    Heap_.push_back({CalculateKey(Node), Node});
+    std::push_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+  }
+}
+
+void IncrementalPath::LowerVertex(size_t Prev, size_t Next, Size G) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (Prev == Target_ || Nav.ToCoord(Prev).Layer != Nav.ToCoord(Target_).Layer ||
+      !IsUsable(Prev)) {
+    return;
+  }
+  auto &State = Touch(Prev);
+  const auto Rhs = G + GetCosts().GetStepCost(Prev, Next);
+  if (Rhs < State.Rhs) {
+    State.Rhs = Rhs;
+    if (State.G != State.Rhs) {
+      Heap_.push_back({CalculateKey(Prev), Prev});
+      std::push_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+    }
+  }
+}
+
+void IncrementalPath::ComputeShortestPath() noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  // Outdated heap entries are left in place and dropped or requeued once popped.
+  while (!Heap_.empty()) {
+    const auto StartState = GetState(Start_);
+    if (!(Heap_.front().K < CalculateKey(Start_)) && StartState.G == StartState.Rhs) {
+      break;
+    }
+
+    std::pop_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+    const auto [OldKey, Node] = Heap_.back();
+    Heap_.pop_back();
+
+    auto &State = Touch(Node);
+    if (State.G == State.Rhs) {
+      continue;
+    }
+    if (const auto NewKey = CalculateKey(Node); OldKey < NewKey) {
+      Heap_.push_back({NewKey, Node});
+      std::push_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+      continue;
+    }
+
+    ++NumExpanded_;
+    if (State.G > State.Rhs) {
+      // Lowering a node can only lower its predecessors, no need to rescan their neighbours.
+      State.G = State.Rhs;
+      if (GetCosts().IsPassable(Node)) {
+        Nav.ForEachNeighbour(Node, [&, Node = Node, G = State.G](size_t Prev) {
+          LowerVertex(Prev, Node, G);
+        });
+      }
+    } else {
+      State.G = MAX_SIZE;
+      UpdateVertex(Node);
+      Nav.ForEachNeighbour(Node, [&, Node = Node](size_t Prev) { UpdateVertex(Prev); });
+    }
+  }
+}
+
+void IncrementalPath::PruneHeap() noexcept {
+  if (Heap_.size() <= PruneSize_) {
+    return;
+  }
+  // The search stops with entries left in the heap, each repair adds more. Only the lowest entry
+  // of a node that is still inconsistent is needed.
+  std::erase_if(Heap_, [&](const HeapItem &Item) {
+    const auto State = GetState(Item.Node);
+    return State.G == State.Rhs;
+  });
+  std::sort(Heap_.begin(), Heap_.end(), [](const HeapItem &A, const HeapItem &B) {
+    return std::tie(A.Node, A.K) < std::tie(B.Node, B.K);
+  });
+  Heap_.erase(std::unique(Heap_.begin(), Heap_.end(),
+                          [](const HeapItem &A, const HeapItem &B) { return A.Node == B.Node; }),
+              Heap_.end());
+  std::make_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+  PruneSize_ = std::max<size_t>(2 * Heap_.size(), 1024);
+}
+
+std::optional<Path> IncrementalPath::ExtractPath() const noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto Costs = GetCosts();
+  if (GetState(Start_).G == MAX_SIZE) {
+    return std::nullopt;
+  }
+
+  Path P;
+  P.Start = Nav.ToCoord(Start_);
+  P.Target = Nav.ToCoord(Target_);
+  P.Waypoints.push_back(Waypoint{.Coord = P.Start, .Cost = 0});
+  // Every step strictly decreases the remaining cost, except the free step out of the start.
+  for (auto Node = Start_; Node != Target_;) {
+    size_t Best = Node;
+    uint64_t BestCost = MAX_SIZE;
+    Nav.ForEachNeighbour(Node, [&](size_t Next) {
+      const auto G = GetState(Next).G;
+      if (G == MAX_SIZE || !Costs.IsPassable(Next)) {
+        return;
+      }
+      const uint64_t Cost = uint64_t{G} + Costs.GetStepCost(Node, Next);
+      if (Cost < BestCost) {
+        Best = Next;
+        BestCost = Cost;
+      }
+    });
+    if (Best == Node || P.Waypoints.size() > Nav.GetNumTiles()) {
+      return std::nullopt;
+    }
+    const auto Cost = P.Waypoints.back().Cost + Costs.GetStepCost(Node, Best);
+    P.Waypoints.push_back(Waypoint{.Coord = Nav.ToCoord(Best), .Cost = Cost});
+    Node = Best;
+  }
+  return std::move(P);
+}
+
+std::optional<Path> IncrementalPath::Update() noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (Nav.ToCoord(Start_).Layer != Nav.ToCoord(Target_).Layer || !GetCosts().IsPassable(Target_)) {
+    return std::nullopt;
+  }
+
+  std::vector<size_t> Changes;
+  if (!Nav.GetChangesSince(Revision_, Changes)) {
+    Reset();
+  } else {
+    Revision_ = Nav.GetRevision();
+    // A patched tile changes the costs of the steps both into it and out of it.
+    for (const auto Tile : Changes) {
+      UpdateVertex(Tile);
+      Nav.ForEachNeighbour(Tile, [&](size_t Prev) { UpdateVertex(Prev); });
+    }
+  }
+
+  ComputeShortestPath();
+  PruneHeap();
+  return ExtractPath();
+}
+
+} // namespace NotAGame
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/global_map.h"
+#include "util/types.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace NotAGame {
+
+// Route to a fixed target that survives map changes (D* Lite). The search runs backwards from
+// the target and keeps its state, so when tiles are patched or the squad advances only the nodes
+// affected by the change are expanded again instead of the whole route.
+class IncrementalPath {
+public:
+  IncrementalPath(const GlobalMap &Map, Coord3D From, Coord3D To,
+                  MovementProfile Profile = kBaseMovement) noexcept;
+
+  Coord3D GetStart() const noexcept { return Map_.GetNavigation().ToCoord(Start_); }
+  Coord3D GetTarget() const noexcept { return Map_.GetNavigation().ToCoord(Target_); }
+
+  // Moves the start after the squad has walked along the route.
+  void SetStart(Coord3D From) noexcept;
+
+  // Pulls the tiles patched since the last call, repairs the search and returns the current best
+  // route, nullopt if the target is unreachable now.
+  std::optional<Path> Update() noexcept;
+
+  // Nodes expanded by all the searches so far.
+  size_t GetNumExpanded() const noexcept { return NumExpanded_; }
+  // Bytes held by the search state, grows with the area the searches have touched.
+  size_t GetMemoryUsage() const noexcept;
+
+private:
+  using Key = std::pair<uint64_t, uint64_t>;
+
+  struct NodeState {
+    Size G = MAX_SIZE;
+    Size Rhs = MAX_SIZE;
+  };
+
+  // The state is kept for square blocks of the layer allocated on first touch, a route holds
+  // memory for the area around it rather than for the whole layer.
+  static constexpr size_t kPageShift = 5;
+  static constexpr size_t kPageMask = (size_t{1} << kPageShift) - 1;
+  static constexpr size_t kPageTiles = size_t{1} << (2 * kPageShift);
+
+  struct Page {
+    std::array<NodeState, kPageTiles> States;
+    std::array<uint32_t, kPageTiles> Stamps{};
+  };
+
+  struct HeapItem {
+    Key K;
+    size_t Node;
+
+    bool operator>(const HeapItem &RHS) const noexcept { return K > RHS.K; }
+  };
+
+  void Reset() noexcept;
+
+  MovementCosts GetCosts() const noexcept { return Map_.GetNavigation().GetCosts(Profile_); }
+  // The page of the node and the node's offset in it.
+  std::pair<size_t, size_t> Locate(size_t Node) const noexcept {
+    const auto InPlane = Node - FirstIndex_;
+    const auto Y = InPlane / Stride_, X = InPlane - Y * Stride_;
+    return {(Y >> kPageShift) * PagesPerRow_ + (X >> kPageShift),
+            ((Y & kPageMask) << kPageShift) | (X & kPageMask)};
+  }
+  NodeState GetState(size_t Node) const noexcept {
+    const auto [PageIndex, Offset] = Locate(Node);
+    const auto *P = Pages_[PageIndex].get();
+    return P && P->Stamps[Offset] == Generation_ ? P->States[Offset] : NodeState{};
+  }
+  bool IsTouched(size_t Node) const noexcept {
+    const auto [PageIndex, Offset] = Locate(Node);
+    const auto *P = Pages_[PageIndex].get();
+    return P && P->Stamps[Offset] == Generation_;
+  }
+  // The state of the node, reset first if the current search never touched it.
+  NodeState &Touch(size_t Node) noexcept;
+  bool IsUsable(size_t Node) const noexcept;
+  Size GetHeuristic(size_t Node) const noexcept;
+  Key CalculateKey(size_t Node) const noexcept;
+
+  void UpdateVertex(size_t Node) noexcept;
+  // Relaxes the step from Prev into Next once the cost of Next has dropped to G.
+  void LowerVertex(size_t Prev, size_t Next, Size G) noexcept;
+  void ComputeShortestPath() noexcept;
+  // Drops the outdated heap entries once they make up most of the heap.
+  void PruneHeap() noexcept;
+  std::optional<Path> ExtractPath() const noexcept;
+
+  const GlobalMap &Map_;
+  MovementProfile Profile_;
+  size_t Start_;
+  size_t Target_;
+  size_t LastStart_;
+  uint64_t KeyModifier_ = 0;
+  NavigationGrid::Revision Revision_ = 0;
+
+  // Pages of the target's layer by block, the search never leaves it. Only the entries stamped
+  // with the current generation are valid, so a reset does not clear the pages.
+  size_t FirstIndex_;
+  size_t Stride_;
+  size_t PagesPerRow_;
+  std::vector<std::unique_ptr<Page>> Pages_;
+  size_t NumPages_ = 0;
+  uint32_t Generation_ = 0;
+  std::vector<HeapItem> Heap_;
+  size_t PruneSize_ = 0; // Heap size that triggers the next pruning.
+  size_t NumExpanded_ = 0;
+};
+
+} // namespace NotAGame
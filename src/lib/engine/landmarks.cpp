@@ -0,0 +1,120 @@
+#include "engine/landmarks.h"
+#include "engine/delta_stepping.h"
+#include "engine/path_search.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace NotAGame {
+
+namespace {
+
+uint16_t Saturate(Size Distance) noexcept {
+  return static_cast<uint16_t>(std::min<Size>(Distance, LandmarkTable::kUnknown));
+}
+
+} // namespace
+
+LandmarkStats BuildLandmarks(GlobalMap &Map, size_t NumPerLayer, MovementProfile Profile,
+                             FieldAlgorithm Algorithm) noexcept {
+  const auto &Nav = Map.GetNavigation();
+  const auto MapSize = Nav.GetSize();
+  const size_t PlaneSize = Nav.GetPlaneSize();
+
+  Size MinCost = 0;
+  const auto TerrainCosts = Nav.GetTerrainCosts(Profile, MinCost);
+  const MovementCosts Costs{TerrainCosts.data(), MinCost};
+
+  const auto Start = std::chrono::steady_clock::now();
+  LandmarkStats Stats;
+  auto &Scratch = GetSearchScratch();
+  DeltaStepping Parallel;
+  auto Run = [&](size_t Tile, bool IsReverse) {
+    SearchStats Search;
+    if (Algorithm == FieldAlgorithm::DeltaStepping) {
+      Parallel.Run(Nav, Costs, Tile, MAX_SIZE, IsReverse);
+      Parallel.FillStats(Search);
+    } else {
+      RunDijkstra(Nav, Costs, Scratch, Tile, MAX_SIZE, IsReverse, [](size_t) { return true; });
+      Scratch.FillStats(Search);
+    }
+    Stats.NodesExpanded += Search.NodesExpanded;
+  };
+  auto GetDistance = [&](size_t Tile) {
+    return Algorithm == FieldAlgorithm::DeltaStepping ? Parallel.GetDistance(Tile)
+                                                      : Scratch.GetDistance(Tile);
+  };
+
+  std::vector<LandmarkTable::Layer> Layers(MapSize.LayersCount);
+  // Distance from the closest landmark picked so far, zero for the tiles never reached.
+  std::vector<Size> Separation(PlaneSize);
+  std::vector<std::vector<uint16_t>> FromLandmark, ToLandmark;
+  for (Dim Layer = 0; Layer < MapSize.LayersCount; ++Layer) {
+    const size_t First = Nav.GetFirstIndex(Layer);
+    auto Pick = [&] {
+      const auto It = std::max_element(Separation.begin(), Separation.end());
+      return *It != 0 ? std::optional<size_t>{First + (It - Separation.begin())} : std::nullopt;
+    };
+
+    // The search from the center only seeds the separation, the first landmark is the tile
+    // farthest from it.
+    size_t Seed = Nav.ToIndex(Coord3D{MapSize.Width / 2, MapSize.Height / 2, Layer});
+    for (size_t I = 0; I < PlaneSize && !Costs.IsPassable(Seed); ++I) {
+      Seed = First + I;
+    }
+    if (!Costs.IsPassable(Seed)) {
+      continue;
+    }
+    Run(Seed, false);
+    for (size_t I = 0; I < PlaneSize; ++I) {
+      const auto Distance = GetDistance(First + I);
+      Separation[I] = Distance != MAX_SIZE ? Distance : 0;
+    }
+
+    auto &L = Layers[Layer];
+    FromLandmark.clear();
+    ToLandmark.clear();
+    while (L.Tiles.size() < NumPerLayer) {
+      const auto Landmark = Pick();
+      if (!Landmark) {
+        break;
+      }
+      L.Tiles.push_back(*Landmark);
+
+      Run(*Landmark, false);
+      auto &From = FromLandmark.emplace_back(PlaneSize);
+      for (size_t I = 0; I < PlaneSize; ++I) {
+        const auto Distance = GetDistance(First + I);
+        From[I] = Saturate(Distance);
+        Separation[I] = std::min(Separation[I], Distance);
+      }
+
+      Run(*Landmark, true);
+      auto &To = ToLandmark.emplace_back(PlaneSize);
+      for (size_t I = 0; I < PlaneSize; ++I) {
+        To[I] = Saturate(GetDistance(First + I));
+      }
+    }
+
+    // Interleaved per tile, a bound reads one contiguous run for each of its ends.
+    const size_t NumLandmarks = L.Tiles.size();
+    L.Distances.resize(PlaneSize * 2 * NumLandmarks);
+    for (size_t I = 0; I < PlaneSize; ++I) {
+      for (size_t J = 0; J < NumLandmarks; ++J) {
+        L.Distances[(I * NumLandmarks + J) * 2] = FromLandmark[J][I];
+        L.Distances[(I * NumLandmarks + J) * 2 + 1] = ToLandmark[J][I];
+      }
+    }
+    Stats.NumLandmarks += NumLandmarks;
+  }
+
+  auto Table = std::make_unique<const LandmarkTable>(PlaneSize, std::move(Layers));
+  Stats.MemoryUsage = Table->GetMemoryUsage();
+  Map.SetLandmarks(Profile, std::move(Table));
+  Stats.BuildTime = std::chrono::steady_clock::now() - Start;
+  return Stats;
+}
+
+} // namespace NotAGame
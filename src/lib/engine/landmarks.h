@@ -0,0 +1,28 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/global_map.h"
+#include "entities/movement.h"
+#include "util/types.h"
+
+#include <chrono>
+
+namespace NotAGame {
+
+// Work done by the landmark preprocessing.
+struct LandmarkStats {
+  size_t NumLandmarks = 0;
+  size_t NodesExpanded = 0;
+  size_t MemoryUsage = 0; // Bytes held by the table.
+  std::chrono::duration<double> BuildTime{};
+};
+
+// ALT preprocessing for the static terrain of the map. Picks up to NumPerLayer tiles on every
+// layer, each one as far as possible from those picked before, and stores the distances from and
+// to them on the map, 4 bytes per tile and landmark. Every landmark costs two Dijkstras over its
+// layer, so this is meant to be done once at map load, with DeltaStepping on big maps.
+LandmarkStats BuildLandmarks(GlobalMap &Map, size_t NumPerLayer = 8,
+                             MovementProfile Profile = kBaseMovement,
+                             FieldAlgorithm Algorithm = FieldAlgorithm::Dijkstra) noexcept;
+
+} // namespace NotAGame
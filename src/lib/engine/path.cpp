@@ -1,110 +1,331 @@
 #include "engine/path.h"
+#include "engine/delta_stepping.h"
+#include "engine/path_search.h"
 
 #include "game/mod.h"
+#include "util/thread_pool.h"
 
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/dijkstra_shortest_paths.hpp>
-#include <boost/graph/graph_traits.hpp>
-
+#include <algorithm>
 #include <vector>
 
 namespace NotAGame {
 
-using namespace boost;
+SearchScratch &GetSearchScratch() noexcept {
+  thread_local SearchScratch Scratch;
+  return Scratch;
+}
 
-using Graph = adjacency_list<listS, vecS, directedS, no_property, property<edge_weight_t, int>>;
-using Vertex = graph_traits<Graph>::vertex_descriptor;
-using Edge = std::pair<Size, Size>;
-using Edges = std::vector<Edge>;
-using Weights = std::vector<Size>;
+void ExtractPath(const NavigationGrid &Nav, const SearchScratch &Scratch, size_t Start,
+                 size_t Target, Size BaseCost, std::vector<Waypoint> &Waypoints) noexcept {
+  const auto First = Waypoints.size();
+  for (auto Node = Target;; Node = Scratch.GetPred(Node)) {
+    Waypoints.push_back(
+        Waypoint{.Coord = Nav.ToCoord(Node), .Cost = BaseCost + Scratch.GetDistance(Node)});
+    if (Node == Start) {
+      break;
+    }
+  }
+  std::reverse(Waypoints.begin() + First, Waypoints.end());
+}
 
-Size ComputeMoveCost(Coord3D From, Coord3D To, const GlobalMap &Map, const Mod &M) noexcept {
-  const auto &Tile = Map.GetTile(From);
-  const auto &NeighTile = Map.GetTile(To);
-  return Tile.Object_.IsValid() ? 0
-                                : M.GetTerrains().GetObjectById(NeighTile.Terrain_).GetBaseCost();
+Size ComputeMoveCost(Coord3D From, Coord3D To, const GlobalMap &Map,
+                     MovementProfile Profile) noexcept {
+  const auto &Nav = Map.GetNavigation();
+  return Nav.GetCosts(Profile).GetStepCost(Nav.ToIndex(From), Nav.ToIndex(To));
 }
 
-void AddLinks(Edges &Edges, Weights &Weights, const GlobalMap &Map, Dim X, Dim Y, Dim Z,
-              const GameplaySystems &Systems, const Mod &M, const Unit &LeaderUnit) noexcept {
-  const Coord3D From{X, Y, Z};
-  // TODO: consider leader perks.
-  const auto &Tile = Map.GetTile(Z, X, Y);
+bool MayBeReachable(Coord3D From, Coord3D To, const GlobalMap &Map) noexcept {
+  if (!Map.IsValid(From) || !Map.IsValid(To)) {
+    return false;
+  }
+  const auto &Nav = Map.GetNavigation();
+  return Nav.MayBeConnected(Nav.ToIndex(From), Nav.ToIndex(To));
+}
 
-  for (const auto Neighboor : GetPlaneNeighboors(From)) {
-    if (!Map.IsValid(Neighboor)) {
-      continue;
-    }
-    const auto &NeighTile = Map.GetTile(Neighboor);
-    if (NeighTile.Object_.IsInvalid()) {
-      Edges.push_back({Map.Coord3DToIndex(From), Map.Coord3DToIndex(Neighboor)});
-      const auto Weight = ComputeMoveCost(From, Neighboor, Map, M);
-      Weights.push_back(Weight);
+bool IsValidStep(Coord3D From, Coord3D To, const GlobalMap &Map) noexcept {
+  if (From.Layer == To.Layer && AbsDiff(From.X, To.X) <= 1 && AbsDiff(From.Y, To.Y) <= 1) {
+    return true;
+  }
+  const auto &Nav = Map.GetNavigation();
+  return Nav.IsPortalJump(Nav.ToIndex(From), Nav.ToIndex(To));
+}
+
+void SplitPathByDays(Path &Path, Size MovePoints, Size MaxMovePoints) noexcept {
+  if (Path.Waypoints.empty()) {
+    return;
+  }
+  Path.Waypoints[0].DayIndex = 0;
+  Size Day = 0;
+  for (size_t I = 1; I < Path.Waypoints.size(); ++I) {
+    auto &Pt = Path.Waypoints[I];
+    if (MovePoints == 0) {
+      if (MaxMovePoints == 0) { // Never gets there.
+        Pt.DayIndex = MAX_SIZE;
+        continue;
+      }
+      ++Day;
+      MovePoints = MaxMovePoints;
     }
+    MovePoints -= std::min(MovePoints, Pt.Cost - Path.Waypoints[I - 1].Cost);
+    Pt.DayIndex = Day;
   }
 }
 
-std::optional<Path> TryBuildPath(Coord3D From, Coord3D To, const GlobalMap &Map,
-                                 const GameplaySystems &Systems, const Mod &M,
-                                 const Id<Unit> LeaderId) noexcept {
+namespace {
 
-  // edges of the graph
-  size_t NumNodes = Map.GetWidth() * Map.GetHeight() * Map.GetNumLayers();
-  // Graph is 8-bound on each plane.
-  size_t GraphSize = NumNodes * 8;
-  Edges Edges;
-  Edges.reserve(GraphSize);
-  Weights Weights;
-  Weights.reserve(GraphSize);
-
-  const auto &LeaderUnit = Systems.Units.GetComponent(LeaderId);
-
-  for (Dim Z = 0, ZE = Map.GetNumLayers(); Z < ZE; ++Z) {
-    for (Dim Y = 0, YE = Map.GetHeight(); Y < YE; ++Y) {
-      for (Dim X = 0; X < Map.GetWidth(); ++X) {
-        const auto &Tile = Map.GetTile(Z, X, Y);
-        AddLinks(Edges, Weights, Map, X, Y, Z, Systems, M, LeaderUnit);
-      }
+// A* that also takes the portals between layers. Nodes off the target layer can only get there
+// through an exit on it, so the heuristic is bounded by the closest such exit.
+bool RunLayeredAStar(const NavigationGrid &Nav, const MovementCosts &Costs, SearchScratch &Scratch,
+                     size_t Start, size_t Target) noexcept {
+  const auto To = Nav.ToCoord(Target);
+  const auto MinCost = Costs.GetMinCost();
+  Size ExitBound = MAX_SIZE;
+  for (const auto &P : Nav.GetPortals()) {
+    if (const auto Exit = Nav.ToCoord(P.Exit); Exit.Layer == To.Layer) {
+      ExitBound = std::min(ExitBound, OctileDistance(Exit, To, MinCost));
     }
   }
+  auto Heuristic = [&](size_t Node) {
+    const auto Coord = Nav.ToCoord(Node);
+    return Coord.Layer == To.Layer ? std::min(OctileDistance(Coord, To, MinCost), ExitBound)
+                                   : ExitBound;
+  };
+  if (Heuristic(Start) == MAX_SIZE) {
+    return false;
+  }
 
-  // graph created from the list of edges
-  Graph G(Edges.data(), Edges.data() + Edges.size(), Weights.data(), NumNodes);
+  Scratch.Reset(Nav.GetNumTiles());
+  Scratch.SetDistance(Start, 0, Start);
+  Scratch.Push(Heuristic(Start), Start);
 
-  // create vectors to store the predecessors (p) and the distances from the root (d)
-  std::vector<Vertex> Pred(num_vertices(G));
-  std::vector<Size> Distances(num_vertices(G));
-  // create a descriptor for the source node
-  Vertex Start = vertex(Map.Coord3DToIndex(From), G);
+  while (!Scratch.IsEmpty()) {
+    const auto [Priority, Node] = Scratch.Pop();
+    const auto Distance = Scratch.GetDistance(Node);
+    if (Priority > Distance + Heuristic(Node)) {
+      continue; // Stale entry.
+    }
+    if (Node == Target) {
+      return true;
+    }
+    Scratch.CountExpanded();
+    auto Relax = [&, Node = Node](size_t Next) {
+      if (!Costs.IsPassable(Next)) {
+        return;
+      }
+      // Layers without an exit on the target one lead nowhere.
+      const auto Bound = Heuristic(Next);
+      if (Bound == MAX_SIZE) {
+        return;
+      }
+      const auto NewDistance = Distance + Costs.GetStepCost(Node, Next);
+      if (NewDistance < Scratch.GetDistance(Next)) {
+        Scratch.SetDistance(Next, NewDistance, Node);
+        Scratch.Push(NewDistance + Bound, Next);
+      }
+    };
+    Nav.ForEachNeighbour(Node, Relax);
+    Nav.ForEachPortalExit(Node, Relax);
+  }
+  return false;
+}
+
+} // namespace
+
+MovementProfile GetMovementProfile(const Squad &Squad, const GameplaySystems &Systems) noexcept {
+  const auto &Leader = Systems.Units.GetComponent(Squad.GetLeader());
+  return Systems.Leaders.GetComponent(Leader.LeaderDataId).Movement;
+}
 
-  // evaluate dijkstra on graph g with source s, predecessor_map p and distance_map d
-  // note that predecessor_map(..).distance_map(..) is a bgl_named_params<P, T, R>, so a named
-  // parameter
-  dijkstra_shortest_paths(
-      G, Start,
-      predecessor_map(boost::make_iterator_property_map(Pred.begin(), get(boost::vertex_index, G)))
-          .distance_map(
-              boost::make_iterator_property_map(Distances.begin(), get(boost::vertex_index, G))));
+std::optional<Path> TryBuildPath(Coord3D From, Coord3D To, const GlobalMap &Map,
+                                 MovementProfile Profile, SearchStats *Stats) noexcept {
+  const auto &Nav = Map.GetNavigation();
+  if (!Map.IsValid(From) || !Map.IsValid(To)) {
+    return std::nullopt;
+  }
+
+  const auto Costs = Nav.GetCosts(Profile);
+  const auto Start = Nav.ToIndex(From);
+  const auto Target = Nav.ToIndex(To);
+  if (Start != Target && (!Costs.IsPassable(Target) || !Nav.MayBeConnected(Start, Target))) {
+    return std::nullopt;
+  }
+
+  // The search stays on the source layer unless the target can only be reached through portals.
+  auto &Scratch = GetSearchScratch();
+  auto AnyTile = [](size_t) { return true; };
+  bool IsFound = false;
+  if (From.Layer == To.Layer) {
+    if (const auto *Landmarks = Nav.GetLandmarks(Profile)) {
+      const auto MinCost = Costs.GetMinCost();
+      IsFound = RunAStar(Nav, Costs, Scratch, Start, Target, AnyTile, [&](size_t Node) {
+        return std::max(OctileDistance(Nav.ToCoord(Node), To, MinCost),
+                        Landmarks->GetLowerBound(Node, Target));
+      });
+    } else {
+      IsFound = RunAStar(Nav, Costs, Scratch, Start, Target, AnyTile);
+    }
+  }
+  if (!IsFound && !Nav.GetPortals().empty()) {
+    IsFound = RunLayeredAStar(Nav, Costs, Scratch, Start, Target);
+  }
+  if (Stats) {
+    Scratch.FillStats(*Stats);
+  }
+  if (!IsFound) {
+    return std::nullopt;
+  }
 
-  auto Coord = To;
   Path P;
   P.Start = From;
   P.Target = To;
+  ExtractPath(Nav, Scratch, Start, Target, 0, P.Waypoints);
+  return std::move(P);
+}
+
+std::optional<size_t> DistanceField::GetOffset(Coord3D Pos) const noexcept {
+  if (Pos.Layer != Source_.Layer) {
+    return std::nullopt;
+  }
+  const Dim X = Pos.X - Origin_.X, Y = Pos.Y - Origin_.Y;
+  if (X >= Size_.Width || Y >= Size_.Height) {
+    return std::nullopt;
+  }
+  return Linearize(Coord{X, Y}, Size_);
+}
+
+std::optional<Size> DistanceField::GetCost(Coord3D Pos) const noexcept {
+  const auto Offset = GetOffset(Pos);
+  if (!Offset || Costs_[*Offset] == MAX_SIZE) {
+    return std::nullopt;
+  }
+  return Costs_[*Offset];
+}
 
-  while (true) {
-    P.Waypoints.push_back(Waypoint{.Coord = Coord});
-    if (Coord == From) {
-      P.Waypoints.back().Cost = 0;
+std::optional<Path> DistanceField::BuildPath(Coord3D To) const noexcept {
+  if (!Contains(To)) {
+    return std::nullopt;
+  }
+
+  Path P;
+  P.Start = Source_;
+  P.Target = To;
+  for (auto Pos = To;;) {
+    const auto Offset = *GetOffset(Pos);
+    P.Waypoints.push_back(Waypoint{.Coord = Pos, .Cost = Costs_[Offset]});
+    if (Pos == Source_) {
       break;
     }
-    const auto &Tile = Map.GetTile(Coord);
-    auto TileVertexIndex = Map.Coord3DToIndex(Coord);
-    P.Waypoints.back().Cost = Distances[TileVertexIndex];
-    Coord = Map.IndexToCoord3D(Pred[TileVertexIndex]);
+    const auto Direction = Directions_[Offset];
+    Pos.X += Direction % 3 - 1;
+    Pos.Y += Direction / 3 - 1;
   }
 
   std::reverse(P.Waypoints.begin(), P.Waypoints.end());
   return std::move(P);
 }
 
+DistanceField ComputeDistanceField(Coord3D From, Size Budget, const GlobalMap &Map,
+                                   MovementProfile Profile, FieldAlgorithm Algorithm) noexcept {
+  const auto &Nav = Map.GetNavigation();
+  const auto Costs = Nav.GetCosts(Profile);
+  const auto MapSize = Nav.GetSize();
+
+  DistanceField Field;
+  Field.Source_ = From;
+  Field.Budget_ = Budget;
+  if (!Map.IsValid(From)) {
+    return Field;
+  }
+
+  // Every expanded tile costs at least MinCost, plus the free step out of an object and the step
+  // behind the budget.
+  const auto MinCost = Costs.GetMinCost();
+  const Size Radius =
+      MinCost ? std::min<uint64_t>(MAX_SIZE, (uint64_t{Budget} + MinCost - 1) / MinCost + 2)
+              : MAX_SIZE;
+  const Dim MinX = From.X - std::min(From.X, Radius), MinY = From.Y - std::min(From.Y, Radius);
+  const Dim MaxX = From.X + std::min(MapSize.Width - 1 - From.X, Radius);
+  const Dim MaxY = From.Y + std::min(MapSize.Height - 1 - From.Y, Radius);
+  Field.Origin_ = Coord{MinX, MinY};
+  Field.Size_ = Dims2D{MaxX - MinX + 1, MaxY - MinY + 1};
+
+  const auto Start = Nav.ToIndex(From);
+  const size_t WindowSize = Field.Size_.Width * Field.Size_.Height;
+  Field.Costs_.resize(WindowSize, MAX_SIZE);
+  Field.Directions_.resize(WindowSize, 4);
+  auto Fill = [&](const auto &Search) {
+    for (Dim Y = MinY; Y <= MaxY; ++Y) {
+      for (Dim X = MinX; X <= MaxX; ++X) {
+        const auto Node = Nav.ToIndex(Coord3D{X, Y, From.Layer});
+        const auto Distance = Search.GetDistance(Node);
+        if (Distance == MAX_SIZE) {
+          continue;
+        }
+        const auto Offset = Linearize(Coord{X - MinX, Y - MinY}, Field.Size_);
+        const auto Pred = Nav.ToCoord(Search.GetPred(Node));
+        Field.Costs_[Offset] = Distance;
+        Field.Directions_[Offset] = (Pred.X + 1 - X) + 3 * (Pred.Y + 1 - Y);
+      }
+    }
+  };
+
+  switch (Algorithm) {
+  case FieldAlgorithm::Dijkstra: {
+    auto &Scratch = GetSearchScratch();
+    RunDijkstra(Nav, Costs, Scratch, Start, Budget, false, [](size_t) { return true; });
+    Fill(Scratch);
+    break;
+  }
+  case FieldAlgorithm::DeltaStepping: {
+    DeltaStepping Search;
+    Search.Run(Nav, Costs, Start, Budget, false);
+    Fill(Search);
+    break;
+  }
+  }
+  return Field;
+}
+
+DistanceField ComputeReachableArea(const Squad &Squad, const GlobalMap &Map,
+                                   const GameplaySystems &Systems) noexcept {
+  const auto &Leader = Systems.Units.GetComponent(Squad.GetLeader());
+  const auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
+  return ComputeDistanceField(Squad.Position, LeaderData.Steps.GetValue(), Map,
+                              LeaderData.Movement);
+}
+
+std::vector<DistanceField> ComputeDistanceFields(std::span<const Coord3D> Sources, Size Budget,
+                                                 const GlobalMap &Map,
+                                                 MovementProfile Profile) noexcept {
+  std::vector<DistanceField> Fields(Sources.size());
+  Utils::ThreadPool::GetDefault().ParallelFor(Sources.size(), [&](size_t I) {
+    Fields[I] = ComputeDistanceField(Sources[I], Budget, Map, Profile);
+  });
+  return Fields;
+}
+
+std::vector<DistanceField> ComputeDistanceFields(std::span<const Id<Squad>> Squads, Size Budget,
+                                                 const GlobalMap &Map,
+                                                 const GameplaySystems &Systems) noexcept {
+  std::vector<DistanceField> Fields(Squads.size());
+  Utils::ThreadPool::GetDefault().ParallelFor(Squads.size(), [&](size_t I) {
+    const auto &Squad = Systems.Squads.GetComponent(Squads[I]);
+    Fields[I] =
+        ComputeDistanceField(Squad.Position, Budget, Map, GetMovementProfile(Squad, Systems));
+  });
+  return Fields;
+}
+
+std::optional<Path> TryBuildPath(Coord3D From, Coord3D To, const GlobalMap &Map,
+                                 const GameplaySystems &Systems, const Mod &,
+                                 const Id<Unit> LeaderId) noexcept {
+  const auto &Leader = Systems.Units.GetComponent(LeaderId);
+  const auto &LeaderData = Systems.Leaders.GetComponent(Leader.LeaderDataId);
+  auto P = TryBuildPath(From, To, Map, LeaderData.Movement);
+  if (P) {
+    SplitPathByDays(*P, LeaderData.Steps.GetValue(), LeaderData.Steps.GetEffectiveValue());
+  }
+  return P;
+}
+
 } // namespace NotAGame
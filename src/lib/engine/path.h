@@ -4,6 +4,7 @@
 #include "entities/global_map.h"
 #include "util/types.h"
 
+#include <span>
 #include <vector>
 
 namespace NotAGame {
@@ -11,10 +12,18 @@ namespace NotAGame {
 struct Waypoint {
   Coord3D Coord;
   Size Cost;
-  Size DayIndex;
+  Size DayIndex = 0; // The day the squad steps onto the waypoint, 0 is the current one.
 };
 
-Size ComputeMoveCost(Coord3D From, Coord3D To, const GlobalMap &Map, const Mod &M) noexcept;
+Size ComputeMoveCost(Coord3D From, Coord3D To, const GlobalMap &Map,
+                     MovementProfile Profile = kBaseMovement) noexcept;
+
+// Constant time check of the connectivity of the map, e.g. to prune the candidate targets of AI
+// players before any search. False means no path exists whatever the profile.
+bool MayBeReachable(Coord3D From, Coord3D To, const GlobalMap &Map) noexcept;
+
+// A step to one of the 8 neighbours on the same layer, or a jump through a portal.
+bool IsValidStep(Coord3D From, Coord3D To, const GlobalMap &Map) noexcept;
 
 struct Path {
   Coord3D Start;
@@ -32,6 +41,92 @@ struct Path {
   }
 };
 
+// Fills the DayIndex of the waypoints. Like Engine::MoveSquad, a step can be started with any
+// positive amount of move points left, and every next day starts with MaxMovePoints.
+void SplitPathByDays(Path &Path, Size MovePoints, Size MaxMovePoints) noexcept;
+
+// Work done by a search, for profiling.
+struct SearchStats {
+  size_t NodesExpanded = 0;
+  size_t PeakHeapSize = 0;
+  size_t MemoryUsage = 0; // Bytes held by the search buffers of the thread.
+};
+
+// The movement profile of the squad's leader.
+MovementProfile GetMovementProfile(const Squad &Squad, const GameplaySystems &Systems) noexcept;
+
+// Searches the source layer only, portals are taken when the target cannot be reached otherwise.
+// Landmarks of the profile, if the map has them, sharpen the heuristic.
+std::optional<Path> TryBuildPath(Coord3D From, Coord3D To, const GlobalMap &Map,
+                                 MovementProfile Profile = kBaseMovement,
+                                 SearchStats *Stats = nullptr) noexcept;
+
+// How a distance field is searched. DeltaStepping spreads a single search over the threads of the
+// default pool, which only pays off on fields covering a big part of a big map.
+enum class FieldAlgorithm : uint8_t { Dijkstra, DeltaStepping };
+
+// Costs and predecessors of every tile reached by a bounded search, stored densely over the
+// window the search could possibly explore.
+class DistanceField {
+public:
+  Coord3D GetSource() const noexcept { return Source_; }
+  Size GetBudget() const noexcept { return Budget_; }
+
+  bool Contains(Coord3D Pos) const noexcept { return GetCost(Pos).has_value(); }
+  std::optional<Size> GetCost(Coord3D Pos) const noexcept;
+
+  // Walks the predecessors back to the source, O(path length).
+  std::optional<Path> BuildPath(Coord3D To) const noexcept;
+
+  template <typename Fn> void ForEachTile(Fn &&Func) const noexcept {
+    for (Dim Y = 0; Y < Size_.Height; ++Y) {
+      for (Dim X = 0; X < Size_.Width; ++X) {
+        if (const auto Cost = Costs_[Linearize(Coord{X, Y}, Size_)]; Cost != MAX_SIZE) {
+          Func(Coord3D{Origin_.X + X, Origin_.Y + Y, Source_.Layer}, Cost);
+        }
+      }
+    }
+  }
+
+private:
+  friend DistanceField ComputeDistanceField(Coord3D From, Size Budget, const GlobalMap &Map,
+                                            MovementProfile Profile,
+                                            FieldAlgorithm Algorithm) noexcept;
+
+  std::optional<size_t> GetOffset(Coord3D Pos) const noexcept;
+
+  Coord3D Source_;
+  Size Budget_ = 0;
+  Coord Origin_;
+  Dims2D Size_{0, 0};
+  std::vector<Size> Costs_;
+  // Offset to the predecessor, (DX + 1) + 3 * (DY + 1).
+  std::vector<uint8_t> Directions_;
+};
+
+// Dijkstra from From which never expands a tile whose cost reached Budget. As in
+// Engine::MoveSquad, a step can be started with any positive amount of move points left, so the
+// field also holds the tiles right behind the budget. DeltaStepping must not be asked for from the
+// pool threads.
+DistanceField ComputeDistanceField(Coord3D From, Size Budget, const GlobalMap &Map,
+                                   MovementProfile Profile = kBaseMovement,
+                                   FieldAlgorithm Algorithm = FieldAlgorithm::Dijkstra) noexcept;
+
+// All tiles the squad can reach with its leader's remaining move points.
+DistanceField ComputeReachableArea(const Squad &Squad, const GlobalMap &Map,
+                                   const GameplaySystems &Systems) noexcept;
+
+// One field per source, computed on the pool threads with their own search buffers. Fields are
+// returned in the order of the sources and can be queried for any number of targets, which is
+// what AI players need to weigh their squads against the candidate goals at turn start.
+std::vector<DistanceField> ComputeDistanceFields(std::span<const Coord3D> Sources, Size Budget,
+                                                 const GlobalMap &Map,
+                                                 MovementProfile Profile = kBaseMovement) noexcept;
+// Every squad moves with the profile of its leader.
+std::vector<DistanceField> ComputeDistanceFields(std::span<const Id<Squad>> Squads, Size Budget,
+                                                 const GlobalMap &Map,
+                                                 const GameplaySystems &Systems) noexcept;
+
 std::optional<Path> TryBuildPath(Coord3D From, Coord3D To, const GlobalMap &Map,
                                  const GameplaySystems &Systems, const Mod &M,
                                  const Id<Unit> LeaderId) noexcept;
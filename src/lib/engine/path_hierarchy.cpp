@@ -0,0 +1,367 @@
+#include "engine/path_hierarchy.h"
+#include "engine/path_search.h"
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+
+namespace NotAGame {
+
+PathHierarchy::PathHierarchy(const GlobalMap &Map, Size ClusterSize) noexcept
+    : Map_{Map}, ClusterSize_{std::max<Size>(ClusterSize, 1)} {
+  const auto MapSize = Map_.GetNavigation().GetSize();
+  NumClusters_ = Dims2D{(MapSize.Width + ClusterSize_ - 1) / ClusterSize_,
+                        (MapSize.Height + ClusterSize_ - 1) / ClusterSize_};
+
+  for (Dim Layer = 0; Layer < MapSize.LayersCount; ++Layer) {
+    for (Dim CY = 0; CY < NumClusters_.Height; ++CY) {
+      for (Dim CX = 0; CX < NumClusters_.Width; ++CX) {
+        const Coord Origin{CX * ClusterSize_, CY * ClusterSize_};
+        const Dims2D Extent{std::min(ClusterSize_, MapSize.Width - Origin.X),
+                            std::min(ClusterSize_, MapSize.Height - Origin.Y)};
+        Clusters_.push_back(Cluster{.Origin = Origin, .Extent = Extent, .Layer = Layer});
+      }
+    }
+  }
+
+  std::vector<Size> All(Clusters_.size());
+  for (Size I = 0; I < All.size(); ++I) {
+    All[I] = I;
+  }
+  Revision_ = Map_.GetNavigation().GetRevision();
+  Rebuild(std::move(All));
+}
+
+Size PathHierarchy::GetClusterIndex(Coord3D Coord) const noexcept {
+  const Size NumPerLayer = NumClusters_.Width * NumClusters_.Height;
+  return NumPerLayer * Coord.Layer + NumClusters_.Width * (Coord.Y / ClusterSize_) +
+         Coord.X / ClusterSize_;
+}
+
+bool PathHierarchy::IsInCluster(const Cluster &C, size_t Tile) const noexcept {
+  const auto [X, Y, Layer] = Map_.GetNavigation().ToCoord(Tile);
+  return Layer == C.Layer && X - C.Origin.X < C.Extent.Width && Y - C.Origin.Y < C.Extent.Height;
+}
+
+void PathHierarchy::Update() noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (Revision_ == Nav.GetRevision()) {
+    return;
+  }
+
+  std::vector<size_t> Changes;
+  std::vector<Size> Dirty;
+  if (Nav.GetChangesSince(Revision_, Changes)) {
+    std::vector<bool> IsDirty(Clusters_.size(), false);
+    auto MarkDirty = [&](size_t Tile) {
+      const auto Coord = Nav.ToCoord(Tile);
+      if (!Map_.IsValid(Coord)) {
+        return; // The border of the grid.
+      }
+      const auto Index = GetClusterIndex(Coord);
+      if (!IsDirty[Index]) {
+        IsDirty[Index] = true;
+        Dirty.push_back(Index);
+      }
+    };
+    // A tile next to a cluster border also changes the transitions of the neighbouring cluster.
+    for (const auto Tile : Changes) {
+      MarkDirty(Tile);
+      Nav.ForEachNeighbour(Tile, MarkDirty);
+    }
+  } else {
+    Dirty.resize(Clusters_.size());
+    for (Size I = 0; I < Dirty.size(); ++I) {
+      Dirty[I] = I;
+    }
+  }
+
+  Revision_ = Nav.GetRevision();
+  Rebuild(std::move(Dirty));
+}
+
+void PathHierarchy::Rebuild(std::vector<Size> DirtyClusters) noexcept {
+  std::vector<bool> IsDirty(Clusters_.size(), false);
+  for (const auto Index : DirtyClusters) {
+    IsDirty[Index] = true;
+    auto &C = Clusters_[Index];
+    for (const auto &E : C.Entrances) {
+      EntranceByTile_.erase(E.Tile);
+    }
+    C.Entrances.clear();
+  }
+
+  for (const auto Index : DirtyClusters) {
+    AddTransitions(Index, IsDirty);
+  }
+  for (const auto Index : DirtyClusters) {
+    ComputeIntraPaths(Clusters_[Index]);
+  }
+}
+
+void PathHierarchy::AddTransitions(Size ClusterIndex, const std::vector<bool> &IsDirty) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  const auto MapSize = Nav.GetSize();
+  const auto &C = Clusters_[ClusterIndex];
+  const Dim X0 = C.Origin.X, Y0 = C.Origin.Y;
+  const Dim X1 = X0 + C.Extent.Width - 1, Y1 = Y0 + C.Extent.Height - 1;
+  auto Tile = [&](Dim X, Dim Y) { return Nav.ToIndex(Coord3D{X, Y, C.Layer}); };
+
+  // Inner and outer tiles along one side of the cluster. Every run of straight crossings becomes
+  // a single transition in its middle, diagonal crossings only count where no straight one is.
+  std::vector<size_t> Inner, Outer;
+  auto ProcessBorder = [&]() {
+    const size_t Length = Inner.size();
+    auto IsStraight = [&](size_t I) {
+      return Nav.IsPassable(Inner[I]) && Nav.IsPassable(Outer[I]);
+    };
+    for (size_t I = 0; I < Length;) {
+      if (!IsStraight(I)) {
+        ++I;
+        continue;
+      }
+      size_t End = I;
+      while (End + 1 < Length && IsStraight(End + 1)) {
+        ++End;
+      }
+      const size_t Middle = (I + End) / 2;
+      AddTransition(Inner[Middle], Outer[Middle], IsDirty);
+      I = End + 1;
+    }
+    for (size_t I = 0; I + 1 < Length; ++I) {
+      if (IsStraight(I) || IsStraight(I + 1)) {
+        continue;
+      }
+      if (Nav.IsPassable(Inner[I]) && Nav.IsPassable(Outer[I + 1])) {
+        AddTransition(Inner[I], Outer[I + 1], IsDirty);
+      }
+      if (Nav.IsPassable(Inner[I + 1]) && Nav.IsPassable(Outer[I])) {
+        AddTransition(Inner[I + 1], Outer[I], IsDirty);
+      }
+    }
+    Inner.clear();
+    Outer.clear();
+  };
+
+  const bool HasLeft = X0 > 0, HasRight = X1 + 1 < MapSize.Width;
+  const bool HasTop = Y0 > 0, HasBottom = Y1 + 1 < MapSize.Height;
+  if (HasLeft || HasRight) {
+    for (const auto &[IsPresent, X, OuterX] :
+         {std::tuple{HasLeft, X0, X0 - 1}, std::tuple{HasRight, X1, X1 + 1}}) {
+      if (!IsPresent) {
+        continue;
+      }
+      for (Dim Y = Y0; Y <= Y1; ++Y) {
+        Inner.push_back(Tile(X, Y));
+        Outer.push_back(Tile(OuterX, Y));
+      }
+      ProcessBorder();
+    }
+  }
+  if (HasTop || HasBottom) {
+    for (const auto &[IsPresent, Y, OuterY] :
+         {std::tuple{HasTop, Y0, Y0 - 1}, std::tuple{HasBottom, Y1, Y1 + 1}}) {
+      if (!IsPresent) {
+        continue;
+      }
+      for (Dim X = X0; X <= X1; ++X) {
+        Inner.push_back(Tile(X, Y));
+        Outer.push_back(Tile(X, OuterY));
+      }
+      ProcessBorder();
+    }
+  }
+
+  // Corners touch the diagonal clusters through a single step.
+  auto AddCorner = [&](bool IsPresent, Dim X, Dim Y, Dim OuterX, Dim OuterY) {
+    const auto From = Tile(X, Y), To = Tile(OuterX, OuterY);
+    if (IsPresent && Nav.IsPassable(From) && Nav.IsPassable(To)) {
+      AddTransition(From, To, IsDirty);
+    }
+  };
+  AddCorner(HasLeft && HasTop, X0, Y0, X0 - 1, Y0 - 1);
+  AddCorner(HasRight && HasTop, X1, Y0, X1 + 1, Y0 - 1);
+  AddCorner(HasLeft && HasBottom, X0, Y1, X0 - 1, Y1 + 1);
+  AddCorner(HasRight && HasBottom, X1, Y1, X1 + 1, Y1 + 1);
+}
+
+void PathHierarchy::AddTransition(size_t From, size_t To,
+                                  const std::vector<bool> &IsDirty) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  // Both clusters see the same border, so a clean cluster already has its side of the transition.
+  auto AddExit = [&](size_t Tile, size_t Exit) {
+    const auto ClusterIndex = GetClusterIndex(Nav.ToCoord(Tile));
+    if (!IsDirty[ClusterIndex]) {
+      return;
+    }
+    auto &C = Clusters_[ClusterIndex];
+    const auto [It, IsNew] = EntranceByTile_.try_emplace(
+        Tile, ClusterIndex, static_cast<Size>(C.Entrances.size()));
+    if (IsNew) {
+      C.Entrances.push_back(Entrance{.Tile = Tile});
+    }
+    auto &E = C.Entrances[It->second.second];
+    if (std::find(E.Exits.begin(), E.Exits.end(), Exit) == E.Exits.end()) {
+      E.Exits.push_back(Exit);
+    }
+  };
+  AddExit(From, To);
+  AddExit(To, From);
+}
+
+void PathHierarchy::ComputeIntraPaths(Cluster &C) noexcept {
+  for (auto &E : C.Entrances) {
+    E.Paths = ComputeEntranceCosts(C, E.Tile, false);
+    std::erase_if(E.Paths, [&](const Link &L) { return L.Tile == E.Tile; });
+  }
+}
+
+std::vector<PathHierarchy::Link>
+PathHierarchy::ComputeEntranceCosts(const Cluster &C, size_t Tile, bool IsReverse) const noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  auto &Scratch = GetSearchScratch();
+  RunDijkstra(Nav, Nav.GetCosts(), Scratch, Tile, MAX_SIZE, IsReverse,
+              [&](size_t Node) { return IsInCluster(C, Node); });
+
+  std::vector<Link> Links;
+  for (const auto &E : C.Entrances) {
+    const auto Distance = Scratch.GetDistance(E.Tile);
+    if (Distance != MAX_SIZE) {
+      Links.push_back(Link{.Tile = E.Tile, .Cost = Distance});
+    }
+  }
+  return Links;
+}
+
+bool PathHierarchy::Refine(size_t From, size_t To, Size BaseCost,
+                           std::vector<Waypoint> &Waypoints) const noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (GetClusterIndex(Nav.ToCoord(From)) != GetClusterIndex(Nav.ToCoord(To))) {
+    // A transition between two clusters.
+    Waypoints.push_back(
+        Waypoint{.Coord = Nav.ToCoord(To), .Cost = BaseCost + Nav.GetStepCost(From, To)});
+    return true;
+  }
+
+  const auto &C = Clusters_[GetClusterIndex(Nav.ToCoord(To))];
+  auto &Scratch = GetSearchScratch();
+  if (!RunAStar(Nav, Nav.GetCosts(), Scratch, From, To,
+                [&](size_t Node) { return IsInCluster(C, Node); })) {
+    return false;
+  }
+  // The segment starts where the previous one ended.
+  Waypoints.pop_back();
+  ExtractPath(Nav, Scratch, From, To, BaseCost, Waypoints);
+  return true;
+}
+
+std::optional<Path> PathHierarchy::TryBuildPath(Coord3D From, Coord3D To) noexcept {
+  const auto &Nav = Map_.GetNavigation();
+  if (!Map_.IsValid(From) || !Map_.IsValid(To) || From.Layer != To.Layer) {
+    return std::nullopt;
+  }
+  // Nearby targets are cheaper to reach directly than through the abstract graph.
+  if (std::max(AbsDiff(From.X, To.X), AbsDiff(From.Y, To.Y)) <= 2 * ClusterSize_) {
+    return NotAGame::TryBuildPath(From, To, Map_);
+  }
+
+  const auto Start = Nav.ToIndex(From);
+  const auto Target = Nav.ToIndex(To);
+  if (!Nav.IsPassable(Target) || !Nav.MayBeConnected(Start, Target)) {
+    return std::nullopt;
+  }
+
+  Update();
+
+  const auto StartLinks = ComputeEntranceCosts(Clusters_[GetClusterIndex(From)], Start, false);
+  const auto TargetClusterIndex = GetClusterIndex(To);
+  std::unordered_map<size_t, Size> TargetCosts;
+  for (const auto &L : ComputeEntranceCosts(Clusters_[TargetClusterIndex], Target, true)) {
+    TargetCosts.emplace(L.Tile, L.Cost);
+  }
+
+  // A* over the entrances, nodes are identified by their tiles.
+  struct NodeState {
+    Size Distance;
+    size_t Pred;
+  };
+  std::unordered_map<size_t, NodeState> States;
+  using HeapItem = SearchScratch::HeapItem;
+  std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<>> Open;
+  const auto MinCost = Nav.GetMinCost();
+  auto Heuristic = [&](size_t Node) { return OctileDistance(Nav.ToCoord(Node), To, MinCost); };
+  auto Relax = [&](size_t Node, size_t Next, Size Distance) {
+    const auto [It, IsNew] = States.try_emplace(Next, NodeState{Distance, Node});
+    if (!IsNew) {
+      if (It->second.Distance <= Distance) {
+        return;
+      }
+      It->second = NodeState{Distance, Node};
+    }
+    Open.push(HeapItem{Distance + Heuristic(Next), Next});
+  };
+
+  States.emplace(Start, NodeState{0, Start});
+  Open.push(HeapItem{Heuristic(Start), Start});
+  bool IsFound = false;
+  while (!Open.empty()) {
+    const auto [Priority, Node] = Open.top();
+    Open.pop();
+    const auto Distance = States.at(Node).Distance;
+    if (Priority > Distance + Heuristic(Node)) {
+      continue; // Stale entry.
+    }
+    if (Node == Target) {
+      IsFound = true;
+      break;
+    }
+
+    if (Node == Start) {
+      for (const auto &L : StartLinks) {
+        Relax(Node, L.Tile, Distance + L.Cost);
+      }
+    }
+    const auto It = EntranceByTile_.find(Node);
+    if (It == EntranceByTile_.end()) {
+      continue;
+    }
+    const auto [ClusterIndex, EntranceIndex] = It->second;
+    const auto &E = Clusters_[ClusterIndex].Entrances[EntranceIndex];
+    for (const auto &L : E.Paths) {
+      Relax(Node, L.Tile, Distance + L.Cost);
+    }
+    for (const auto Exit : E.Exits) {
+      Relax(Node, Exit, Distance + Nav.GetStepCost(Node, Exit));
+    }
+    if (ClusterIndex == TargetClusterIndex) {
+      if (const auto Cost = TargetCosts.find(Node); Cost != TargetCosts.end()) {
+        Relax(Node, Target, Distance + Cost->second);
+      }
+    }
+  }
+  if (!IsFound) {
+    return std::nullopt;
+  }
+
+  std::vector<size_t> Abstract;
+  for (auto Node = Target;; Node = States.at(Node).Pred) {
+    Abstract.push_back(Node);
+    if (Node == Start) {
+      break;
+    }
+  }
+  std::reverse(Abstract.begin(), Abstract.end());
+
+  Path P;
+  P.Start = From;
+  P.Target = To;
+  P.Waypoints.push_back(Waypoint{.Coord = From, .Cost = 0});
+  for (size_t I = 0; I + 1 < Abstract.size(); ++I) {
+    if (!Refine(Abstract[I], Abstract[I + 1], P.Waypoints.back().Cost, P.Waypoints)) {
+      return std::nullopt;
+    }
+  }
+  return std::move(P);
+}
+
+} // namespace NotAGame
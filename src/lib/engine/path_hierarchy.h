@@ -0,0 +1,80 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/global_map.h"
+#include "util/types.h"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace NotAGame {
+
+// Hierarchical pathfinding (HPA*) over the navigation grid of a map. Every layer is split into
+// square clusters, passable runs on cluster borders become entrances, and the costs between the
+// entrances of a cluster are precomputed. Long queries search this abstract graph first and then
+// refine the path cluster by cluster, short ones fall back to the plain A*.
+//
+// The hierarchy follows the map: before a query the patched tiles are pulled from the navigation
+// journal and only the clusters around them are recomputed. Costs are those of the base movement
+// profile.
+class PathHierarchy {
+public:
+  explicit PathHierarchy(const GlobalMap &Map, Size ClusterSize = 16) noexcept;
+
+  // Recomputes the clusters touched since the last update.
+  void Update() noexcept;
+
+  std::optional<Path> TryBuildPath(Coord3D From, Coord3D To) noexcept;
+
+  Size GetClusterSize() const noexcept { return ClusterSize_; }
+  size_t GetNumClusters() const noexcept { return Clusters_.size(); }
+  size_t GetNumEntrances() const noexcept { return EntranceByTile_.size(); }
+
+private:
+  struct Link {
+    size_t Tile;
+    Size Cost;
+  };
+
+  struct Entrance {
+    size_t Tile;
+    // Entrances of the neighbouring clusters one step away.
+    SmallVector<size_t, 3> Exits{};
+    // Other entrances of the same cluster.
+    std::vector<Link> Paths{};
+  };
+
+  struct Cluster {
+    Coord Origin;
+    Dims2D Extent;
+    Dim Layer;
+    std::vector<Entrance> Entrances{};
+  };
+
+  Size GetClusterIndex(Coord3D Coord) const noexcept;
+  bool IsInCluster(const Cluster &C, size_t Tile) const noexcept;
+
+  void Rebuild(std::vector<Size> DirtyClusters) noexcept;
+  void AddTransitions(Size ClusterIndex, const std::vector<bool> &IsDirty) noexcept;
+  void AddTransition(size_t From, size_t To, const std::vector<bool> &IsDirty) noexcept;
+  void ComputeIntraPaths(Cluster &C) noexcept;
+
+  // Costs from From to every entrance of its cluster, or from every entrance to To if IsReverse.
+  std::vector<Link> ComputeEntranceCosts(const Cluster &C, size_t Tile,
+                                         bool IsReverse) const noexcept;
+
+  bool Refine(size_t From, size_t To, Size BaseCost,
+              std::vector<Waypoint> &Waypoints) const noexcept;
+
+  const GlobalMap &Map_;
+  Size ClusterSize_;
+  Dims2D NumClusters_;
+  NavigationGrid::Revision Revision_;
+
+  std::vector<Cluster> Clusters_;
+  // Tile -> {cluster, index of the entrance in the cluster}.
+  std::unordered_map<size_t, std::pair<Size, Size>> EntranceByTile_;
+};
+
+} // namespace NotAGame
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "engine/path.h"
+#include "entities/navigation.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Building blocks shared by the path searches of the engine.
+
+namespace NotAGame {
+
+// Search buffers. Entries are stamped with the generation of the search that wrote them, so
+// nothing is cleared between queries and a search only touches the nodes it visits.
+class SearchScratch {
+public:
+  struct HeapItem {
+    Size Priority;
+    size_t Node;
+
+    bool operator>(const HeapItem &RHS) const noexcept { return Priority > RHS.Priority; }
+  };
+
+  void Reset(size_t NumNodes) noexcept {
+    if (Stamps_.size() < NumNodes) {
+      Stamps_.resize(NumNodes, 0);
+      Distances_.resize(NumNodes);
+      Pred_.resize(NumNodes);
+    }
+    if (++Generation_ == 0) {
+      std::fill(Stamps_.begin(), Stamps_.end(), 0);
+      Generation_ = 1;
+    }
+    Heap_.clear();
+    NumExpanded_ = 0;
+    PeakHeapSize_ = 0;
+  }
+
+  Size GetDistance(size_t Node) const noexcept {
+    return Stamps_[Node] == Generation_ ? Distances_[Node] : MAX_SIZE;
+  }
+  size_t GetPred(size_t Node) const noexcept { return Pred_[Node]; }
+
+  void SetDistance(size_t Node, Size Distance, size_t Pred) noexcept {
+    Stamps_[Node] = Generation_;
+    Distances_[Node] = Distance;
+    Pred_[Node] = Pred;
+  }
+
+  void Push(Size Priority, size_t Node) noexcept {
+    Heap_.push_back({Priority, Node});
+    std::push_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+    PeakHeapSize_ = std::max(PeakHeapSize_, Heap_.size());
+  }
+
+  HeapItem Pop() noexcept {
+    std::pop_heap(Heap_.begin(), Heap_.end(), std::greater<>{});
+    auto Item = Heap_.back();
+    Heap_.pop_back();
+    return Item;
+  }
+
+  bool IsEmpty() const noexcept { return Heap_.empty(); }
+
+  void CountExpanded() noexcept { ++NumExpanded_; }
+
+  // Work done by the last search.
+  void FillStats(SearchStats &Stats) const noexcept {
+    Stats.NodesExpanded = NumExpanded_;
+    Stats.PeakHeapSize = PeakHeapSize_;
+    Stats.MemoryUsage = Stamps_.capacity() * sizeof(uint32_t) +
+                        Distances_.capacity() * sizeof(Size) + Pred_.capacity() * sizeof(size_t) +
+                        Heap_.capacity() * sizeof(HeapItem);
+  }
+
+private:
+  std::vector<uint32_t> Stamps_;
+  std::vector<Size> Distances_;
+  std::vector<size_t> Pred_;
+  std::vector<HeapItem> Heap_;
+  uint32_t Generation_ = 0;
+  size_t NumExpanded_ = 0;
+  size_t PeakHeapSize_ = 0;
+};
+
+// One scratch per thread, searches must not be nested.
+SearchScratch &GetSearchScratch() noexcept;
+
+inline Dim AbsDiff(Dim A, Dim B) noexcept { return A > B ? A - B : B - A; }
+
+// Diagonal steps cost the same as straight ones, so the octile distance degenerates into the
+// Chebyshev one. Scaled by the cheapest terrain it never overestimates, except for the free step
+// out of a map object, which can only be the first one and is expanded before anything else.
+inline Size OctileDistance(Coord3D From, Coord3D To, Size MinCost) noexcept {
+  return MinCost * std::max(AbsDiff(From.X, To.X), AbsDiff(From.Y, To.Y));
+}
+
+// A* from Start to Target over the tiles passable under Costs and accepted by Filter. Stops as
+// soon as the target is popped, the path can then be read from the scratch with ExtractPath.
+// Heuristic must never overestimate the remaining cost.
+template <typename FilterFn, typename HeuristicFn>
+bool RunAStar(const NavigationGrid &Nav, const MovementCosts &Costs, SearchScratch &Scratch,
+              size_t Start, size_t Target, FilterFn &&Filter, HeuristicFn &&Heuristic) noexcept {
+  Scratch.Reset(Nav.GetNumTiles());
+  Scratch.SetDistance(Start, 0, Start);
+  Scratch.Push(Heuristic(Start), Start);
+
+  while (!Scratch.IsEmpty()) {
+    const auto [Priority, Node] = Scratch.Pop();
+    const auto Distance = Scratch.GetDistance(Node);
+    if (Priority > Distance + Heuristic(Node)) {
+      continue; // Stale entry.
+    }
+    if (Node == Target) {
+      return true;
+    }
+    Scratch.CountExpanded();
+    Nav.ForEachNeighbour(Node, [&, Node = Node](size_t Neighbour) {
+      if (!Costs.IsPassable(Neighbour) || !Filter(Neighbour)) {
+        return;
+      }
+      const auto NewDistance = Distance + Costs.GetStepCost(Node, Neighbour);
+      if (NewDistance < Scratch.GetDistance(Neighbour)) {
+        Scratch.SetDistance(Neighbour, NewDistance, Node);
+        Scratch.Push(NewDistance + Heuristic(Neighbour), Neighbour);
+      }
+    });
+  }
+  return false;
+}
+
+template <typename FilterFn>
+bool RunAStar(const NavigationGrid &Nav, const MovementCosts &Costs, SearchScratch &Scratch,
+              size_t Start, size_t Target, FilterFn &&Filter) noexcept {
+  const auto To = Nav.ToCoord(Target);
+  const auto MinCost = Costs.GetMinCost();
+  return RunAStar(Nav, Costs, Scratch, Start, Target, Filter, [&](size_t Node) {
+    return OctileDistance(Nav.ToCoord(Node), To, MinCost);
+  });
+}
+
+// Dijkstra from Start over the tiles passable under Costs and accepted by Filter. Tiles whose cost
+// reached Budget are not expanded. A reverse search computes the costs from every tile to Start
+// instead.
+template <typename FilterFn>
+void RunDijkstra(const NavigationGrid &Nav, const MovementCosts &Costs, SearchScratch &Scratch,
+                 size_t Start, Size Budget, bool IsReverse, FilterFn &&Filter) noexcept {
+  Scratch.Reset(Nav.GetNumTiles());
+  Scratch.SetDistance(Start, 0, Start);
+  Scratch.Push(0, Start);
+
+  while (!Scratch.IsEmpty()) {
+    const auto [Distance, Node] = Scratch.Pop();
+    if (Distance != Scratch.GetDistance(Node)) {
+      continue; // Stale entry.
+    }
+    if (Distance >= Budget) {
+      break;
+    }
+    Scratch.CountExpanded();
+    Nav.ForEachNeighbour(Node, [&, Distance = Distance, Node = Node](size_t Neighbour) {
+      if (!Costs.IsPassable(Neighbour) || !Filter(Neighbour)) {
+        return;
+      }
+      const auto StepCost =
+          IsReverse ? Costs.GetStepCost(Neighbour, Node) : Costs.GetStepCost(Node, Neighbour);
+      const auto NewDistance = Distance + StepCost;
+      if (NewDistance < Scratch.GetDistance(Neighbour)) {
+        Scratch.SetDistance(Neighbour, NewDistance, Node);
+        Scratch.Push(NewDistance, Neighbour);
+      }
+    });
+  }
+}
+
+// Appends the waypoints from Start to Target found by the last search, costs are shifted by
+// BaseCost.
+void ExtractPath(const NavigationGrid &Nav, const SearchScratch &Scratch, size_t Start,
+                 size_t Target, Size BaseCost, std::vector<Waypoint> &Waypoints) noexcept;
+
+} // namespace NotAGame
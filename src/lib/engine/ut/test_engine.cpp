@@ -0,0 +1,254 @@
+#include "engine/engine.h"
+#include "game/mod.h"
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+class TestEngine : public ::testing::Test {
+protected:
+  TestEngine() : Mod_{Mod::Load(std::filesystem::path{TEST_MOD_DIR})}, Map_{CreateMap()} {}
+
+  MapState CreateMap() noexcept {
+    GlobalMap M{1, 16, 16};
+    const auto RoadId = Mod_.GetTerrains().GetId("road");
+    for (Dim X = 0; X < M.GetWidth(); ++X) {
+      for (Dim Y = 0; Y < M.GetHeight(); ++Y) {
+        M.SetTerrain(Coord3D{X, Y, 0}, RoadId);
+      }
+    }
+
+    GameplaySystems Systems{Mod_.GetResources(), 2, Dims3D{16, 16, 1}};
+    MapObject CapObj{Named{"1st_capital", "Capital", "capitol"},
+                     MapObject::Capital,
+                     Coord3D{1, 1, 0},
+                     Dims2D{5, 5},
+                     Coord{4, 4},
+                     false,
+                     true};
+    CapObj.Owner = 0;
+    auto CapitalObjId = M.AddObject("1st_capital", std::move(CapObj));
+    auto &Cap = M.GetObject(CapitalObjId.GetValue());
+
+    GuardComponent CapitalGuard;
+    CapitalGuard.Owner = 0;
+    auto &AddedGuard = Systems.Guards.AddComponent(CapitalGuard);
+    CapitalComponent Comp;
+    Comp.FractionId = Mod_.GetFractions().GetId("mountain_clans");
+    Comp.GuardId = AddedGuard.ComponentId;
+    Comp.PlayerId = 0;
+    Comp.ObjectId = CapitalObjId.GetValue();
+    Systems.Capitals.AddComponent(Comp);
+    Cap.CapitalTrait = M.AddCapital(Comp);
+    Cap.Guard = AddedGuard.ComponentId;
+
+    Resources R{Mod_.GetResources()};
+    R.SetAmountByName("gold", 100);
+    ResourceSource CapitalIncome{.ComponentId = {}, .Income = R, .Player = 0};
+    Cap.ResourceTrait = Systems.Resources.AddComponent(CapitalIncome).ComponentId;
+
+    return MapState{.GlobalMap = std::move(M), .Systems = std::move(Systems)};
+  }
+
+  OnlineGameState &StartGame(Engine &E) {
+    auto LobbyId = E.PlayerConnect(PlayerKind::Human).GetValue();
+    EXPECT_TRUE(E.SetPlayerId(LobbyId, 0).IsSuccess());
+    auto Response = E.PlayerReady(LobbyId);
+    EXPECT_TRUE(Response.Result.IsSuccess());
+    auto &State = *E.GetOnlineState();
+    State.SavedState.PlayerStates[0].ResourcesGained.SetAmountByName("gold", 1000);
+    return State;
+  }
+
+  // A squad led by a guardian with the given move points, placed directly on the map.
+  Id<Squad> AddSquad(PlayerId Player, Coord3D Position, Size MovePoints) {
+    auto &Systems = Map_.Systems;
+    auto &Leader = Systems.Units.AddComponent(Mod_.GetUnitPresets().GetObjectByKey("guardian"));
+    LeaderData Data;
+    Data.Steps = SizeTrait{MovePoints};
+    Leader.LeaderDataId = Systems.Leaders.AddComponent(std::move(Data)).ComponentId;
+
+    Squad S{Mod_.GetGridSettings(), Leader.ComponentId, Player};
+    S.Position = Position;
+    EXPECT_TRUE(S.GetGrid().TrySetUnit(Leader.ComponentId, &Leader, Coord{1, 1}));
+    auto &Added = Systems.Squads.AddComponent(S);
+    Leader.SquadId = Added.ComponentId;
+    Map_.GlobalMap.SetSquad(Position, Added.ComponentId);
+    return Added.ComponentId;
+  }
+
+  Path BuildPath(Coord3D From, Coord3D To) {
+    auto P = TryBuildPath(From, To, Map_.GlobalMap);
+    EXPECT_TRUE(P);
+    return P ? std::move(*P) : Path{};
+  }
+
+  // Squad moves of the human player's turns.
+  struct MoveRecorder : public EventListener {
+    void OnPlayerNewTurn(const NewTurnEvent &Event) noexcept override {
+      if (Event.Player == 0) {
+        Moves.push_back(Event.SquadsMoved);
+      }
+    }
+
+    std::vector<std::vector<SquadMovedEvent>> Moves;
+  };
+
+  Mod Mod_;
+  MapState Map_;
+};
+
+TEST_F(TestEngine, HiredSquadLeavesCapital) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+  auto &Systems = State.SavedState.Map.Systems;
+  const auto &Map = Map_.GlobalMap;
+  const auto &Nav = Map.GetNavigation();
+
+  const auto &Capital = Map.GetCapitals()[0];
+  const auto GuardId = Capital.GuardId;
+  auto Hired = E.HireLeader(0, GuardId, Capital.ObjectId, Mod_.GetUnitPresets().GetId("guardian"),
+                            Coord{1, 1});
+  ASSERT_TRUE(Hired.IsSuccess());
+  const auto SquadId = Hired.GetValue().SquadId;
+  const auto Entrance = Systems.Squads.GetComponent(SquadId).Position;
+
+  const Coord3D First{Entrance.X + 2, Entrance.Y, 0}, Second{Entrance.X + 4, Entrance.Y, 0};
+  for (const auto To : {First, Second}) {
+    const auto &Squad = Systems.Squads.GetComponent(SquadId);
+    auto Path = TryBuildPath(Squad.Position, To, Map);
+    ASSERT_TRUE(Path);
+    auto Moved = E.MoveSquad(0, SquadId, *Path);
+    ASSERT_TRUE(Moved.IsSuccess());
+    ASSERT_EQ(Squad.Position, To);
+  }
+
+  // The first stop is free again, only the second one is taken.
+  EXPECT_FALSE(Map.GetTile(First).Squad_.IsValid());
+  EXPECT_FALSE(Nav.IsOccupied(Nav.ToIndex(First)));
+  EXPECT_FALSE(Map.GetSquadIndex().FindNearest(First, 0, [](const auto &) { return true; }));
+  EXPECT_EQ(Map.GetTile(Second).Squad_, SquadId);
+  EXPECT_TRUE(Nav.IsOccupied(Nav.ToIndex(Second)));
+  EXPECT_FALSE(Systems.Guards.GetComponent(GuardId).SquadId.IsValid());
+}
+
+TEST_F(TestEngine, MultiDayOrder) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+  MoveRecorder Recorder;
+  E.SetEventListener(&Recorder);
+
+  const Coord3D From{0, 12, 0}, To{10, 12, 0};
+  const auto SquadId = AddSquad(0, From, 4);
+  ASSERT_TRUE(E.SetMoveOrder(0, SquadId, BuildPath(From, To)).IsSuccess());
+
+  // Four tiles a day, every step of the route gets one column closer. The rest of the route is
+  // kept for the next days.
+  const auto &Squad = State.SavedState.Map.Systems.Squads.GetComponent(SquadId);
+  for (const auto &[X, IsFinished] : {std::pair{4u, false}, {8u, false}, {10u, true}}) {
+    ASSERT_TRUE(E.EndTurn(State.Players[0]).IsSuccess());
+    ASSERT_EQ(Recorder.Moves.back().size(), 1u);
+    const auto &Moved = Recorder.Moves.back()[0];
+    EXPECT_EQ(Moved.SquadId, SquadId);
+    EXPECT_EQ(Moved.To.X, X);
+    EXPECT_EQ(Moved.IsOrderFinished, IsFinished);
+    EXPECT_EQ(Squad.Position, Moved.To);
+    EXPECT_EQ(E.GetMoveOrder(0, SquadId) == nullptr, IsFinished);
+  }
+}
+
+TEST_F(TestEngine, BlockedOrder) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+  MoveRecorder Recorder;
+  E.SetEventListener(&Recorder);
+  const auto &Squads = State.SavedState.Map.Systems.Squads;
+
+  // A squad steps onto the route, the march goes around it.
+  const Coord3D From{0, 12, 0}, To{8, 12, 0};
+  const auto SquadId = AddSquad(0, From, 20);
+  ASSERT_TRUE(E.SetMoveOrder(0, SquadId, BuildPath(From, To)).IsSuccess());
+  AddSquad(0, Coord3D{4, 12, 0}, 20);
+  ASSERT_TRUE(E.EndTurn(State.Players[0]).IsSuccess());
+  EXPECT_EQ(Squads.GetComponent(SquadId).Position, To);
+  ASSERT_EQ(Recorder.Moves.back().size(), 1u);
+  EXPECT_TRUE(Recorder.Moves.back()[0].IsOrderFinished);
+
+  // The target is taken, the order is dropped.
+  const Coord3D Back{0, 12, 0};
+  ASSERT_TRUE(E.SetMoveOrder(0, SquadId, BuildPath(To, Back)).IsSuccess());
+  AddSquad(0, Back, 20);
+  ASSERT_TRUE(E.EndTurn(State.Players[0]).IsSuccess());
+  EXPECT_EQ(Squads.GetComponent(SquadId).Position, To);
+  ASSERT_EQ(Recorder.Moves.back().size(), 1u);
+  EXPECT_EQ(Recorder.Moves.back()[0].From, To);
+  EXPECT_EQ(Recorder.Moves.back()[0].To, To);
+  EXPECT_TRUE(Recorder.Moves.back()[0].IsOrderFinished);
+  EXPECT_EQ(E.GetMoveOrder(0, SquadId), nullptr);
+}
+
+TEST_F(TestEngine, OrderStopsNextToEnemy) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+  MoveRecorder Recorder;
+  E.SetEventListener(&Recorder);
+
+  // The route goes through a gap in a wall of own squads, past the enemy behind it.
+  const Coord3D From{0, 12, 0}, To{12, 12, 0};
+  for (Dim Y = 0; Y < 16; ++Y) {
+    if (Y != 12) {
+      AddSquad(0, Coord3D{6, Y, 0}, 20);
+    }
+  }
+  const auto SquadId = AddSquad(0, From, 20);
+  ASSERT_TRUE(E.SetMoveOrder(0, SquadId, BuildPath(From, To)).IsSuccess());
+  AddSquad(1, Coord3D{8, 12, 0}, 20);
+  ASSERT_TRUE(E.EndTurn(State.Players[0]).IsSuccess());
+
+  // The first tile next to the enemy, no battle is started.
+  EXPECT_EQ(State.SavedState.Map.Systems.Squads.GetComponent(SquadId).Position.X, 7u);
+  ASSERT_EQ(Recorder.Moves.back().size(), 1u);
+  EXPECT_TRUE(Recorder.Moves.back()[0].IsOrderFinished);
+  EXPECT_EQ(E.GetMoveOrder(0, SquadId), nullptr);
+  EXPECT_FALSE(State.SavedState.FightState);
+}
+
+TEST_F(TestEngine, OrdersExecuteInSquadOrder) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+  MoveRecorder Recorder;
+  E.SetEventListener(&Recorder);
+  const auto &Squads = State.SavedState.Map.Systems.Squads;
+
+  // Both squads head to the same tile, the one with the lower id takes it.
+  const Coord3D FromA{2, 12, 0}, FromB{8, 12, 0}, To{5, 12, 0};
+  const auto A = AddSquad(0, FromA, 20), B = AddSquad(0, FromB, 20);
+  ASSERT_LT(A, B);
+  ASSERT_TRUE(E.SetMoveOrder(0, A, BuildPath(FromA, To)).IsSuccess());
+  ASSERT_TRUE(E.SetMoveOrder(0, B, BuildPath(FromB, To)).IsSuccess());
+  ASSERT_TRUE(E.EndTurn(State.Players[0]).IsSuccess());
+
+  EXPECT_EQ(Squads.GetComponent(A).Position, To);
+  EXPECT_EQ(Squads.GetComponent(B).Position, FromB);
+  const auto &Moves = Recorder.Moves.back();
+  ASSERT_EQ(Moves.size(), 2u);
+  EXPECT_EQ(Moves[0].SquadId, A);
+  EXPECT_EQ(Moves[1].SquadId, B);
+  EXPECT_TRUE(Moves[1].IsOrderFinished);
+}
+
+TEST_F(TestEngine, AttackCancelsOrder) {
+  Engine E{Mod_, Map_};
+  auto &State = StartGame(E);
+
+  // The client continues a march only if the move did not start a battle.
+  const Coord3D From{0, 12, 0}, To{10, 12, 0};
+  const auto SquadId = AddSquad(0, From, 20);
+  const auto EnemyId = AddSquad(1, Coord3D{3, 11, 0}, 20);
+  ASSERT_TRUE(E.SetMoveOrder(0, SquadId, BuildPath(From, To)).IsSuccess());
+  auto Moved = E.MoveSquad(0, SquadId, BuildPath(From, Coord3D{2, 12, 0}));
+  ASSERT_TRUE(Moved.IsSuccess());
+  EXPECT_EQ(Moved.GetValue().SquadAttacked, EnemyId);
+  ASSERT_TRUE(State.SavedState.FightState);
+  EXPECT_EQ(E.GetMoveOrder(0, SquadId), nullptr);
+}
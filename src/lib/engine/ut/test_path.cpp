@@ -0,0 +1,620 @@
+#include "engine/path.h"
+#include "engine/delta_stepping.h"
+#include "engine/flow_field.h"
+#include "engine/incremental_path.h"
+#include "engine/landmarks.h"
+#include "engine/path_hierarchy.h"
+#include "engine/path_search.h"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+class TestPath : public ::testing::Test {
+protected:
+  virtual void SetUp() {
+    Terrains_.AddObject("road",
+                        Terrain{Named{"road", "Road", "road"}, 1, TerrainKind::Ground,
+                                GroundKind::Road});
+    Terrains_.AddObject("forest", Terrain{Named{"forest", "Forest", "forest"}, 4,
+                                          TerrainKind::Ground, GroundKind::Forest});
+  }
+
+  GlobalMap MakeMap(Size Width, Size Height, Id<Terrain> TerrainId = 0) {
+    GlobalMap Map{1, Width, Height};
+    for (Dim Y = 0; Y < Height; ++Y) {
+      for (Dim X = 0; X < Width; ++X) {
+        Map.SetTerrain(Coord3D{X, Y, 0}, TerrainId);
+      }
+    }
+    Map.BuildNavigation(Terrains_);
+    return Map;
+  }
+
+  Utils::Registry<Terrain, 8> Terrains_;
+};
+
+TEST_F(TestPath, Straight) {
+  auto Map = MakeMap(8, 4);
+  auto P = TryBuildPath(Coord3D{0, 1, 0}, Coord3D{5, 1, 0}, Map);
+  ASSERT_TRUE(P);
+  ASSERT_EQ(P->Waypoints.size(), 6);
+  EXPECT_EQ(P->Waypoints.front().Coord, (Coord3D{0, 1, 0}));
+  EXPECT_EQ(P->Waypoints.back().Coord, (Coord3D{5, 1, 0}));
+  for (Size I = 0; I < P->Waypoints.size(); ++I) {
+    EXPECT_EQ(P->Waypoints[I].Cost, I);
+  }
+}
+
+TEST_F(TestPath, AvoidsExpensiveTerrain) {
+  auto Map = MakeMap(5, 5);
+  for (Dim Y = 0; Y < 2; ++Y) {
+    Map.SetTerrain(Coord3D{2, Y, 0}, 1);
+  }
+  auto P = TryBuildPath(Coord3D{0, 0, 0}, Coord3D{4, 0, 0}, Map);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, 4);
+  for (const auto &Pt : P->Waypoints) {
+    EXPECT_FALSE(Pt.Coord.X == 2 && Pt.Coord.Y < 2);
+  }
+}
+
+TEST_F(TestPath, PatchedBySquadsAndObjects) {
+  auto Map = MakeMap(5, 3);
+  Map.SetSquad(Coord3D{2, 1, 0}, Id<Squad>{0});
+  MapObject Wall{Named{"wall", "Wall", "wall"}, MapObject::Other, Coord3D{2, 2, 0}, Dims2D{1, 1},
+                 std::nullopt, false, false};
+  ASSERT_TRUE(Map.AddObject("wall", std::move(Wall)).IsSuccess());
+
+  auto P = TryBuildPath(Coord3D{0, 1, 0}, Coord3D{4, 1, 0}, Map);
+  ASSERT_TRUE(P);
+  for (const auto &Pt : P->Waypoints) {
+    EXPECT_FALSE(Pt.Coord.X == 2 && Pt.Coord.Y > 0);
+  }
+
+  Map.SetSquad(Coord3D{2, 1, 0}, NullId);
+  P = TryBuildPath(Coord3D{0, 1, 0}, Coord3D{4, 1, 0}, Map);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, 4);
+}
+
+TEST_F(TestPath, Unreachable) {
+  auto Map = MakeMap(5, 5);
+  MapObject Wall{Named{"wall", "Wall", "wall"}, MapObject::Other, Coord3D{2, 0, 0}, Dims2D{1, 5},
+                 std::nullopt, false, false};
+  ASSERT_TRUE(Map.AddObject("wall", std::move(Wall)).IsSuccess());
+
+  EXPECT_FALSE(TryBuildPath(Coord3D{0, 0, 0}, Coord3D{4, 4, 0}, Map));
+  EXPECT_FALSE(TryBuildPath(Coord3D{0, 0, 0}, Coord3D{2, 2, 0}, Map));
+  EXPECT_TRUE(TryBuildPath(Coord3D{0, 0, 0}, Coord3D{1, 4, 0}, Map));
+}
+
+TEST_F(TestPath, Connectivity) {
+  auto Map = MakeMap(6, 6);
+  const auto &Nav = Map.GetNavigation();
+  auto Connected = [&](Coord3D From, Coord3D To) {
+    return Nav.MayBeConnected(Nav.ToIndex(From), Nav.ToIndex(To));
+  };
+  EXPECT_TRUE(Connected(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}));
+
+  // Cutting the map in two relabels it, a gap merges the halves again.
+  for (Dim Y = 0; Y < 6; ++Y) {
+    Map.SetTerrain(Coord3D{3, Y, 0}, Id<Terrain>{});
+  }
+  EXPECT_FALSE(Connected(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}));
+  EXPECT_FALSE(MayBeReachable(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}, Map));
+  EXPECT_FALSE(TryBuildPath(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}, Map));
+  EXPECT_TRUE(Connected(Coord3D{0, 0, 0}, Coord3D{2, 5, 0}));
+  Map.SetTerrain(Coord3D{3, 2, 0}, 0);
+  EXPECT_TRUE(Connected(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}));
+
+  // Squads do not count, a start inside an object leaves through its neighbours.
+  Map.SetSquad(Coord3D{3, 2, 0}, Id<Squad>{0});
+  EXPECT_TRUE(Connected(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}));
+  MapObject Hut{Named{"hut", "Hut", "hut"}, MapObject::Other, Coord3D{0, 0, 0}, Dims2D{1, 1},
+                std::nullopt, false, false};
+  ASSERT_TRUE(Map.AddObject("hut", std::move(Hut)).IsSuccess());
+  EXPECT_TRUE(Connected(Coord3D{0, 0, 0}, Coord3D{5, 5, 0}));
+}
+
+TEST_F(TestPath, GridBorder) {
+  auto Map = MakeMap(5, 3);
+  const auto &Nav = Map.GetNavigation();
+  const auto Costs = Nav.GetCosts();
+  for (Dim Y = 0; Y < 3; ++Y) {
+    for (Dim X = 0; X < 5; ++X) {
+      const Coord3D Coord{X, Y, 0};
+      EXPECT_EQ(Nav.ToCoord(Nav.ToIndex(Coord)), Coord);
+      const auto Neighbours = Nav.GetNeighbours(Nav.ToIndex(Coord));
+      for (size_t I = 0; I < Neighbours.size(); ++I) {
+        // Off the map, the neighbour is a border tile.
+        const auto Expected = GetPlaneNeighboors(Coord)[I];
+        EXPECT_EQ(Nav.ToCoord(Neighbours[I]), Expected);
+        EXPECT_EQ(Costs.IsPassable(Neighbours[I]), Map.IsValid(Expected));
+      }
+    }
+  }
+}
+
+TEST_F(TestPath, LeavingObjectIsFree) {
+  auto Map = MakeMap(6, 6);
+  MapObject Capital{Named{"capital", "Capital", "capital"}, MapObject::Capital, Coord3D{0, 0, 0},
+                    Dims2D{2, 2}, Coord{1, 1}, false, true};
+  ASSERT_TRUE(Map.AddObject("capital", std::move(Capital)).IsSuccess());
+
+  auto P = TryBuildPath(Coord3D{1, 1, 0}, Coord3D{5, 5, 0}, Map);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.size(), 5);
+  EXPECT_EQ(P->Waypoints.back().Cost, 3);
+}
+
+TEST_F(TestPath, MovementProfiles) {
+  auto Map = MakeMap(6, 3, 1);
+  const Coord3D From{0, 1, 0}, To{4, 1, 0};
+  auto Base = TryBuildPath(From, To, Map);
+  ASSERT_TRUE(Base);
+  EXPECT_EQ(Base->Waypoints.back().Cost, 16);
+
+  auto Walker = TryBuildPath(From, To, Map, ForestWalker);
+  ASSERT_TRUE(Walker);
+  EXPECT_EQ(Walker->Waypoints.back().Cost, 4);
+  EXPECT_EQ(ComputeMoveCost(From, Coord3D{1, 1, 0}, Map, ForestWalker), 1);
+  EXPECT_EQ(ComputeDistanceField(From, 2, Map, ForestWalker).GetCost(Coord3D{2, 1, 0}), 2);
+
+  // Profile grids follow the map once created.
+  const auto &Nav = Map.GetNavigation();
+  Map.SetSquad(Coord3D{2, 1, 0}, Id<Squad>{0});
+  EXPECT_FALSE(Nav.GetCosts(ForestWalker).IsPassable(Nav.ToIndex(Coord3D{2, 1, 0})));
+  Map.SetTerrain(Coord3D{3, 0, 0}, 0);
+  EXPECT_EQ(Nav.GetCosts(ForestWalker | RoadRunner).GetCost(Nav.ToIndex(Coord3D{3, 0, 0})), 1);
+  EXPECT_EQ(Nav.GetCosts(ForestWalker).GetCost(Nav.ToIndex(Coord3D{3, 0, 0})), 1);
+  EXPECT_EQ(Nav.GetCost(Nav.ToIndex(Coord3D{3, 0, 0})), 1);
+  EXPECT_EQ(Nav.GetCost(Nav.ToIndex(Coord3D{4, 0, 0})), 4);
+}
+
+TEST_F(TestPath, Landmarks) {
+  // A forest wall with a gap at the bottom, the octile distance leads straight into it.
+  auto Map = MakeMap(32, 32);
+  for (Dim Y = 0; Y < 30; ++Y) {
+    Map.SetTerrain(Coord3D{16, Y, 0}, 1);
+    Map.SetTerrain(Coord3D{17, Y, 0}, 1);
+  }
+  Map.BuildNavigation(Terrains_);
+  const Coord3D From{4, 8, 0}, To{28, 8, 0};
+
+  SearchStats Plain;
+  auto Expected = TryBuildPath(From, To, Map, kBaseMovement, &Plain);
+  ASSERT_TRUE(Expected);
+
+  const auto Built = BuildLandmarks(Map, 4);
+  EXPECT_EQ(Built.NumLandmarks, 4);
+  EXPECT_GE(Built.MemoryUsage, 32 * 32 * 4 * 4);
+  ASSERT_NE(Map.GetNavigation().GetLandmarks(kBaseMovement), nullptr);
+
+  SearchStats WithLandmarks;
+  auto P = TryBuildPath(From, To, Map, kBaseMovement, &WithLandmarks);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, Expected->Waypoints.back().Cost);
+  EXPECT_LT(WithLandmarks.NodesExpanded, Plain.NodesExpanded);
+
+  // Squads and objects keep the bounds valid, terrain changes do not.
+  for (Dim Y = 0; Y < 30; ++Y) {
+    Map.SetSquad(Coord3D{16, Y, 0}, Id<Squad>{Y});
+  }
+  P = TryBuildPath(From, To, Map);
+  ASSERT_TRUE(P);
+  EXPECT_NE(Map.GetNavigation().GetLandmarks(kBaseMovement), nullptr);
+  Map.SetLandmarks(kBaseMovement, nullptr);
+  Expected = TryBuildPath(From, To, Map);
+  ASSERT_TRUE(Expected);
+  EXPECT_EQ(P->Waypoints.back().Cost, Expected->Waypoints.back().Cost);
+
+  BuildLandmarks(Map, 4);
+  Map.SetTerrain(Coord3D{16, 10, 0}, 0);
+  EXPECT_EQ(Map.GetNavigation().GetLandmarks(kBaseMovement), nullptr);
+}
+
+TEST_F(TestPath, FlowFields) {
+  auto Map = MakeMap(16, 16);
+  for (Dim Y = 0; Y < 16; ++Y) {
+    Map.SetTerrain(Coord3D{4, Y, 0}, 1);
+  }
+  MapObject Tower{Named{"tower", "Tower", "tower"}, MapObject::Other, Coord3D{9, 7, 0},
+                  Dims2D{2, 2}, std::nullopt, false, false};
+  auto Added = Map.AddObject("tower", std::move(Tower));
+  ASSERT_TRUE(Added.IsSuccess());
+  const auto TowerId = Added.GetValue();
+
+  FlowFieldCache Cache{Map};
+  const std::vector<Coord3D> Sources = {{0, 0, 0}, {0, 8, 0}, {15, 15, 0}, {2, 14, 0}};
+  auto Check = [&](const FlowField &Field) {
+    for (const auto From : Sources) {
+      const auto P = Field.BuildPath(From);
+      ASSERT_TRUE(P);
+      EXPECT_EQ(P->Waypoints.back().Cost, Field.GetCost(From));
+      const auto Target = P->Target;
+      EXPECT_TRUE(Target.X + 1 >= 9 && Target.X <= 11 && Target.Y + 1 >= 7 && Target.Y <= 9);
+      // As cheap as a search to the same tile.
+      const auto Searched = TryBuildPath(From, Target, Map);
+      ASSERT_TRUE(Searched);
+      EXPECT_EQ(Searched->Waypoints.back().Cost, P->Waypoints.back().Cost);
+    }
+  };
+  Check(Cache.Get(TowerId));
+  Check(Cache.Get(TowerId));
+  EXPECT_EQ(Cache.GetNumComputed(), 1);
+
+  // Far changes are repaired, and the result is the same as computed anew.
+  Map.SetTerrain(Coord3D{1, 8, 0}, 1);
+  Map.SetSquad(Coord3D{3, 12, 0}, Id<Squad>{0});
+  const auto &Repaired = Cache.Get(TowerId);
+  EXPECT_EQ(Cache.GetNumComputed(), 1);
+  EXPECT_EQ(Cache.GetNumRepaired(), 1);
+  Check(Repaired);
+  auto CheckAsFresh = [&](const FlowField &Field) {
+    FlowFieldCache Fresh{Map};
+    for (Dim Y = 0; Y < 16; ++Y) {
+      for (Dim X = 0; X < 16; ++X) {
+        EXPECT_EQ(Field.GetCost(Coord3D{X, Y, 0}), Fresh.Get(TowerId).GetCost(Coord3D{X, Y, 0}));
+      }
+    }
+  };
+  CheckAsFresh(Repaired);
+
+  // Only the routes through a patched tile are searched again.
+  auto NumExpanded = Cache.GetNumExpanded();
+  Map.SetSquad(Coord3D{15, 0, 0}, Id<Squad>{2});
+  CheckAsFresh(Cache.Get(TowerId));
+  EXPECT_EQ(Cache.GetNumRepaired(), 2);
+  EXPECT_LT(Cache.GetNumExpanded() - NumExpanded, 10);
+  // A tile freed again may open cheaper routes.
+  NumExpanded = Cache.GetNumExpanded();
+  Map.SetSquad(Coord3D{3, 12, 0}, NullId);
+  CheckAsFresh(Cache.Get(TowerId));
+  EXPECT_EQ(Cache.GetNumRepaired(), 3);
+  EXPECT_LT(Cache.GetNumExpanded() - NumExpanded, 16 * 16);
+
+  // A squad next to the target changes the goals.
+  Map.SetSquad(Coord3D{8, 8, 0}, Id<Squad>{1});
+  Check(Cache.Get(TowerId));
+  EXPECT_EQ(Cache.GetNumComputed(), 2);
+  EXPECT_NE(Cache.Get(TowerId, ForestWalker).GetCost(Coord3D{0, 8, 0}),
+            Cache.Get(TowerId).GetCost(Coord3D{0, 8, 0}));
+  EXPECT_EQ(Cache.GetNumFields(), 2);
+}
+
+TEST_F(TestPath, DistanceField) {
+  auto Map = MakeMap(32, 32);
+  Map.SetTerrain(Coord3D{11, 10, 0}, 1);
+
+  const Coord3D From{10, 10, 0};
+  auto Field = ComputeDistanceField(From, 3, Map);
+  EXPECT_EQ(Field.GetCost(From), 0);
+  EXPECT_EQ(Field.GetCost(Coord3D{11, 10, 0}), 4); // A step behind the budget.
+  EXPECT_EQ(Field.GetCost(Coord3D{13, 13, 0}), 3);
+  EXPECT_FALSE(Field.Contains(Coord3D{14, 10, 0}));
+  EXPECT_FALSE(Field.Contains(Coord3D{10, 10, 1}));
+
+  Size NumTiles = 0;
+  Field.ForEachTile([&](Coord3D Coord, Size Cost) {
+    ++NumTiles;
+    const auto P = Field.BuildPath(Coord);
+    ASSERT_TRUE(P);
+    EXPECT_EQ(P->Waypoints.front().Coord, From);
+    EXPECT_EQ(P->Waypoints.back().Cost, Cost);
+    const auto Reference = TryBuildPath(From, Coord, Map);
+    ASSERT_TRUE(Reference);
+    EXPECT_EQ(Reference->Waypoints.back().Cost, Cost);
+  });
+  EXPECT_EQ(NumTiles, 7 * 7);
+}
+
+TEST_F(TestPath, Hierarchy) {
+  auto Map = MakeMap(64, 64);
+  for (Dim Y = 0; Y < 64; ++Y) {
+    for (Dim X = 0; X < 64; ++X) {
+      if ((X * 7 + Y * 13) % 5 == 0) {
+        Map.SetTerrain(Coord3D{X, Y, 0}, 1);
+      }
+    }
+  }
+  PathHierarchy Hierarchy{Map, 8};
+  EXPECT_EQ(Hierarchy.GetNumClusters(), 64);
+
+  auto CheckPath = [&](Coord3D From, Coord3D To) {
+    auto Expected = TryBuildPath(From, To, Map);
+    auto P = Hierarchy.TryBuildPath(From, To);
+    ASSERT_EQ(P.has_value(), Expected.has_value());
+    if (!P) {
+      return;
+    }
+    ASSERT_EQ(P->Waypoints.front().Coord, From);
+    ASSERT_EQ(P->Waypoints.back().Coord, To);
+    EXPECT_GE(P->Waypoints.back().Cost, Expected->Waypoints.back().Cost);
+    for (size_t I = 1; I < P->Waypoints.size(); ++I) {
+      const auto &Prev = P->Waypoints[I - 1], &Cur = P->Waypoints[I];
+      EXPECT_LE(std::max(AbsDiff(Prev.Coord.X, Cur.Coord.X), AbsDiff(Prev.Coord.Y, Cur.Coord.Y)),
+                1);
+      EXPECT_EQ(Cur.Cost, Prev.Cost + ComputeMoveCost(Prev.Coord, Cur.Coord, Map));
+    }
+  };
+
+  CheckPath(Coord3D{0, 0, 0}, Coord3D{63, 63, 0});
+  CheckPath(Coord3D{3, 60, 0}, Coord3D{60, 2, 0});
+
+  // A wall with a single gap, the hierarchy has to notice both the wall and the gap.
+  for (Dim Y = 0; Y < 64; ++Y) {
+    if (Y != 40) {
+      Map.SetSquad(Coord3D{32, Y, 0}, Id<Squad>{Y});
+    }
+  }
+  CheckPath(Coord3D{0, 0, 0}, Coord3D{63, 0, 0});
+  auto P = Hierarchy.TryBuildPath(Coord3D{0, 0, 0}, Coord3D{63, 0, 0});
+  ASSERT_TRUE(P);
+  EXPECT_TRUE(std::ranges::any_of(P->Waypoints,
+                                  [](const Waypoint &W) { return W.Coord == Coord3D{32, 40, 0}; }));
+
+  Map.SetSquad(Coord3D{32, 40, 0}, Id<Squad>{40});
+  EXPECT_FALSE(Hierarchy.TryBuildPath(Coord3D{0, 0, 0}, Coord3D{63, 0, 0}));
+}
+
+TEST_F(TestPath, BatchDistanceFields) {
+  auto Map = MakeMap(32, 32);
+  for (Dim Y = 0; Y < 32; Y += 3) {
+    Map.SetTerrain(Coord3D{Y, Y, 0}, 1);
+  }
+
+  std::vector<Coord3D> Sources;
+  for (Dim I = 0; I < 20; ++I) {
+    Sources.push_back(Coord3D{(I * 5) % 32, (I * 11) % 32, 0});
+  }
+  const auto Fields = ComputeDistanceFields(Sources, MAX_SIZE, Map);
+  ASSERT_EQ(Fields.size(), Sources.size());
+  for (size_t I = 0; I < Sources.size(); ++I) {
+    const auto Expected = ComputeDistanceField(Sources[I], MAX_SIZE, Map);
+    EXPECT_EQ(Fields[I].GetSource(), Sources[I]);
+    for (Dim Y = 0; Y < 32; ++Y) {
+      for (Dim X = 0; X < 32; ++X) {
+        EXPECT_EQ(Fields[I].GetCost(Coord3D{X, Y, 0}), Expected.GetCost(Coord3D{X, Y, 0}));
+      }
+    }
+  }
+}
+
+TEST_F(TestPath, DeltaStepping) {
+  auto Map = MakeMap(48, 48);
+  for (Dim Y = 0; Y < 48; ++Y) {
+    for (Dim X = 0; X < 48; ++X) {
+      if ((X * 7 + Y * 13) % 5 < 2) {
+        Map.SetTerrain(Coord3D{X, Y, 0}, 1);
+      }
+    }
+  }
+  for (Dim Y = 0; Y < 40; ++Y) {
+    Map.SetSquad(Coord3D{24, Y, 0}, Id<Squad>{Y});
+  }
+  const auto &Nav = Map.GetNavigation();
+  const auto Costs = Nav.GetCosts(kBaseMovement);
+  const auto Start = Nav.ToIndex(Coord3D{3, 5, 0});
+
+  // Any delta and any number of threads give the costs of the serial search.
+  Utils::ThreadPool Pool{4};
+  auto &Scratch = GetSearchScratch();
+  for (const bool IsReverse : {false, true}) {
+    for (const Size Budget : {Size{30}, MAX_SIZE}) {
+      RunDijkstra(Nav, Costs, Scratch, Start, Budget, IsReverse, [](size_t) { return true; });
+      for (const Size Delta : {Size{0}, Size{1}, Size{6}, Size{500}}) {
+        DeltaStepping Search{Pool, Delta};
+        Search.Run(Nav, Costs, Start, Budget, IsReverse);
+        for (size_t Tile = 0; Tile < Nav.GetNumTiles(); ++Tile) {
+          ASSERT_EQ(Search.GetDistance(Tile), Scratch.GetDistance(Tile)) << Tile;
+        }
+      }
+    }
+  }
+
+  const Coord3D From{3, 5, 0}, To{40, 44, 0};
+  const auto Field = ComputeDistanceField(From, MAX_SIZE, Map, kBaseMovement,
+                                          FieldAlgorithm::DeltaStepping);
+  const auto Expected = ComputeDistanceField(From, MAX_SIZE, Map);
+  ASSERT_EQ(Field.GetCost(To), Expected.GetCost(To));
+  auto P = Field.BuildPath(To);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.front().Coord, From);
+  for (size_t I = 1; I < P->Waypoints.size(); ++I) {
+    const auto &Prev = P->Waypoints[I - 1], &Next = P->Waypoints[I];
+    EXPECT_TRUE(IsValidStep(Prev.Coord, Next.Coord, Map));
+    EXPECT_EQ(Next.Cost,
+              Prev.Cost + Nav.GetStepCost(Nav.ToIndex(Prev.Coord), Nav.ToIndex(Next.Coord)));
+  }
+}
+
+TEST_F(TestPath, SplitByDays) {
+  auto Map = MakeMap(10, 1);
+  Map.SetTerrain(Coord3D{3, 0, 0}, 1);
+  auto P = TryBuildPath(Coord3D{0, 0, 0}, Coord3D{8, 0, 0}, Map);
+  ASSERT_TRUE(P);
+  ASSERT_EQ(P->Waypoints.size(), 9);
+
+  // Costs: 1 1 4 1 1 1 1 1. The forest step starts with 1 point left and still succeeds.
+  SplitPathByDays(*P, 3, 3);
+  const Size ExpectedDays[] = {0, 0, 0, 0, 1, 1, 1, 2, 2};
+  for (size_t I = 0; I < P->Waypoints.size(); ++I) {
+    EXPECT_EQ(P->Waypoints[I].DayIndex, ExpectedDays[I]) << I;
+  }
+
+  SplitPathByDays(*P, 0, 0);
+  EXPECT_EQ(P->Waypoints[0].DayIndex, 0);
+  EXPECT_EQ(P->Waypoints[1].DayIndex, MAX_SIZE);
+}
+
+TEST_F(TestPath, IncrementalRepair) {
+  auto Map = MakeMap(48, 48);
+  for (Dim Y = 0; Y < 48; ++Y) {
+    for (Dim X = 0; X < 48; ++X) {
+      if ((X * 3 + Y * 7) % 11 == 0) {
+        Map.SetTerrain(Coord3D{X, Y, 0}, 1);
+      }
+    }
+  }
+  const Coord3D From{2, 3, 0}, To{45, 40, 0};
+  Map.SetSquad(From, Id<Squad>{0});
+
+  auto ExpectSameCost = [&](const std::optional<Path> &P) {
+    auto Expected = TryBuildPath(P ? P->Start : From, To, Map);
+    ASSERT_EQ(P.has_value(), Expected.has_value());
+    if (P) {
+      EXPECT_EQ(P->Waypoints.back().Coord, To);
+      EXPECT_EQ(P->Waypoints.back().Cost, Expected->Waypoints.back().Cost);
+    }
+  };
+
+  IncrementalPath Route{Map, From, To};
+  auto P = Route.Update();
+  ExpectSameCost(P);
+  const auto InitialExpanded = Route.GetNumExpanded();
+
+  // Another squad steps onto the route.
+  const auto Blocked = P->Waypoints[P->Waypoints.size() / 2].Coord;
+  Map.SetSquad(Blocked, Id<Squad>{1});
+  P = Route.Update();
+  ExpectSameCost(P);
+  EXPECT_TRUE(std::ranges::none_of(P->Waypoints,
+                                   [&](const Waypoint &W) { return W.Coord == Blocked; }));
+  EXPECT_LT(Route.GetNumExpanded() - InitialExpanded, InitialExpanded / 2);
+
+  // The squad walks a few steps and the blocker leaves.
+  const auto NewStart = P->Waypoints[5].Coord;
+  Map.SetSquad(From, NullId);
+  Map.SetSquad(NewStart, Id<Squad>{0});
+  Map.SetSquad(Blocked, NullId);
+  Route.SetStart(NewStart);
+  P = Route.Update();
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Start, NewStart);
+  ExpectSameCost(P);
+
+  // Many repairs in a row, the outdated heap entries are pruned on the way.
+  for (size_t I = 0; I < 200; ++I) {
+    const auto Tile = P->Waypoints[1 + I % (P->Waypoints.size() - 2)].Coord;
+    Map.SetSquad(Tile, Id<Squad>{1});
+    ExpectSameCost(Route.Update());
+    Map.SetSquad(Tile, NullId);
+    P = Route.Update();
+    ExpectSameCost(P);
+  }
+
+  // Walled off.
+  for (Dim Y = 0; Y < 48; ++Y) {
+    Map.SetSquad(Coord3D{30, Y, 0}, Id<Squad>{2 + Y});
+  }
+  EXPECT_FALSE(Route.Update());
+}
+
+TEST_F(TestPath, IncrementalRepairUpperLayer) {
+  GlobalMap Map{2, 16, 16};
+  for (Dim Z = 0; Z < 2; ++Z) {
+    for (Dim Y = 0; Y < 16; ++Y) {
+      for (Dim X = 0; X < 16; ++X) {
+        Map.SetTerrain(Coord3D{X, Y, Z}, 0);
+      }
+    }
+  }
+  Map.BuildNavigation(Terrains_);
+
+  // The search state covers the target's layer only.
+  const Coord3D From{1, 1, 1}, To{14, 12, 1};
+  IncrementalPath Route{Map, From, To};
+  auto P = Route.Update();
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, TryBuildPath(From, To, Map)->Waypoints.back().Cost);
+
+  const auto Blocked = P->Waypoints[P->Waypoints.size() / 2].Coord;
+  Map.SetSquad(Blocked, Id<Squad>{1});
+  P = Route.Update();
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, TryBuildPath(From, To, Map)->Waypoints.back().Cost);
+  EXPECT_TRUE(std::ranges::none_of(P->Waypoints,
+                                   [&](const Waypoint &W) { return W.Coord == Blocked; }));
+}
+
+TEST_F(TestPath, IncrementalRepairMemory) {
+  auto Map = MakeMap(512, 512);
+  const Coord3D From{10, 10, 0}, To{60, 40, 0};
+  IncrementalPath Route{Map, From, To};
+  auto P = Route.Update();
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, TryBuildPath(From, To, Map)->Waypoints.back().Cost);
+
+  // Only the blocks around the route are allocated, a dense state takes 12 bytes per tile.
+  EXPECT_LT(Route.GetMemoryUsage(), Map.GetNavigation().GetPlaneSize() * 12 / 20);
+}
+
+TEST_F(TestPath, Portals) {
+  GlobalMap Map{2, 8, 8};
+  for (Dim Z = 0; Z < 2; ++Z) {
+    for (Dim Y = 0; Y < 8; ++Y) {
+      for (Dim X = 0; X < 8; ++X) {
+        Map.SetTerrain(Coord3D{X, Y, Z}, 0);
+      }
+    }
+  }
+  Map.BuildNavigation(Terrains_);
+
+  MapObject Stairs{Named{"stairs", "Stairs", "stairs"}, MapObject::Portal, Coord3D{3, 3, 0},
+                   Dims2D{1, 1}, std::nullopt, true, false};
+  Stairs.SetPortalExit(Coord3D{6, 6, 1});
+  ASSERT_TRUE(Map.AddObject("stairs", std::move(Stairs)).IsSuccess());
+
+  MapObject Broken{Named{"broken", "Broken", "broken"}, MapObject::Portal, Coord3D{5, 5, 0},
+                   Dims2D{1, 1}, std::nullopt, true, false};
+  EXPECT_FALSE(Map.AddObject("broken", std::move(Broken)).IsSuccess());
+
+  // Same layer: the portal tile is passable, but never taken as a shortcut.
+  auto P = TryBuildPath(Coord3D{0, 0, 0}, Coord3D{7, 0, 0}, Map);
+  ASSERT_TRUE(P);
+  EXPECT_EQ(P->Waypoints.back().Cost, 7);
+
+  P = TryBuildPath(Coord3D{0, 0, 0}, Coord3D{7, 7, 1}, Map);
+  ASSERT_TRUE(P);
+  // 3 steps to the stairs, the jump and one step on the lower layer.
+  ASSERT_EQ(P->Waypoints.size(), 6);
+  EXPECT_EQ(P->Waypoints[3].Coord, (Coord3D{3, 3, 0}));
+  EXPECT_EQ(P->Waypoints[4].Coord, (Coord3D{6, 6, 1}));
+  EXPECT_EQ(P->Waypoints.back().Cost, 5);
+  for (size_t I = 1; I < P->Waypoints.size(); ++I) {
+    EXPECT_TRUE(IsValidStep(P->Waypoints[I - 1].Coord, P->Waypoints[I].Coord, Map));
+  }
+
+  // One-way.
+  EXPECT_FALSE(TryBuildPath(Coord3D{7, 7, 1}, Coord3D{0, 0, 0}, Map));
+  EXPECT_TRUE(MayBeReachable(Coord3D{0, 0, 0}, Coord3D{7, 7, 1}, Map));
+  EXPECT_FALSE(MayBeReachable(Coord3D{7, 7, 1}, Coord3D{0, 0, 0}, Map));
+}
+
+TEST_F(TestPath, PortalsAwayFromTarget) {
+  GlobalMap Map{2, 8, 8};
+  for (Dim Z = 0; Z < 2; ++Z) {
+    for (Dim Y = 0; Y < 8; ++Y) {
+      for (Dim X = 0; X < 8; ++X) {
+        Map.SetTerrain(Coord3D{X, Y, Z}, 0);
+      }
+    }
+  }
+  Map.BuildNavigation(Terrains_);
+  MapObject Stairs{Named{"stairs", "Stairs", "stairs"}, MapObject::Portal, Coord3D{1, 1, 0},
+                   Dims2D{1, 1}, std::nullopt, true, false};
+  Stairs.SetPortalExit(Coord3D{6, 6, 1});
+  ASSERT_TRUE(Map.AddObject("stairs", std::move(Stairs)).IsSuccess());
+  // Squads cut the upper layer in two, the stairs only lead away from it.
+  for (Dim Y = 0; Y < 8; ++Y) {
+    Map.SetSquad(Coord3D{4, Y, 0}, Id<Squad>{Y});
+  }
+
+  SearchStats Stats;
+  EXPECT_FALSE(TryBuildPath(Coord3D{0, 0, 0}, Coord3D{7, 0, 0}, Map, kBaseMovement, &Stats));
+  // The lower layer is never searched.
+  EXPECT_LE(Stats.NodesExpanded, 4 * 8);
+}
@@ -0,0 +1,314 @@
+#include "entities/components.h"
+#include "entities/global_map.h"
+#include "entities/visibility.h"
+
+#include <benchmark/benchmark.h>
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+using namespace NotAGame;
+
+namespace {
+
+// Neighbourhood scans over the tiles of a map for every layout. Pathfinding itself reads the
+// navigation grid, these are the map-side loops: adjacency checks, visibility and propagation.
+
+struct BenchMap {
+  BenchMap(Size Width, TileLayout Layout) noexcept : Width{Width}, Map{1, Width, Width, Layout} {
+    std::mt19937 Random{Width};
+    for (Dim Y = 0; Y < Width; ++Y) {
+      for (Dim X = 0; X < Width; ++X) {
+        const Coord3D Coord{X, Y, 0};
+        // Water on a tenth of the map stops the propagation.
+        Map.SetTerrain(Coord, Random() % 10 == 0 ? 1 : 0);
+        if (Random() % 16 == 0) {
+          Map.SetSquad(Coord, Id<Squad>{static_cast<Size>(X + Y)});
+        }
+      }
+    }
+  }
+
+  Size Width;
+  GlobalMap Map;
+};
+
+// Generating the biggest maps takes a while, the last one is kept for the next benchmark.
+BenchMap &GetMap(const benchmark::State &State) noexcept {
+  static std::unique_ptr<BenchMap> Cached;
+  const auto Width = static_cast<Size>(State.range(0));
+  const auto Layout = static_cast<TileLayout>(State.range(1));
+  if (!Cached || Cached->Width != Width || Cached->Map.GetLayout() != Layout) {
+    Cached.reset();
+    Cached = std::make_unique<BenchMap>(Width, Layout);
+  }
+  return *Cached;
+}
+
+void MapArguments(benchmark::internal::Benchmark *B) {
+  B->ArgNames({"size", "layout"});
+  for (const int64_t Width : {256, 1024, 2048}) {
+    for (const auto Layout : {TileLayout::RowMajor, TileLayout::Chunked, TileLayout::Morton,
+                              TileLayout::PowerOfTwo}) {
+      B->Args({Width, static_cast<int64_t>(Layout)});
+    }
+  }
+}
+
+} // namespace
+
+// Squads next to every tile, in the order the tiles are stored.
+static void BM_NeighbourScan(benchmark::State &State) {
+  const auto &Map = GetMap(State).Map;
+  const auto NumTiles = Map.GetTerrainIds(0).size();
+  for (auto _ : State) {
+    size_t NumAdjacent = 0;
+    for (size_t Index = 0; Index < NumTiles; ++Index) {
+      const auto Coord = Map.IndexToCoord3D(Index);
+      if (!Map.IsValid(Coord)) {
+        continue;
+      }
+      for (const auto Neighbour : GetPlaneNeighboors(Coord)) {
+        NumAdjacent += Map.IsValid(Neighbour) && Map.GetTile(Neighbour).Squad_.IsValid();
+      }
+    }
+    benchmark::DoNotOptimize(NumAdjacent);
+  }
+  State.SetItemsProcessed(State.iterations() * Map.GetWidth() * Map.GetHeight());
+}
+BENCHMARK(BM_NeighbourScan)->Apply(MapArguments);
+
+// Visibility squares of radius 8 around random origins.
+static void BM_VisibilityRadius(benchmark::State &State) {
+  constexpr Dim kRadius = 8;
+  constexpr size_t kNumOrigins = 1024;
+  auto &Map = GetMap(State).Map;
+  std::mt19937 Random{42};
+  std::vector<Coord3D> Origins;
+  for (size_t I = 0; I < kNumOrigins; ++I) {
+    Origins.push_back(
+        Coord3D{static_cast<Dim>(Random() % Map.GetWidth()),
+                static_cast<Dim>(Random() % Map.GetHeight()), 0});
+  }
+
+  for (auto _ : State) {
+    for (const auto Origin : Origins) {
+      const Dim MinX = Origin.X - std::min(Origin.X, kRadius);
+      const Dim MinY = Origin.Y - std::min(Origin.Y, kRadius);
+      const Dim MaxX = std::min(Origin.X + kRadius, Map.GetWidth() - 1);
+      const Dim MaxY = std::min(Origin.Y + kRadius, Map.GetHeight() - 1);
+      for (Dim Y = MinY; Y <= MaxY; ++Y) {
+        for (Dim X = MinX; X <= MaxX; ++X) {
+          Map.GetTile(Coord3D{X, Y, 0}).VisibilityFlags ^= 2;
+        }
+      }
+    }
+    benchmark::ClobberMemory();
+  }
+  State.SetItemsProcessed(State.iterations() * kNumOrigins);
+}
+BENCHMARK(BM_VisibilityRadius)->Apply(MapArguments);
+
+// Breadth-first flood over the land from the center of the map, as the land propagation.
+static void BM_FloodFill(benchmark::State &State) {
+  const auto &Map = GetMap(State).Map;
+  const auto NumTiles = Map.GetTerrainIds(0).size();
+  std::vector<bool> IsVisited(NumTiles);
+  std::deque<Coord3D> Frontier;
+  for (auto _ : State) {
+    std::fill(IsVisited.begin(), IsVisited.end(), false);
+    const Coord3D Center{Map.GetWidth() / 2, Map.GetHeight() / 2, 0};
+    Frontier.push_back(Center);
+    IsVisited[Map.Coord3DToIndex(Center)] = true;
+    size_t NumReached = 0;
+    while (!Frontier.empty()) {
+      const auto Coord = Frontier.front();
+      Frontier.pop_front();
+      ++NumReached;
+      for (const auto Neighbour : GetPlaneNeighboors(Coord)) {
+        if (!Map.IsValid(Neighbour)) {
+          continue;
+        }
+        const auto Index = Map.Coord3DToIndex(Neighbour);
+        if (!IsVisited[Index] && Map.GetTile(Neighbour).Terrain_ == 0) {
+          IsVisited[Index] = true;
+          Frontier.push_back(Neighbour);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(NumReached);
+  }
+  State.SetItemsProcessed(State.iterations() * Map.GetWidth() * Map.GetHeight());
+}
+BENCHMARK(BM_FloodFill)->Apply(MapArguments);
+
+// Every one of 16 players reveals a radius 10 square and hides it again, keeping the diffs.
+static void BM_RevealRadius(benchmark::State &State) {
+  constexpr Dim kRadius = 10;
+  constexpr size_t kNumOrigins = 64;
+  const auto Width = static_cast<Size>(State.range(0));
+  std::vector<VisibilityMap> Players(kMaxPlayers, VisibilityMap{Dims3D{Width, Width, 1}});
+  std::mt19937 Random{42};
+  std::vector<Coord> Origins;
+  for (size_t I = 0; I < kNumOrigins; ++I) {
+    Origins.push_back(Coord{static_cast<Dim>(Random() % (Width - 2 * kRadius)),
+                            static_cast<Dim>(Random() % (Width - 2 * kRadius))});
+  }
+
+  VisibilityDiff Diff;
+  for (auto _ : State) {
+    for (const auto Origin : Origins) {
+      for (auto &Player : Players) {
+        Diff.clear();
+        Player.SetRegionAndDiff(Diff, 0, Origin.X, Origin.Y, 2 * kRadius + 1, 2 * kRadius + 1,
+                                true);
+        Player.SetRegionAndDiff(Diff, 0, Origin.X, Origin.Y, 2 * kRadius + 1, 2 * kRadius + 1,
+                                false);
+        benchmark::DoNotOptimize(Diff.data());
+      }
+    }
+  }
+  State.SetItemsProcessed(State.iterations() * kNumOrigins * kMaxPlayers);
+}
+BENCHMARK(BM_RevealRadius)->ArgName("size")->Arg(1024)->Arg(4096);
+
+// Scouts of radius 10 walking a step at a time, the cost should not depend on the map size.
+static void BM_MoveObserver(benchmark::State &State) {
+  constexpr Dim kRadius = 10;
+  constexpr size_t kNumScouts = 64;
+  const auto Width = static_cast<Size>(State.range(0));
+  ObservedVisibility Visibility{Dims3D{Width, Width, 1}};
+  std::mt19937 Random{42};
+  std::vector<VisibilityArea> Scouts;
+  VisibilityDiff Diff;
+  for (size_t I = 0; I < kNumScouts; ++I) {
+    Scouts.push_back(VisibilityArea::FromRegion(
+        VisibilityRegion{0, static_cast<Dim>(Random() % (Width - 4 * kRadius)),
+                         static_cast<Dim>(Random() % (Width - 2 * kRadius)), 2 * kRadius + 1,
+                         2 * kRadius + 1}));
+    Visibility.AddObserver(Diff, Scouts.back());
+  }
+
+  // Back and forth over the same tiles.
+  bool IsRight = true;
+  for (auto _ : State) {
+    for (auto &Scout : Scouts) {
+      Diff.clear();
+      auto To = Scout;
+      for (auto &Span : To.Spans) {
+        Span.X0 = IsRight ? Span.X0 + 1 : Span.X0 - 1;
+        Span.X1 = IsRight ? Span.X1 + 1 : Span.X1 - 1;
+      }
+      Visibility.MoveObserver(Diff, Scout, To);
+      Scout = std::move(To);
+      benchmark::DoNotOptimize(Diff.data());
+    }
+    IsRight = !IsRight;
+  }
+  State.SetItemsProcessed(State.iterations() * kNumScouts);
+}
+BENCHMARK(BM_MoveObserver)->ArgName("size")->Arg(1024)->Arg(4096);
+
+// 16 players with 16 ranges of radius 10 each, every range walking a step at a time on a map
+// with an eighth of the tiles opaque. Shapes: 0 rectangle, 1 circle, 2 line of sight.
+static void BM_VisibilityModes(benchmark::State &State) {
+  constexpr Size kRadius = 10;
+  constexpr size_t kRangesPerPlayer = 16;
+  const auto Mode = static_cast<VisibilityMode>(State.range(0));
+  const auto Width = static_cast<Size>(State.range(1));
+  VisibilitySystem Visibility{kMaxPlayers, Dims3D{Width, Width, 1}};
+  std::mt19937 Random{42};
+  for (Dim Y = 0; Y < Width; ++Y) {
+    for (Dim X = 0; X < Width; ++X) {
+      if (Random() % 8 == 0) {
+        Visibility.SetOpaqueRegion(0, X, Y, 1, 1, true);
+      }
+    }
+  }
+  std::vector<Id<VisibilityRange>> Ranges;
+  for (Size Player = 0; Player < kMaxPlayers; ++Player) {
+    for (size_t I = 0; I < kRangesPerPlayer; ++I) {
+      const Coord3D Origin{static_cast<Dim>(Random() % (Width - 4 * kRadius) + kRadius),
+                           static_cast<Dim>(Random() % (Width - 2 * kRadius) + kRadius), 0};
+      Ranges.push_back(Visibility
+                           .AddComponent(VisibilityRange{.Player = Player,
+                                                         .Origin = Origin,
+                                                         .OriginSize = Dims2D{1, 1},
+                                                         .Radius = kRadius,
+                                                         .Mode = Mode})
+                           .ComponentId);
+    }
+  }
+
+  bool IsRight = true;
+  for (auto _ : State) {
+    for (const auto Range : Ranges) {
+      auto Origin = Visibility.GetComponent(Range).Origin;
+      Origin.X = IsRight ? Origin.X + 1 : Origin.X - 1;
+      const auto Diff = Visibility.MoveComponent(Range, Origin);
+      benchmark::DoNotOptimize(Diff.data());
+    }
+    IsRight = !IsRight;
+  }
+  State.SetItemsProcessed(State.iterations() * Ranges.size());
+}
+BENCHMARK(BM_VisibilityModes)
+    ->ArgNames({"mode", "size"})
+    ->ArgsProduct({{0, 1, 2}, {1024, 4096}});
+
+// A player of a team of 4 out of 16 players leaving and joining it again: the team is rebuilt
+// from its 3 other players, then the player is merged back in.
+static void BM_ChangeTeam(benchmark::State &State) {
+  const auto Width = static_cast<Size>(State.range(0));
+  VisibilitySystem Visibility{kMaxPlayers, Dims3D{Width, Width, 1}};
+  for (Size Player = 0; Player < kMaxPlayers; ++Player) {
+    Visibility.SetTeam(Player, Player / 4);
+    Visibility.SetRegionVisibility(Player, 0, Player * 16, 0, Width / 2, Width, true);
+  }
+  for (auto _ : State) {
+    Visibility.SetTeam(1, 4);
+    Visibility.SetTeam(1, 0);
+    benchmark::DoNotOptimize(Visibility.GetTeamVisibility(0).GetRow(0, 0).data());
+  }
+  State.SetItemsProcessed(State.iterations() * Width * Width);
+}
+BENCHMARK(BM_ChangeTeam)->ArgName("size")->Arg(1024)->Arg(4096);
+
+// A round of turns of 16 players with a source each, claiming 16 tiles a turn. The cost of a
+// turn should not depend on the map size. The land is given back every 256 rounds.
+static void BM_LandPropagation(benchmark::State &State) {
+  constexpr size_t kRoundsPerGame = 256;
+  const auto Width = static_cast<Size>(State.range(0));
+  GlobalMap Map{1, Width, Width};
+  std::optional<LandPropagationSystem> Propagation;
+  auto StartGame = [&] {
+    std::fill_n(Map.GetOwners(0).begin(), Map.GetOwners(0).size(), Id<Player>{});
+    Propagation.emplace(kMaxPlayers);
+    std::mt19937 Random{42};
+    for (Size Player = 0; Player < kMaxPlayers; ++Player) {
+      Propagation->AddComponentAndPropagate(
+          Map, LandPropagation{.Player = Player,
+                               .TilesPerTurn = 16,
+                               .Origin = Coord3D{static_cast<Dim>(Random() % (Width - 1)),
+                                                 static_cast<Dim>(Random() % (Width - 1)), 0},
+                               .OriginSize = Dims2D{2, 2}});
+    }
+  };
+
+  size_t NumRounds = 0, NumGained = 0;
+  for (auto _ : State) {
+    if (NumRounds++ % kRoundsPerGame == 0) {
+      State.PauseTiming();
+      StartGame();
+      State.ResumeTiming();
+    }
+    for (Size Player = 0; Player < kMaxPlayers; ++Player) {
+      NumGained += Propagation->Propagate(Map, Player).size();
+    }
+  }
+  State.SetItemsProcessed(NumGained);
+}
+BENCHMARK(BM_LandPropagation)->ArgName("size")->Arg(1024)->Arg(4096);
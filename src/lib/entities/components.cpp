@@ -0,0 +1,118 @@
+#include "entities/components.h"
+
+#include "entities/global_map.h"
+
+#include <algorithm>
+
+namespace NotAGame {
+
+PropagationResult LandPropagationSystem::Propagate(GlobalMap &Map,
+                                                   const LandPropagation &Component) noexcept {
+  const auto &Nav = Map.GetNavigation();
+  auto &Reached = Reached_[Component.Player];
+  if (Reached.empty()) {
+    Reached.resize(Nav.GetNumTiles());
+    for (size_t Index = 0; Index < Reached.size(); ++Index) {
+      Reached[Index] = !Map.IsValid(Nav.ToCoord(Index));
+    }
+  }
+  Frontiers_.resize(std::max<size_t>(Frontiers_.size(), Component.ComponentId + 1));
+  auto &Frontier = Frontiers_[Component.ComponentId];
+  Frontier.clear();
+
+  PropagationResult Result{.ComponentId = Component.ComponentId,
+                           .PlayerId = Component.Player,
+                           .Layer = Component.Origin.Layer,
+                           .Tiles = {}};
+  const auto Origin = Component.Origin;
+  for (Dim Y = Origin.Y; Y < Origin.Y + Component.OriginSize.Height; ++Y) {
+    for (Dim X = Origin.X; X < Origin.X + Component.OriginSize.Width; ++X) {
+      const Coord3D Position{X, Y, Origin.Layer};
+      auto Tile = Map.GetTile(Position);
+      if (Tile.Owner_ != Component.Player) {
+        Tile.Owner_ = Component.Player;
+        Result.Tiles.push_back(Coord{X, Y});
+      }
+      const auto Index = Nav.ToIndex(Position);
+      Reached[Index] = true;
+      Frontier.push_back(Index);
+    }
+  }
+  return Result;
+}
+
+PropagationResult LandPropagationSystem::ChangeOwner(GlobalMap &Map,
+                                                     Id<LandPropagation> ComponentId,
+                                                     PlayerId PlayerId) noexcept {
+  DropFrontier(ComponentId);
+  Parent::ChangeOwner(ComponentId, PlayerId);
+  auto &Component = GetComponent(ComponentId);
+  Component.Player = PlayerId;
+  return Propagate(Map, Component);
+}
+
+std::vector<Coord3D> LandPropagationSystem::Propagate(GlobalMap &Map, PlayerId Player) noexcept {
+  // Sources take turns in the order they were added, the same tiles go to the same ones.
+  const auto &Ids = GetComponentsByPlayer(Player);
+  SmallVector<Id<LandPropagation>, 32> Sources(Ids.begin(), Ids.end());
+  std::sort(Sources.begin(), Sources.end());
+
+  const auto &Nav = Map.GetNavigation();
+  std::vector<Coord3D> Gained;
+  for (const auto ComponentId : Sources) {
+    const auto &Component = GetComponent(ComponentId);
+    auto &Frontier = Frontiers_[ComponentId];
+    for (Size NumClaimed = 0; NumClaimed < Component.TilesPerTurn && !Frontier.empty();) {
+      const auto Index = Frontier.front();
+      Frontier.pop_front();
+      const auto Coord = Nav.ToCoord(Index);
+      auto Tile = Map.GetTile(Coord);
+      if (Tile.Owner_.IsValid() && Tile.Owner_ != Player) {
+        continue;
+      }
+      // Land of the player is walked through for free, every tile of it only once.
+      if (Tile.Owner_.IsInvalid()) {
+        Tile.Owner_ = Player;
+        Gained.push_back(Coord);
+        ++NumClaimed;
+      }
+      Nav.ForEachNeighbour(Index, [&](size_t Next) { Reach(Map, Player, Next, Frontier); });
+    }
+  }
+  return Gained;
+}
+
+void LandPropagationSystem::DropFrontier(Id<LandPropagation> ComponentId) noexcept {
+  const auto Player = GetComponent(ComponentId).Player;
+  auto Frontier = std::move(Frontiers_[ComponentId]);
+  Frontiers_[ComponentId] = {};
+
+  std::optional<Id<LandPropagation>> Heir;
+  for (const auto Other : GetComponentsByPlayer(Player)) {
+    if (Other != ComponentId && (!Heir || Other < *Heir)) {
+      Heir = Other;
+    }
+  }
+  if (!Heir) {
+    Reached_[Player] = {};
+    return;
+  }
+  auto &HeirFrontier = Frontiers_[*Heir];
+  HeirFrontier.insert(HeirFrontier.end(), Frontier.begin(), Frontier.end());
+}
+
+void LandPropagationSystem::Reach(const GlobalMap &Map, PlayerId Player, size_t Index,
+                                  std::deque<size_t> &Frontier) noexcept {
+  auto &&IsReached = Reached_[Player][Index];
+  if (IsReached) {
+    return;
+  }
+  IsReached = true;
+  const auto ObjectId = Map.GetTile(Map.GetNavigation().ToCoord(Index)).Object_;
+  if (ObjectId.IsValid() && Map.GetObject(ObjectId).IsLandPropagationBarrier()) {
+    return;
+  }
+  Frontier.push_back(Index);
+}
+
+} // namespace NotAGame
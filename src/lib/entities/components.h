@@ -4,10 +4,12 @@
 #include "entities/resource.h"
 #include "entities/squad.h"
 #include "entities/unit.h"
+#include "entities/visibility.h"
 #include "util/id.h"
 #include "util/paged_vector.h"
 #include "util/types.h"
 
+#include <deque>
 #include <optional>
 #include <ranges>
 #include <unordered_set>
@@ -17,6 +19,9 @@ namespace NotAGame {
 class Player;
 using PlayerId = Id<Player>;
 
+class Team;
+using TeamId = Id<Team>;
+
 class MapObject;
 using MapObjectId = Id<MapObject>;
 
@@ -70,6 +75,15 @@ public:
     return ComponentId.IsValid() ? &GetComponent(ComponentId) : nullptr;
   }
 
+  // Visits every live component, skipping the removed ones.
+  template <typename Fn> void ForEach(Fn &&Func) noexcept {
+    for (auto &Component : Components_) {
+      if (Component) {
+        Func(*Component);
+      }
+    }
+  }
+
 private:
   Utils::PagedVector<TurnableComponent, PageSize> Components_;
 };
@@ -117,24 +131,63 @@ private:
 };
 
 struct PropagationResult {
+  Id<LandPropagation> ComponentId;
   Id<Player> PlayerId;
   // Propagation is only done on single layer.
   Dim Layer;
   std::vector<Coord> Tiles;
 };
 
+// Land spreads from capitals, towns and rods: every source claims the tiles around it ring by
+// ring, TilesPerTurn of them per turn. The frontier of a source is kept from a turn to the next
+// and a tile enters the frontiers of a player once, so a turn only looks at the tiles it claims
+// and the few it finds taken, never at the rest of the map. Land of other players and barrier
+// objects stop the propagation.
 class LandPropagationSystem : public ByPlayerSystem<LandPropagation> {
 public:
   using Parent = ByPlayerSystem<LandPropagation>;
-  explicit LandPropagationSystem(Size PlayersCount) noexcept : Parent{PlayersCount} {}
+  explicit LandPropagationSystem(Size PlayersCount) noexcept : Parent{PlayersCount} {
+    Reached_.resize(PlayersCount);
+  }
+
   PropagationResult AddComponentAndPropagate(GlobalMap &Map,
                                              const LandPropagation &Component) noexcept {
-    Parent::AddComponent(Component);
-    return Propagate(Map, Component);
+    return Propagate(Map, Parent::AddComponent(Component));
   }
 
-  std::vector<Coord3D> Propagate(GlobalMap &Map, PlayerId Player) noexcept { return {}; } // FIXME
+  // The land already claimed stays with the player.
+  void RemoveComponent(Id<LandPropagation> ComponentId) noexcept {
+    DropFrontier(ComponentId);
+    Parent::RemoveComponent(ComponentId);
+  }
+
+  // A captured source claims its origin for the new owner and starts over from it.
+  PropagationResult ChangeOwner(GlobalMap &Map, Id<LandPropagation> ComponentId,
+                                PlayerId PlayerId) noexcept;
+
+  // A turn of the player, returns the tiles gained in the order they were claimed.
+  std::vector<Coord3D> Propagate(GlobalMap &Map, PlayerId Player) noexcept;
+  // Claims the origin of a new source and starts its frontier.
   PropagationResult Propagate(GlobalMap &Map, const LandPropagation &Component) noexcept;
+
+private:
+  // Sources need the map to start their frontier.
+  using Parent::AddComponent;
+
+  // Another source of the player takes over the frontier of the source. Without one, the player
+  // starts over from its next source, walking through its land again.
+  void DropFrontier(Id<LandPropagation> ComponentId) noexcept;
+
+  // Adds the tile to the frontier unless the player reached it before or it is a barrier.
+  void Reach(const GlobalMap &Map, PlayerId Player, size_t Index,
+             std::deque<size_t> &Frontier) noexcept;
+
+  // By component, navigation grid indices of the tiles reached and not expanded yet, the closest
+  // to the source first.
+  std::vector<std::deque<size_t>> Frontiers_;
+  // By player and navigation grid index, a flag per tile once it entered a frontier of the player.
+  // The border of the grid counts as reached, the neighbours of a tile need no bounds checks.
+  SmallVector<std::vector<bool>, kMaxPlayers> Reached_;
 };
 
 struct VisibilityRangeSettings {
@@ -148,38 +201,124 @@ struct VisibilityRange {
   Coord3D Origin;
   Dims2D OriginSize;
   Size Radius;
+  VisibilityMode Mode = VisibilityMode::Rectangle;
 };
 
+// Every range is an observer of its player, moving one only updates the tiles it stops or starts
+// seeing. Diffs returned are for the player of the range.
+//
+// Lines of sight are cast when a range is added or moved, and on a reset. Opaque tiles changing
+// do not update the ranges already looking at them.
+//
+// Every player is in a team, alone in its own by default. A team sees what any of its players
+// sees: the diffs of a player are merged into its team a word at a time, a tile hidden from the
+// player stays visible to the team while another member sees it.
 class VisibilitySystem : public ByPlayerSystem<VisibilityRange> {
 public:
   using Parent = ByPlayerSystem<VisibilityRange>;
-  using Visibility = std::vector<bool>;
-  using VisibilityDiff = std::vector<Coord3D>;
 
   VisibilitySystem(Size PlayersCount, Dims3D MapSize) noexcept
-      : Parent{PlayersCount}, MapSize_{MapSize} {
-    PlayerVisibilities_.resize(PlayersCount);
-    for (Size I = 0; I < PlayersCount; ++I) {
-      PlayerVisibilities_[I].resize(MapSize.Height * MapSize.Width * MapSize.LayersCount, false);
-      Reset(PlayerId{I});
+      : Parent{PlayersCount}, MapSize_{MapSize}, Opaque_{MapSize} {
+    PlayerVisibilities_.resize(PlayersCount, ObservedVisibility{MapSize});
+    TeamVisibilities_.resize(PlayersCount, VisibilityMap{MapSize});
+    for (Size Player = 0; Player < PlayersCount; ++Player) {
+      Teams_.push_back(TeamId{Player});
     }
   }
 
+  const VisibilityMap &GetVisibility(PlayerId Player) const noexcept {
+    return PlayerVisibilities_[Player].GetMap();
+  }
+  bool IsVisible(PlayerId Player, Coord3D Coord) const noexcept {
+    return GetVisibility(Player).IsVisible(Coord);
+  }
+
+  // Teams are numbered from 0 to the number of players.
+  const VisibilityMap &GetTeamVisibility(TeamId Team) const noexcept {
+    return TeamVisibilities_[Team];
+  }
+  bool IsVisibleByTeam(TeamId Team, Coord3D Coord) const noexcept {
+    return GetTeamVisibility(Team).IsVisible(Coord);
+  }
+
+  TeamId GetTeam(PlayerId Player) const noexcept { return Teams_[Player]; }
+
+  // Only the old team is rebuilt from its remaining players, the new one merges the player in.
+  void SetTeam(PlayerId Player, TeamId Team) noexcept {
+    const auto OldTeam = Teams_[Player];
+    if (OldTeam == Team) {
+      return;
+    }
+    Teams_[Player] = Team;
+    RebuildTeam(OldTeam);
+    TeamVisibilities_[Team].Merge(GetVisibility(Player));
+  }
+
+  // Tiles blocking the lines of sight: relief, forests, tall objects.
+  void SetOpaqueRegion(Dim Layer, Dim X, Dim Y, Dim Width, Dim Height, bool IsOpaque) noexcept {
+    Opaque_.SetRegion(Layer, X, Y, Width, Height, IsOpaque);
+  }
+
+  VisibilityRange &AddComponent(const VisibilityRange &Component) noexcept {
+    auto &NewComponent = Parent::AddComponent(Component);
+    Areas_.resize(std::max<size_t>(Areas_.size(), NewComponent.ComponentId + 1));
+    auto &Area = Areas_[NewComponent.ComponentId];
+    Area = ComputeArea(NewComponent);
+    VisibilityDiff Diff;
+    PlayerVisibilities_[NewComponent.Player].AddObserver(Diff, Area);
+    MergeIntoTeam(NewComponent.Player, Diff);
+    return NewComponent;
+  }
+
+  VisibilityDiff RemoveComponent(Id<VisibilityRange> ComponentId) noexcept {
+    VisibilityDiff Diff;
+    const auto &Component = GetComponent(ComponentId);
+    PlayerVisibilities_[Component.Player].RemoveObserver(Diff, Areas_[ComponentId]);
+    MergeIntoTeam(Component.Player, Diff);
+    Areas_[ComponentId] = {};
+    Parent::RemoveComponent(ComponentId);
+    return Diff;
+  }
+
+  void ChangeOwner(Id<VisibilityRange> ComponentId, PlayerId PlayerId) noexcept {
+    VisibilityDiff OldDiff, NewDiff;
+    auto &Component = GetComponent(ComponentId);
+    PlayerVisibilities_[Component.Player].RemoveObserver(OldDiff, Areas_[ComponentId]);
+    PlayerVisibilities_[PlayerId].AddObserver(NewDiff, Areas_[ComponentId]);
+    MergeIntoTeam(Component.Player, OldDiff);
+    MergeIntoTeam(PlayerId, NewDiff);
+    Parent::ChangeOwner(ComponentId, PlayerId);
+    Component.Player = PlayerId;
+  }
+
+  // Recounts the observers of the player from scratch, casting the lines of sight again.
   void Reset(PlayerId Player) noexcept {
+    VisibilityDiff Diff;
     auto &Visibility = PlayerVisibilities_[Player];
-    std::vector<Coord3D> Diff;
-
-    std::fill(Visibility.begin(), Visibility.end(), false);
+    Visibility.Clear();
     for (auto ComponentId : GetComponentsByPlayer(Player)) {
-      RenderVisibility(Diff, GetComponent(ComponentId));
+      auto &Area = Areas_[ComponentId];
+      Area = ComputeArea(GetComponent(ComponentId));
+      Visibility.AddObserver(Diff, Area);
     }
+    RebuildTeam(Teams_[Player]);
   }
 
-  void MoveComponent(Id<VisibilityRange> ComponentId, Coord3D Coord) noexcept {
+  // Touches the tiles of the old and new areas that are not in both.
+  VisibilityDiff MoveComponent(Id<VisibilityRange> ComponentId, Coord3D Coord) noexcept {
     VisibilityDiff Diff;
     auto &Component = GetComponent(ComponentId);
     Component.Origin = Coord;
-    RenderVisibility(Diff, Component);
+    auto To = ComputeArea(Component);
+    PlayerVisibilities_[Component.Player].MoveObserver(Diff, Areas_[ComponentId], To);
+    MergeIntoTeam(Component.Player, Diff);
+    Areas_[ComponentId] = std::move(To);
+    return Diff;
+  }
+
+  // The tiles seen by a range, as of its last update.
+  const VisibilityArea &GetArea(Id<VisibilityRange> ComponentId) const noexcept {
+    return Areas_[ComponentId];
   }
 
   VisibilityDiff HideRegion(PlayerId PlayerId, Dim Layer, Dim X, Dim Y, Dim Width,
@@ -192,46 +331,86 @@ public:
 
   void SetAndDiffRegionVisibility(VisibilityDiff &Diff, PlayerId PlayerId, Dim Layer, Dim X, Dim Y,
                                   Dim Width, Dim Height, bool NewValue) noexcept {
-    auto &Visibility = PlayerVisibilities_[PlayerId];
-    for (Size IW = X; IW < X + Width; ++IW) {
-      for (Size IH = Y; IH < Y + Height; ++IH) {
-        const Coord3D Coord{.X = IW, .Y = IH, .Layer = Layer};
-        const auto Offset = Linearize(Coord, MapSize_);
-        if (Visibility[Offset] != NewValue) {
-          Diff.push_back(Coord);
-          Visibility[Offset] = NewValue;
+    const size_t First = Diff.size();
+    PlayerVisibilities_[PlayerId].GetMap().SetRegionAndDiff(Diff, Layer, X, Y, Width, Height,
+                                                            NewValue);
+    MergeIntoTeam(PlayerId, std::span{Diff}.subspan(First));
+  }
+
+  void SetRegionVisibility(PlayerId PlayerId, Dim Layer, Dim X, Dim Y, Dim Width, Dim Height,
+                           bool NewValue) noexcept {
+    VisibilityDiff Diff;
+    SetAndDiffRegionVisibility(Diff, PlayerId, Layer, X, Y, Width, Height, NewValue);
+  }
+
+private:
+  // Tiles seen by the player are seen by the team. The ones hidden from the player are hidden
+  // from the team unless another member sees them, only the words of the diff are looked at.
+  void MergeIntoTeam(PlayerId Player, std::span<const VisibilityChange> Diff) noexcept {
+    const auto Team = Teams_[Player];
+    SmallVector<const VisibilityMap *, kMaxPlayers> Others;
+    for (Size Member = 0; Member < Teams_.size(); ++Member) {
+      if (Teams_[Member] == Team && Member != Player) {
+        Others.push_back(&GetVisibility(Member));
+      }
+    }
+    auto &Visibility = TeamVisibilities_[Team];
+    for (const auto &Change : Diff) {
+      const Dim Word = Change.FirstX / VisibilityMap::kWordBits;
+      uint64_t Mask = Change.Mask;
+      if (!Change.IsVisible) {
+        for (const auto *Other : Others) {
+          Mask &= ~Other->GetRow(Change.Layer, Change.Y)[Word];
         }
       }
+      Visibility.UpdateWord(Change.Layer, Change.Y, Word, Mask, Change.IsVisible);
     }
   }
 
-  void SetRegionVisibility(PlayerId PlayerId, Dim Layer, Dim X, Dim Y, Dim Width, Dim Height,
-                           bool NewValue) noexcept {
-    auto &Visibility = PlayerVisibilities_[PlayerId];
-    for (Size IW = X; IW < X + Width; ++IW) {
-      for (Size IH = Y; IH < Y + Height; ++IH) {
-        const Coord3D Coord{.X = IW, .Y = IH, .Layer = Layer};
-        const auto Offset = Linearize(Coord, MapSize_);
-        Visibility[Offset] = NewValue;
+  // A word-wise OR of the maps of the players of the team.
+  void RebuildTeam(TeamId Team) noexcept {
+    auto &Visibility = TeamVisibilities_[Team];
+    Visibility.Clear();
+    for (Size Player = 0; Player < Teams_.size(); ++Player) {
+      if (Teams_[Player] == Team) {
+        Visibility.Merge(GetVisibility(Player));
       }
     }
   }
 
-private:
-  void RenderVisibility(VisibilityDiff &Diff, const VisibilityRange &Component) noexcept {
-    Size WidthFrom = std::min(Component.Origin.X, Component.Radius);
-    Size WidthTo = std::min(Component.Origin.X + Component.OriginSize.Width + Component.Radius,
-                            MapSize_.Width);
-    Size HeightFrom = std::min(Component.Origin.Y, Component.Radius);
-    Size HeightTo = std::min(Component.Origin.Y + Component.OriginSize.Height + Component.Radius,
-                             MapSize_.Height);
-    SetAndDiffRegionVisibility(Diff, Component.Player, Component.Origin.Layer,
-                               Component.Origin.X - WidthFrom, Component.Origin.Y - HeightFrom,
-                               WidthFrom + WidthTo, HeightFrom - HeightTo, true);
-  }
-
-  SmallVector<std::vector<bool>, kMaxPlayers> PlayerVisibilities_;
+  // The tiles seen by a range, clipped to the map.
+  VisibilityArea ComputeArea(const VisibilityRange &Component) noexcept {
+    switch (Component.Mode) {
+    case VisibilityMode::Rectangle:
+      break;
+    case VisibilityMode::Circle:
+      return MakeCircleArea(Component.Origin, Component.OriginSize,
+                            Stencils_.Get(Component.Radius), MapSize_);
+    case VisibilityMode::LineOfSight:
+      return CastLineOfSight(Component.Origin, Component.OriginSize,
+                             Stencils_.Get(Component.Radius), Opaque_);
+    }
+    const Dim MinX = Component.Origin.X - std::min(Component.Origin.X, Component.Radius);
+    const Dim MinY = Component.Origin.Y - std::min(Component.Origin.Y, Component.Radius);
+    const Dim MaxX = std::min(Component.Origin.X + Component.OriginSize.Width + Component.Radius,
+                              MapSize_.Width);
+    const Dim MaxY = std::min(Component.Origin.Y + Component.OriginSize.Height + Component.Radius,
+                              MapSize_.Height);
+    return VisibilityArea::FromRegion(
+        VisibilityRegion{Component.Origin.Layer, MinX, MinY, MaxX - MinX, MaxY - MinY});
+  }
+
+  SmallVector<ObservedVisibility, kMaxPlayers> PlayerVisibilities_;
+  // By team, the number of teams is the number of players, some may be empty.
+  SmallVector<VisibilityMap, kMaxPlayers> TeamVisibilities_;
+  // By player.
+  SmallVector<TeamId, kMaxPlayers> Teams_;
   Dims3D MapSize_;
+  // A bit per tile, set on the ones blocking the lines of sight.
+  VisibilityMap Opaque_;
+  CircleStencils Stencils_;
+  // By component, what every range sees.
+  std::vector<VisibilityArea> Areas_;
 };
 
 struct ResourceSource {
@@ -3,7 +3,12 @@
 #include "entities/common.h"
 #include "entities/inventory.h"
 #include "entities/map_components.h"
+#include "entities/movement.h"
+#include "entities/navigation.h"
+#include "entities/occupancy_table.h"
+#include "entities/spatial_index.h"
 #include "entities/squad.h"
+#include "entities/tile_layout.h"
 #include "status/status.h"
 #include "util/id.h"
 #include "util/registry.h"
@@ -14,6 +19,7 @@
 #include <memory>
 #include <optional>
 #include <span>
+#include <type_traits>
 #include <vector>
 
 namespace NotAGame {
@@ -28,10 +34,6 @@ struct LandPropagation;
 struct VisibilityRange;
 struct ResourceSource;
 
-enum class TerrainKind { Ground, Water, Relief };
-
-enum class GroundKind { Plain, Road, Forest };
-
 class MapObject;
 using MapObjectId = Id<MapObject>;
 using MapObjectPtr = std::unique_ptr<MapObject>;
@@ -49,6 +51,7 @@ public:
     Resource,
     Ruins,
     Squad,
+    Portal, // Stairs, tunnels: a squad stepping onto it moves to the exit on another layer.
     Other,
   };
 
@@ -67,6 +70,12 @@ public:
   Size GetWidth() const noexcept { return Size_.Width; }
   Size GetHeight() const noexcept { return Size_.Height; }
 
+  bool IsPassable() const noexcept { return IsPassable_; }
+  bool IsLandPropagationBarrier() const noexcept { return IsLandPropagationBarrier_; }
+
+  std::optional<Coord3D> GetPortalExit() const noexcept { return PortalExit_; }
+  void SetPortalExit(Coord3D Exit) noexcept { PortalExit_ = Exit; }
+
   std::optional<Coord> GetEntrancePos() const noexcept { return EntrancePos_; }
   std::optional<Coord3D> GetEntrancePosAbsolute() const noexcept {
     if (!EntrancePos_) {
@@ -96,6 +105,7 @@ protected:
   Coord3D Pos_;
   Dims2D Size_;
   std::optional<Coord> EntrancePos_;
+  std::optional<Coord3D> PortalExit_;
   bool IsPassable_;
   bool IsLandPropagationBarrier_;
   bool IsEnterable_;
@@ -103,30 +113,62 @@ protected:
 
 class Terrain : public Named {
 public:
-  Terrain(Named Name, Size BaseCost) noexcept : Named{std::move(Name)}, BaseCost_{BaseCost} {}
+  Terrain(Named Name, Size BaseCost, TerrainKind Kind = TerrainKind::Ground,
+          GroundKind Ground = GroundKind::Plain) noexcept
+      : Named{std::move(Name)}, BaseCost_{BaseCost}, Kind_{Kind}, Ground_{Ground} {}
   Size GetBaseCost() const noexcept { return BaseCost_; }
+  TerrainKind GetKind() const noexcept { return Kind_; }
+  GroundKind GetGroundKind() const noexcept { return Ground_; }
 
 private:
   Size BaseCost_;
+  TerrainKind Kind_;
+  GroundKind Ground_;
 };
 
-class Tile {
+// A tile of the map. GlobalMap stores every field in its own array, so a scan over one of them
+// streams only its bytes; a tile reference bundles the fields of one index.
+template <bool IsConst> class BasicTileRef {
+  template <typename T> using Field = std::conditional_t<IsConst, const T, T>;
+
 public:
-  explicit Tile(Id<Terrain> Terrain = NullId) noexcept : Terrain_{Terrain} {}
-  Id<Terrain> Terrain_;
-  Id<Player> Owner_;
-  // std::optional<Grave> Grave_;
-  Id<MapObject> Object_ = NullId;
-  Id<Squad> Squad_ = NullId;
-  // By default, all tiles are visible to the neutral player which has index 0.
-  uint16_t VisibilityFlags = 1;
+  BasicTileRef(Field<Id<Terrain>> &TerrainId, Field<Id<Player>> &OwnerId,
+               Field<Id<MapObject>> &ObjectId, Field<Id<Squad>> &SquadId,
+               Field<uint16_t> &Visibility) noexcept
+      : Terrain_{TerrainId}, Owner_{OwnerId}, Object_{ObjectId}, Squad_{SquadId},
+        VisibilityFlags{Visibility} {}
+
+  operator BasicTileRef<true>() const noexcept
+    requires(!IsConst)
+  {
+    return {Terrain_, Owner_, Object_, Squad_, VisibilityFlags};
+  }
+
+  Field<Id<Terrain>> &Terrain_;
+  Field<Id<Player>> &Owner_;
+  Field<Id<MapObject>> &Object_;
+  Field<Id<Squad>> &Squad_;
+  Field<uint16_t> &VisibilityFlags;
 };
 
+using TileRef = BasicTileRef<false>;
+using ConstTileRef = BasicTileRef<true>;
+
 class GlobalMap {
 public:
-  GlobalMap(Size Layers, Size Width, Size Height) noexcept
-      : Width_{Width}, Height_{Height}, Layers_{Layers} {
-    Tiles_.resize(Width * Height * Layers);
+  // The layout only changes how the tiles are stored, see TileLayout.
+  GlobalMap(Size Layers, Size Width, Size Height,
+            TileLayout Layout = TileLayout::RowMajor) noexcept
+      : Width_{Width}, Height_{Height}, Layers_{Layers}, Indexer_{GetSize(), Layout},
+        Navigation_{GetSize()}, Occupancy_{GetSize()}, SquadIndex_{GetSize()},
+        ObjectIndex_{GetSize()} {
+    const size_t NumTiles = Indexer_.GetNumTiles();
+    TerrainIds_.resize(NumTiles);
+    Owners_.resize(NumTiles);
+    ObjectIds_.resize(NumTiles);
+    SquadIds_.resize(NumTiles);
+    // By default, all tiles are visible to the neutral player which has index 0.
+    VisibilityFlags_.resize(NumTiles, 1);
     ObjectsByLayer_.resize(Layers);
   }
 
@@ -137,6 +179,7 @@ public:
   Dims3D GetSize() const noexcept {
     return Dims3D{.Width = Width_, .Height = Height_, .LayersCount = Layers_};
   }
+  TileLayout GetLayout() const noexcept { return Indexer_.GetLayout(); }
 
   ErrorOr<MapObjectId> AddObject(std::string Name, MapObject Object) noexcept {
     assert(Object.GetHeight() && Object.GetWidth());
@@ -151,53 +194,140 @@ public:
       return Status::Error(ErrorCode::MapError, "Object overlap is not allowed");
     }
 
+    const auto PortalExit = Object.GetPortalExit();
+    if (Object.GetKind() == MapObject::Kind::Portal && (!PortalExit || !IsValid(*PortalExit))) {
+      return Status::Error(ErrorCode::MapError, "Portal exit out of bounds");
+    }
+
     const bool IsCapital = Object.GetKind() == MapObject::Kind::Capital;
+    const bool IsBlocking = !Object.IsPassable();
+    const auto PortalEntry = Object.GetEntrancePosAbsolute().value_or(Object.GetPosition());
     auto Id = MapObjects_.AddObject(std::move(Name), std::move(Object));
     ObjectsByLayer_[Object.GetLayer()].push_back(Id);
+    ObjectIndex_.Insert(Id, Object.GetPosition(), Object.GetSize());
+    Occupancy_.Occupy(Object.GetLayer(), Coord{Object.GetX(), Object.GetY()}, Object.GetSize());
     for (Dim X = Object.GetX(); X < MaxX; ++X) {
       for (Dim Y = Object.GetY(); Y < MaxY; ++Y) {
-        GetTile(Object.GetLayer(), X, Y).Object_ = Id;
+        const Coord3D Coord{X, Y, Object.GetLayer()};
+        ObjectIds_[Coord3DToIndex(Coord)] = Id;
+        Navigation_.SetBlocked(Navigation_.ToIndex(Coord), IsBlocking);
       }
     }
+    if (PortalExit) {
+      Navigation_.AddPortal(Navigation_.ToIndex(PortalEntry), Navigation_.ToIndex(*PortalExit));
+    }
 
     return Id;
   }
 
-  bool CanPlaceObject(Dim Layer, Dim X, Dim Y, const MapObject &Object) const noexcept {
-    auto MaxX = X + Object.GetHeight();
-    auto MaxY = Y + Object.GetWidth();
-
-    for (Dim x = X; x < MaxX; ++x) {
-      for (Dim y = Y; y < MaxY; ++y) {
-        const auto &Tile = GetTile(Layer, x, y);
-        if (Tile.Object_.IsValid()) {
-          return false;
-        }
-      }
+  void SetTerrain(Coord3D Coord, Id<Terrain> TerrainId) noexcept {
+    TerrainIds_[Coord3DToIndex(Coord)] = TerrainId;
+    Navigation_.SetTerrain(Navigation_.ToIndex(Coord), TerrainId);
+  }
+
+  void SetSquad(Coord3D Coord, Id<Squad> SquadId) noexcept {
+    auto &Tile = SquadIds_[Coord3DToIndex(Coord)];
+    if (Tile.IsValid()) {
+      SquadIndex_.Remove(Tile, Coord);
+    }
+    if (SquadId.IsValid()) {
+      SquadIndex_.Insert(SquadId, Coord);
     }
-    return true;
+    Tile = SquadId;
+    Navigation_.SetOccupied(Navigation_.ToIndex(Coord), SquadId.IsValid());
   }
 
-  size_t Coord3DToIndex(Coord3D Coord) const noexcept {
-    return Width_ * Height_ * Coord.Layer + Coord.Y * Width_ + Coord.X;
+  // Same as clearing From and setting To, the index entry of the squad is moved in place.
+  void MoveSquad(Id<Squad> SquadId, Coord3D From, Coord3D To) noexcept {
+    auto &FromTile = SquadIds_[Coord3DToIndex(From)];
+    if (FromTile != SquadId) {
+      SetSquad(To, SquadId);
+      return;
+    }
+    FromTile = NullId;
+    Navigation_.SetOccupied(Navigation_.ToIndex(From), false);
+    if (auto &ToTile = SquadIds_[Coord3DToIndex(To)]; ToTile.IsValid()) {
+      SquadIndex_.Remove(ToTile, To);
+    }
+    SquadIndex_.Move(SquadId, From, To);
+    SquadIds_[Coord3DToIndex(To)] = SquadId;
+    Navigation_.SetOccupied(Navigation_.ToIndex(To), true);
   }
 
-  Coord3D IndexToCoord3D(size_t Index) const noexcept {
-    Size Layer = Index / (Width_ * Height_);
-    Size Y = (Index - Layer * Width_ * Height_) / Height_;
-    Size X = Index - Layer * Width_ * Height_ - Y * Width_;
-    return {X, Y, Layer};
+  // Squads on the map and map objects by position, kept up to date by SetSquad and AddObject.
+  const SpatialIndex<Squad> &GetSquadIndex() const noexcept { return SquadIndex_; }
+  const SpatialIndex<MapObject> &GetObjectIndex() const noexcept { return ObjectIndex_; }
+
+  // Should be called once the terrain is filled, later changes are patched incrementally.
+  template <size_t N> void BuildNavigation(const Utils::Registry<Terrain, N> &Terrains) noexcept {
+    std::vector<TerrainMovement> Movement;
+    Movement.reserve(Terrains.size());
+    for (const auto &Terrain : Terrains) {
+      Movement.push_back({Terrain.GetBaseCost(), Terrain.GetKind(), Terrain.GetGroundKind()});
+    }
+    Navigation_.Build(*this, std::move(Movement));
   }
 
+  const NavigationGrid &GetNavigation() const noexcept { return Navigation_; }
+
+  void SetLandmarks(MovementProfile Profile, std::unique_ptr<const LandmarkTable> Table) noexcept {
+    Navigation_.SetLandmarks(Profile, std::move(Table));
+  }
+
+  // False as well if the object would stick out of the map.
+  bool CanPlaceObject(Dim Layer, Dim X, Dim Y, const MapObject &Object) const noexcept {
+    return Occupancy_.IsFree(Layer, Coord{X, Y}, Object.GetSize());
+  }
+
+  // Top-left tiles where an object of that size can be placed, row by row.
+  std::vector<Coord> FindFreePositions(Dim Layer, Dims2D Extent) noexcept {
+    return Occupancy_.FindFreePositions(Layer, Extent);
+  }
+
+  size_t Coord3DToIndex(Coord3D Coord) const noexcept { return Indexer_.ToIndex(Coord); }
+  // Padding tiles of the blocked layouts are not IsValid.
+  Coord3D IndexToCoord3D(size_t Index) const noexcept { return Indexer_.ToCoord(Index); }
+
   bool IsValid(Coord3D Coord) const noexcept {
     return Coord.X < Width_ && Coord.Y < Height_ && Coord.Layer < Layers_;
   }
-  Tile &GetTile(Dim Layer, Dim X, Dim Y) noexcept { return GetTile(Coord3D{X, Y, Layer}); }
-  const Tile &GetTile(Dim Layer, Dim X, Dim Y) const noexcept {
+  TileRef GetTile(Dim Layer, Dim X, Dim Y) noexcept { return GetTile(Coord3D{X, Y, Layer}); }
+  ConstTileRef GetTile(Dim Layer, Dim X, Dim Y) const noexcept {
     return GetTile(Coord3D{X, Y, Layer});
   }
-  const Tile &GetTile(Coord3D Coord) const noexcept { return Tiles_[Coord3DToIndex(Coord)]; }
-  Tile &GetTile(Coord3D Coord) noexcept { return Tiles_[Coord3DToIndex(Coord)]; }
+  ConstTileRef GetTile(Coord3D Coord) const noexcept {
+    const auto Index = Coord3DToIndex(Coord);
+    return {TerrainIds_[Index], Owners_[Index], ObjectIds_[Index], SquadIds_[Index],
+            VisibilityFlags_[Index]};
+  }
+  TileRef GetTile(Coord3D Coord) noexcept {
+    const auto Index = Coord3DToIndex(Coord);
+    return {TerrainIds_[Index], Owners_[Index], ObjectIds_[Index], SquadIds_[Index],
+            VisibilityFlags_[Index]};
+  }
+
+  // One field of every tile of a layer in the order of the layout, padding included. The
+  // coordinates of the I-th element are IndexToCoord3D(GetFirstIndex(Layer) + I).
+  size_t GetFirstIndex(Dim Layer) const noexcept { return Indexer_.GetPlaneSize() * Layer; }
+  std::span<const Id<Terrain>> GetTerrainIds(Dim Layer) const noexcept {
+    return GetLayerSpan(TerrainIds_, Layer);
+  }
+  std::span<const Id<Player>> GetOwners(Dim Layer) const noexcept {
+    return GetLayerSpan(Owners_, Layer);
+  }
+  std::span<Id<Player>> GetOwners(Dim Layer) noexcept { return GetLayerSpan(Owners_, Layer); }
+  std::span<const Id<MapObject>> GetObjectIds(Dim Layer) const noexcept {
+    return GetLayerSpan(ObjectIds_, Layer);
+  }
+  std::span<const Id<Squad>> GetSquadIds(Dim Layer) const noexcept {
+    return GetLayerSpan(SquadIds_, Layer);
+  }
+  std::span<const uint16_t> GetVisibilityFlags(Dim Layer) const noexcept {
+    return GetLayerSpan(VisibilityFlags_, Layer);
+  }
+  std::span<uint16_t> GetVisibilityFlags(Dim Layer) noexcept {
+    return GetLayerSpan(VisibilityFlags_, Layer);
+  }
 
   auto GetObjects() noexcept { return MakeRange(MapObjects_.begin(), MapObjects_.end()); }
   auto GetObjects() const noexcept { return MakeRange(MapObjects_.begin(), MapObjects_.end()); }
@@ -233,10 +363,29 @@ public:
   }
 
 private:
+  template <typename T> std::span<T> GetLayerSpan(std::vector<T> &Column, Dim Layer) noexcept {
+    const size_t PlaneSize = Indexer_.GetPlaneSize();
+    return {Column.data() + PlaneSize * Layer, PlaneSize};
+  }
+  template <typename T>
+  std::span<const T> GetLayerSpan(const std::vector<T> &Column, Dim Layer) const noexcept {
+    const size_t PlaneSize = Indexer_.GetPlaneSize();
+    return {Column.data() + PlaneSize * Layer, PlaneSize};
+  }
+
   Size Width_;
   Size Height_;
   Size Layers_;
-  std::vector<Tile> Tiles_;
+  TileIndexer Indexer_;
+  std::vector<Id<Terrain>> TerrainIds_;
+  std::vector<Id<Player>> Owners_;
+  std::vector<Id<MapObject>> ObjectIds_;
+  std::vector<Id<Squad>> SquadIds_;
+  std::vector<uint16_t> VisibilityFlags_;
+  NavigationGrid Navigation_;
+  OccupancyTable Occupancy_;
+  SpatialIndex<Squad> SquadIndex_;
+  SpatialIndex<MapObject> ObjectIndex_;
 
   Utils::Registry<MapObject> MapObjects_;
   SmallVector<CapitalComponent, 8> Capitals_;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "util/types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace NotAGame {
+
+enum class TerrainKind { Ground, Water, Relief };
+
+enum class GroundKind { Plain, Road, Forest };
+
+// Leader perks changing the cost of terrain. A set of perks is a movement profile, leaders with
+// the same set share one cost grid.
+enum MovementPerk : uint8_t {
+  ForestWalker = 1 << 0, // Forests cost as much as plains.
+  RoadRunner = 1 << 1,   // Roads cost half as much.
+  Swimmer = 1 << 2,      // Water costs as much as plains.
+  Flying = 1 << 3,       // Every terrain costs as much as the cheapest one.
+};
+
+using MovementProfile = uint8_t;
+
+constexpr MovementProfile kBaseMovement = 0;
+constexpr size_t kNumMovementProfiles = 1 << 4;
+
+inline std::optional<MovementPerk> ParseMovementPerk(std::string_view Name) noexcept {
+  if (Name == "forest_walker") {
+    return ForestWalker;
+  }
+  if (Name == "road_runner") {
+    return RoadRunner;
+  }
+  if (Name == "swimmer") {
+    return Swimmer;
+  }
+  if (Name == "flying") {
+    return Flying;
+  }
+  return std::nullopt;
+}
+
+struct TerrainMovement {
+  Size BaseCost;
+  TerrainKind Kind;
+  GroundKind Ground;
+};
+
+// Cost of stepping onto the terrain for the profile. PlainCost and MinCost are the cheapest plain
+// and the cheapest terrain of the mod.
+inline Size GetTerrainCost(MovementProfile Profile, const TerrainMovement &Terrain,
+                           Size PlainCost, Size MinCost) noexcept {
+  if (Profile & Flying) {
+    return MinCost;
+  }
+  Size Cost = Terrain.BaseCost;
+  if (Terrain.Kind == TerrainKind::Ground) {
+    if ((Profile & ForestWalker) && Terrain.Ground == GroundKind::Forest) {
+      Cost = std::min(Cost, PlainCost);
+    }
+    if ((Profile & RoadRunner) && Terrain.Ground == GroundKind::Road) {
+      Cost = std::max<Size>((Cost + 1) / 2, 1);
+    }
+  }
+  if ((Profile & Swimmer) && Terrain.Kind == TerrainKind::Water) {
+    Cost = std::min(Cost, PlainCost);
+  }
+  return Cost;
+}
+
+} // namespace NotAGame
@@ -0,0 +1,323 @@
+#include "entities/navigation.h"
+
+#include "entities/global_map.h"
+
+#include <algorithm>
+
+namespace NotAGame {
+
+NavigationGrid::NavigationGrid(Dims3D Size) noexcept
+    : Size_{Size}, Stride_{size_t{Size.Width} + 2}, PlaneSize_{Stride_ * (Size.Height + 2)},
+      NeighbourOffsets_{MakeOffsets(kPlaneSteps, Stride_)} {
+  const size_t NumTiles = PlaneSize_ * Size.LayersCount;
+  TerrainIds_.resize(NumTiles, kNoTerrain);
+  Flags_.resize(NumTiles, Void);
+  HasPortal_.resize(NumTiles, false);
+  ComponentParent_.resize(NumTiles);
+  ComponentRank_.resize(NumTiles, 0);
+  for (size_t Index = 0; Index < NumTiles; ++Index) {
+    ComponentParent_[Index] = static_cast<uint32_t>(Index);
+  }
+
+  auto &Base = Profiles_[kBaseMovement];
+  Base = std::make_unique<ProfileGrid>();
+  Base->Costs.resize(NumTiles, MovementCosts::kImpassable);
+}
+
+void NavigationGrid::Build(const GlobalMap &Map, std::vector<TerrainMovement> Terrains) noexcept {
+  Terrains_ = std::move(Terrains);
+
+  for (Dim Z = 0, ZE = Size_.LayersCount; Z < ZE; ++Z) {
+    const auto TerrainIds = Map.GetTerrainIds(Z);
+    const auto ObjectIds = Map.GetObjectIds(Z);
+    const auto SquadIds = Map.GetSquadIds(Z);
+    const size_t First = Map.GetFirstIndex(Z);
+    for (size_t I = 0; I < TerrainIds.size(); ++I) {
+      const auto Coord = Map.IndexToCoord3D(First + I);
+      if (!Map.IsValid(Coord)) {
+        continue; // Padding of the layout.
+      }
+      const auto Index = ToIndex(Coord);
+      const auto ObjectId = ObjectIds[I];
+      Flags_[Index] = Passable;
+      UpdateTerrain(Index, TerrainIds[I]);
+      SetFlag(Index, Blocked, ObjectId.IsValid() && !Map.GetObject(ObjectId).IsPassable());
+      SetFlag(Index, Occupied, SquadIds[I].IsValid());
+    }
+  }
+
+  DropLandmarks();
+  for (Dim Z = 0, ZE = Size_.LayersCount; Z < ZE; ++Z) {
+    RelabelLayer(Z);
+  }
+
+  std::lock_guard Lock{*ProfilesMutex_};
+  for (MovementProfile Profile = 0; Profile < kNumMovementProfiles; ++Profile) {
+    if (auto &Grid = Profiles_[Profile]) {
+      FillTerrainCosts(Profile, *Grid);
+      for (size_t Index = 0, E = Grid->Costs.size(); Index < E; ++Index) {
+        Grid->Costs[Index] = ComputeCost(*Grid, Index);
+      }
+    }
+  }
+
+  // Everything has changed.
+  Journal_.clear();
+  JournalStart_ = ++Revision_;
+}
+
+MovementCosts NavigationGrid::GetCosts(MovementProfile Profile) const noexcept {
+  if (Profile == kBaseMovement) {
+    return GetBaseCosts();
+  }
+
+  std::lock_guard Lock{*ProfilesMutex_};
+  auto &Grid = Profiles_[Profile];
+  if (!Grid) {
+    Grid = std::make_unique<ProfileGrid>();
+    FillTerrainCosts(Profile, *Grid);
+    Grid->Costs.resize(Flags_.size());
+    for (size_t Index = 0, E = Grid->Costs.size(); Index < E; ++Index) {
+      Grid->Costs[Index] = ComputeCost(*Grid, Index);
+    }
+  }
+  return MovementCosts{Grid->Costs.data(), Grid->MinCost};
+}
+
+void NavigationGrid::FillTerrainCosts(MovementProfile Profile, ProfileGrid &Grid) const noexcept {
+  Size MinCost = MAX_SIZE, PlainCost = MAX_SIZE;
+  for (const auto &Terrain : Terrains_) {
+    MinCost = std::min(MinCost, Terrain.BaseCost);
+    if (Terrain.Kind == TerrainKind::Ground && Terrain.Ground == GroundKind::Plain) {
+      PlainCost = std::min(PlainCost, Terrain.BaseCost);
+    }
+  }
+  if (PlainCost == MAX_SIZE) {
+    PlainCost = MinCost;
+  }
+
+  Grid.TerrainCosts.clear();
+  Grid.MinCost = Terrains_.empty() ? 0 : MovementCosts::kMaxCost;
+  for (const auto &Terrain : Terrains_) {
+    const Size Cost = std::clamp<Size>(GetTerrainCost(Profile, Terrain, PlainCost, MinCost), 1,
+                                       MovementCosts::kMaxCost);
+    Grid.TerrainCosts.push_back(static_cast<uint8_t>(Cost));
+    Grid.MinCost = std::min(Grid.MinCost, Cost);
+  }
+}
+
+uint8_t NavigationGrid::ComputeCost(const ProfileGrid &Grid, size_t Index) const noexcept {
+  if (Flags_[Index] & Blocked) {
+    return MovementCosts::kObject;
+  }
+  if (Flags_[Index] != Passable) {
+    return MovementCosts::kImpassable;
+  }
+  return Grid.TerrainCosts[TerrainIds_[Index]];
+}
+
+void NavigationGrid::PatchProfiles(size_t Index) noexcept {
+  for (auto &Grid : Profiles_) {
+    if (Grid) {
+      Grid->Costs[Index] = ComputeCost(*Grid, Index);
+    }
+  }
+}
+
+std::vector<uint8_t> NavigationGrid::GetTerrainCosts(MovementProfile Profile,
+                                                     Size &MinCost) const noexcept {
+  ProfileGrid Grid;
+  FillTerrainCosts(Profile, Grid);
+  MinCost = Grid.MinCost;
+
+  std::vector<uint8_t> Costs(TerrainIds_.size());
+  for (size_t Index = 0, E = Costs.size(); Index < E; ++Index) {
+    const auto TerrainId = TerrainIds_[Index];
+    Costs[Index] =
+        TerrainId != kNoTerrain ? Grid.TerrainCosts[TerrainId] : MovementCosts::kImpassable;
+  }
+  return Costs;
+}
+
+void NavigationGrid::SetTerrain(size_t Index, Id<Terrain> Terrain) noexcept {
+  const auto OldTerrain = TerrainIds_[Index];
+  const bool WasWalkable = IsWalkable(Index);
+  if (UpdateTerrain(Index, Terrain)) {
+    if (TerrainIds_[Index] != OldTerrain) {
+      DropLandmarks();
+    }
+    PatchComponents(Index, WasWalkable);
+    PatchProfiles(Index);
+    Record(Index);
+  }
+}
+
+void NavigationGrid::AddPortal(size_t Entry, size_t Exit) noexcept {
+  Portals_.push_back(Portal{.Entry = Entry, .Exit = Exit});
+  HasPortal_[Entry] = true;
+  Record(Entry);
+}
+
+bool NavigationGrid::IsPortalJump(size_t From, size_t To) const noexcept {
+  bool IsJump = false;
+  ForEachPortalExit(From, [&](size_t Exit) { IsJump |= Exit == To; });
+  return IsJump;
+}
+
+bool NavigationGrid::MayBeConnected(size_t From, size_t To) const noexcept {
+  const auto Target = GetComponent(To);
+  SmallVector<uint32_t, 8> Reached;
+  if (IsWalkable(From)) {
+    Reached.push_back(GetComponent(From));
+  } else {
+    ForEachNeighbour(From, [&](size_t Next) {
+      if (IsWalkable(Next)) {
+        Reached.push_back(GetComponent(Next));
+      }
+    });
+  }
+
+  // Portals are few, the components they link are searched directly.
+  for (size_t I = 0; I < Reached.size(); ++I) {
+    if (Reached[I] == Target) {
+      return true;
+    }
+    for (const auto &P : Portals_) {
+      if (GetComponent(P.Entry) != Reached[I]) {
+        continue;
+      }
+      const auto Next = GetComponent(P.Exit);
+      if (std::find(Reached.begin(), Reached.end(), Next) == Reached.end()) {
+        Reached.push_back(Next);
+      }
+    }
+  }
+  return false;
+}
+
+void NavigationGrid::PatchComponents(size_t Index, bool WasWalkable) noexcept {
+  const bool IsNowWalkable = IsWalkable(Index);
+  if (IsNowWalkable == WasWalkable) {
+    return;
+  }
+  if (IsNowWalkable) {
+    ForEachNeighbour(Index, [&](size_t Next) {
+      if (IsWalkable(Next)) {
+        UniteComponents(Index, Next);
+      }
+    });
+  } else if (MaySplit(Index)) {
+    RelabelLayer(ToCoord(Index).Layer);
+  }
+}
+
+bool NavigationGrid::MaySplit(size_t Index) const noexcept {
+  // The neighbours clockwise from the northern one. Consecutive ones are adjacent, and so are
+  // two orthogonal ones around a corner.
+  static constexpr std::array<std::array<int, 2>, 8> kClockwise = {
+      {{0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}}};
+  const auto Offsets = MakeOffsets(kClockwise, Stride_);
+  unsigned Walkable = 0;
+  for (size_t I = 0; I < Offsets.size(); ++I) {
+    Walkable |= unsigned{IsWalkable(Index + Offsets[I])} << I;
+  }
+  if (!Walkable) {
+    return false;
+  }
+
+  // The neighbours stay connected without the tile if they are connected around it.
+  unsigned Reached = Walkable & -Walkable, Prev = 0;
+  while (Reached != Prev) {
+    Prev = Reached;
+    for (unsigned I = 0; I < 8; ++I) {
+      if (Prev & (1u << I)) {
+        Reached |= 1u << (I + 1) % 8 | 1u << (I + 7) % 8;
+        if (I % 2 == 0) {
+          Reached |= 1u << (I + 2) % 8 | 1u << (I + 6) % 8;
+        }
+      }
+    }
+    Reached &= Walkable;
+  }
+  return Reached != Walkable;
+}
+
+void NavigationGrid::RelabelLayer(Dim Layer) noexcept {
+  const size_t First = GetFirstIndex(Layer);
+  for (size_t Index = First; Index < First + PlaneSize_; ++Index) {
+    ComponentParent_[Index] = static_cast<uint32_t>(Index);
+    ComponentRank_[Index] = 0;
+  }
+
+  // Half of the neighbours, the other half unites with the tile from their side.
+  static constexpr std::array<std::array<int, 2>, 4> kForward = {{{1, 0}, {-1, 1}, {0, 1}, {1, 1}}};
+  const auto Offsets = MakeOffsets(kForward, Stride_);
+  for (Dim Y = 0; Y < Size_.Height; ++Y) {
+    const auto RowStart = ToIndex(Coord3D{0, Y, Layer});
+    for (size_t Index = RowStart; Index < RowStart + Size_.Width; ++Index) {
+      if (!IsWalkable(Index)) {
+        continue;
+      }
+      for (const auto Offset : Offsets) {
+        if (IsWalkable(Index + Offset)) {
+          UniteComponents(Index, Index + Offset);
+        }
+      }
+    }
+  }
+
+  // Flat after a relabelling, so that lookups stay a couple of loads.
+  for (size_t Index = First; Index < First + PlaneSize_; ++Index) {
+    ComponentParent_[Index] = static_cast<uint32_t>(FindComponent(Index));
+  }
+}
+
+size_t NavigationGrid::FindComponent(size_t Index) noexcept {
+  while (ComponentParent_[Index] != Index) {
+    ComponentParent_[Index] = ComponentParent_[ComponentParent_[Index]];
+    Index = ComponentParent_[Index];
+  }
+  return Index;
+}
+
+void NavigationGrid::UniteComponents(size_t A, size_t B) noexcept {
+  A = FindComponent(A);
+  B = FindComponent(B);
+  if (A == B) {
+    return;
+  }
+  if (ComponentRank_[A] < ComponentRank_[B]) {
+    std::swap(A, B);
+  }
+  ComponentParent_[B] = static_cast<uint32_t>(A);
+  if (ComponentRank_[A] == ComponentRank_[B]) {
+    ++ComponentRank_[A];
+  }
+}
+
+bool NavigationGrid::GetChangesSince(Revision Since, std::vector<size_t> &Changes) const noexcept {
+  if (Since < JournalStart_) {
+    return false;
+  }
+  Changes.insert(Changes.end(), Journal_.begin() + (Since - JournalStart_), Journal_.end());
+  return true;
+}
+
+bool NavigationGrid::UpdateTerrain(size_t Index, Id<Terrain> Terrain) noexcept {
+  const bool IsKnown = Terrain < Terrains_.size() && Terrain < kNoTerrain;
+  const uint8_t TerrainId = IsKnown ? static_cast<uint8_t>(Terrain) : kNoTerrain;
+  const bool IsChanged = TerrainIds_[Index] != TerrainId;
+  TerrainIds_[Index] = TerrainId;
+  return SetFlag(Index, Void, !IsKnown) || IsChanged;
+}
+
+void NavigationGrid::Record(size_t Index) noexcept {
+  ++Revision_;
+  Journal_.push_back(Index);
+  if (Journal_.size() > kMaxJournalSize) {
+    Journal_.pop_front();
+    ++JournalStart_;
+  }
+}
+
+} // namespace NotAGame
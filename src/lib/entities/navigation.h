@@ -0,0 +1,323 @@
+#pragma once
+
+#include "entities/movement.h"
+#include "util/id.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace NotAGame {
+
+class GlobalMap;
+class Terrain;
+
+// Cost grid of one movement profile, a byte per tile. Everything a search needs to know about a
+// tile is in that byte.
+class MovementCosts {
+public:
+  static constexpr uint8_t kObject = 0;       // Cannot be entered, leaving it is free.
+  static constexpr uint8_t kImpassable = 255; // Taken by a squad or without terrain.
+  static constexpr Size kMaxCost = 254;
+
+  MovementCosts(const uint8_t *Costs, Size MinCost) noexcept : Costs_{Costs}, MinCost_{MinCost} {}
+
+  Size GetCost(size_t Index) const noexcept { return Costs_[Index]; }
+  Size GetMinCost() const noexcept { return MinCost_; }
+  bool IsPassable(size_t Index) const noexcept {
+    return static_cast<uint8_t>(Costs_[Index] - 1) < kMaxCost;
+  }
+  bool IsBlocked(size_t Index) const noexcept { return Costs_[Index] == kObject; }
+
+  // Leaving a map object (e.g. a squad stepping out of the capital entrance) is free.
+  Size GetStepCost(size_t From, size_t To) const noexcept {
+    return Costs_[From] == kObject ? 0 : Costs_[To];
+  }
+
+private:
+  const uint8_t *Costs_;
+  Size MinCost_;
+};
+
+// Exact distances from and to a few tiles of every layer over the terrain alone, saturated to 16
+// bits. Objects and squads can only make paths longer, so by the triangle inequality the
+// differences of the distances are lower bounds of the real costs.
+class LandmarkTable {
+public:
+  static constexpr uint16_t kUnknown = UINT16_MAX;
+
+  struct Layer {
+    std::vector<size_t> Tiles;
+    // Per tile of the layer, the distance from and then to every landmark.
+    std::vector<uint16_t> Distances;
+  };
+
+  // Layers are indexed like the tiles of the navigation grid.
+  LandmarkTable(size_t PlaneSize, std::vector<Layer> Layers) noexcept
+      : PlaneSize_{PlaneSize}, Layers_{std::move(Layers)} {}
+
+  std::span<const Layer> GetLayers() const noexcept { return Layers_; }
+
+  // Both tiles must be on the same layer.
+  Size GetLowerBound(size_t From, size_t To) const noexcept {
+    const auto &L = Layers_[From / PlaneSize_];
+    const size_t Stride = 2 * L.Tiles.size();
+    const auto *DFrom = L.Distances.data() + From % PlaneSize_ * Stride;
+    const auto *DTo = L.Distances.data() + To % PlaneSize_ * Stride;
+    Size Bound = 0;
+    for (size_t I = 0; I < Stride; I += 2) {
+      // d(L, To) <= d(L, From) + d(From, To) and d(From, L) <= d(From, To) + d(To, L).
+      if (DFrom[I] != kUnknown && DTo[I] != kUnknown && DTo[I] > DFrom[I]) {
+        Bound = std::max<Size>(Bound, DTo[I] - DFrom[I]);
+      }
+      if (DFrom[I + 1] != kUnknown && DTo[I + 1] != kUnknown && DFrom[I + 1] > DTo[I + 1]) {
+        Bound = std::max<Size>(Bound, DFrom[I + 1] - DTo[I + 1]);
+      }
+    }
+    return Bound;
+  }
+
+  size_t GetMemoryUsage() const noexcept {
+    size_t Bytes = sizeof(*this);
+    for (const auto &L : Layers_) {
+      Bytes += L.Tiles.capacity() * sizeof(size_t) + L.Distances.capacity() * sizeof(uint16_t);
+    }
+    return Bytes;
+  }
+
+private:
+  size_t PlaneSize_;
+  std::vector<Layer> Layers_;
+};
+
+// Flat per-tile movement data used by the pathfinding. Tiles are 8-connected within a layer and
+// the adjacency is implicit, so no graph is ever materialized. The grid is built once and then
+// patched by GlobalMap whenever a tile, an object or a squad changes.
+//
+// Every layer is stored row by row inside a border of Void tiles, one tile wide. The neighbours of
+// a tile of the map are then at fixed index offsets and never out of the grid, searches walk them
+// without bounds checks and skip the border as impassable.
+//
+// Patched tiles are recorded in a bounded journal. Derived structures (path hierarchies, caches)
+// remember the revision they were computed at and pull the changes since then.
+class NavigationGrid {
+public:
+  using Revision = uint64_t;
+
+  // One-way jump between layers, costs as much as a step onto the exit.
+  struct Portal {
+    size_t Entry;
+    size_t Exit;
+  };
+
+  static constexpr size_t kMaxJournalSize = 1 << 16;
+
+  enum TileFlags : uint8_t {
+    Passable = 0,
+    Blocked = 1 << 0,  // Covered by a map object.
+    Occupied = 1 << 1, // Taken by a squad.
+    Void = 1 << 2,     // No terrain assigned.
+  };
+
+  NavigationGrid() noexcept : NavigationGrid{Dims3D{0, 0, 0}} {}
+  explicit NavigationGrid(Dims3D Size) noexcept;
+
+  void Build(const GlobalMap &Map, std::vector<TerrainMovement> Terrains) noexcept;
+
+  Dims3D GetSize() const noexcept { return Size_; }
+  // The border included.
+  size_t GetNumTiles() const noexcept { return Flags_.size(); }
+  size_t GetPlaneSize() const noexcept { return PlaneSize_; }
+  // Distance between the rows of a layer, the border included.
+  size_t GetStride() const noexcept { return Stride_; }
+  size_t GetFirstIndex(Dim Layer) const noexcept { return PlaneSize_ * Layer; }
+
+  size_t ToIndex(Coord3D Coord) const noexcept {
+    return PlaneSize_ * Coord.Layer + (size_t{Coord.Y} + 1) * Stride_ + Coord.X + 1;
+  }
+  // Border tiles give coordinates off the map.
+  Coord3D ToCoord(size_t Index) const noexcept {
+    const Dim Layer = static_cast<Dim>(Index / PlaneSize_);
+    const size_t InPlane = Index - Layer * PlaneSize_;
+    return {static_cast<Dim>(InPlane % Stride_) - 1, static_cast<Dim>(InPlane / Stride_) - 1,
+            Layer};
+  }
+
+  // The grid of a profile is computed on first use and patched along with the map afterwards.
+  // Safe to call from several threads.
+  MovementCosts GetCosts(MovementProfile Profile = kBaseMovement) const noexcept;
+
+  // Shortcuts for the base profile.
+  Size GetCost(size_t Index) const noexcept { return GetBaseCosts().GetCost(Index); }
+  Size GetMinCost() const noexcept { return GetBaseCosts().GetMinCost(); }
+  bool IsPassable(size_t Index) const noexcept { return Flags_[Index] == Passable; }
+  bool IsBlocked(size_t Index) const noexcept { return Flags_[Index] & Blocked; }
+  bool IsOccupied(size_t Index) const noexcept { return Flags_[Index] & Occupied; }
+  Size GetStepCost(size_t From, size_t To) const noexcept {
+    return GetBaseCosts().GetStepCost(From, To);
+  }
+
+  // Costs of the terrain alone, as if there were no objects and squads on the map.
+  std::vector<uint8_t> GetTerrainCosts(MovementProfile Profile, Size &MinCost) const noexcept;
+
+  // Landmarks hold for the terrain they were computed for, any terrain change drops them.
+  const LandmarkTable *GetLandmarks(MovementProfile Profile) const noexcept {
+    return Landmarks_[Profile].get();
+  }
+  void SetLandmarks(MovementProfile Profile, std::unique_ptr<const LandmarkTable> Table) noexcept {
+    Landmarks_[Profile] = std::move(Table);
+  }
+
+  void SetTerrain(size_t Index, Id<Terrain> Terrain) noexcept;
+  void SetBlocked(size_t Index, bool Value) noexcept { PatchFlag(Index, Blocked, Value); }
+  void SetOccupied(size_t Index, bool Value) noexcept { PatchFlag(Index, Occupied, Value); }
+
+  void AddPortal(size_t Entry, size_t Exit) noexcept;
+  std::span<const Portal> GetPortals() const noexcept { return Portals_; }
+  bool HasPortal(size_t Index) const noexcept { return HasPortal_[Index]; }
+  bool IsPortalJump(size_t From, size_t To) const noexcept;
+
+  template <typename Fn> void ForEachPortalExit(size_t Index, Fn &&Func) const noexcept {
+    if (!HasPortal_[Index]) {
+      return;
+    }
+    for (const auto &P : Portals_) {
+      if (P.Entry == Index) {
+        Func(P.Exit);
+      }
+    }
+  }
+
+  // Connected components of the walkable tiles of every layer: tiles of different components are
+  // never connected, tiles of the same one are, unless squads are in the way. Squads are ignored
+  // since they move every turn.
+  uint32_t GetComponent(size_t Index) const noexcept {
+    while (ComponentParent_[Index] != Index) {
+      Index = ComponentParent_[Index];
+    }
+    return static_cast<uint32_t>(Index);
+  }
+
+  // False if no path from From to To can exist. A start inside an object counts as the tiles
+  // around it. Constant time, unless the map has portals.
+  bool MayBeConnected(size_t From, size_t To) const noexcept;
+
+  Revision GetRevision() const noexcept { return Revision_; }
+
+  // Appends the tiles patched after Since, possibly with repetitions. Returns false if the
+  // journal does not reach back that far, the caller has to recompute everything then.
+  bool GetChangesSince(Revision Since, std::vector<size_t> &Changes) const noexcept;
+
+  // The 8 neighbours of a tile of the map in the order of kPlaneSteps, border tiles included.
+  std::array<size_t, 8> GetNeighbours(size_t Index) const noexcept {
+    std::array<size_t, 8> Neighbours;
+    for (size_t I = 0; I < NeighbourOffsets_.size(); ++I) {
+      Neighbours[I] = Index + NeighbourOffsets_[I];
+    }
+    return Neighbours;
+  }
+
+  template <typename Fn> void ForEachNeighbour(size_t Index, Fn &&Func) const noexcept {
+    for (const auto Offset : NeighbourOffsets_) {
+      Func(Index + Offset);
+    }
+  }
+
+private:
+  // Index offsets of the steps, negative ones wrap around.
+  template <size_t N>
+  static constexpr std::array<size_t, N>
+  MakeOffsets(const std::array<std::array<int, 2>, N> &Steps, size_t Stride) noexcept {
+    std::array<size_t, N> Offsets;
+    for (size_t I = 0; I < N; ++I) {
+      Offsets[I] = static_cast<size_t>(Steps[I][1]) * Stride + static_cast<size_t>(Steps[I][0]);
+    }
+    return Offsets;
+  }
+
+  struct ProfileGrid {
+    std::vector<uint8_t> TerrainCosts;
+    std::vector<uint8_t> Costs;
+    Size MinCost = 0;
+  };
+
+  MovementCosts GetBaseCosts() const noexcept {
+    const auto &Grid = *Profiles_[kBaseMovement];
+    return MovementCosts{Grid.Costs.data(), Grid.MinCost};
+  }
+
+  void FillTerrainCosts(MovementProfile Profile, ProfileGrid &Grid) const noexcept;
+  uint8_t ComputeCost(const ProfileGrid &Grid, size_t Index) const noexcept;
+  void PatchProfiles(size_t Index) noexcept;
+
+  bool UpdateTerrain(size_t Index, Id<Terrain> Terrain) noexcept;
+
+  bool SetFlag(size_t Index, TileFlags Flag, bool Value) noexcept {
+    const uint8_t NewFlags = Value ? Flags_[Index] | Flag : Flags_[Index] & ~Flag;
+    const bool IsChanged = NewFlags != Flags_[Index];
+    Flags_[Index] = NewFlags;
+    return IsChanged;
+  }
+
+  void PatchFlag(size_t Index, TileFlags Flag, bool Value) noexcept {
+    const bool WasWalkable = IsWalkable(Index);
+    if (SetFlag(Index, Flag, Value)) {
+      PatchComponents(Index, WasWalkable);
+      PatchProfiles(Index);
+      Record(Index);
+    }
+  }
+
+  void Record(size_t Index) noexcept;
+
+  bool IsWalkable(size_t Index) const noexcept { return !(Flags_[Index] & (Blocked | Void)); }
+  void PatchComponents(size_t Index, bool WasWalkable) noexcept;
+  bool MaySplit(size_t Index) const noexcept;
+  void RelabelLayer(Dim Layer) noexcept;
+  size_t FindComponent(size_t Index) noexcept;
+  void UniteComponents(size_t A, size_t B) noexcept;
+
+  void DropLandmarks() noexcept {
+    for (auto &Table : Landmarks_) {
+      Table.reset();
+    }
+  }
+
+  static constexpr uint8_t kNoTerrain = 255;
+
+  Dims3D Size_{0, 0, 0};
+  size_t Stride_ = 0;
+  size_t PlaneSize_ = 0;
+  std::array<size_t, 8> NeighbourOffsets_;
+  std::vector<TerrainMovement> Terrains_;
+
+  std::vector<uint8_t> TerrainIds_;
+  std::vector<uint8_t> Flags_;
+
+  // The base profile always exists, the others are created under the mutex.
+  mutable std::array<std::unique_ptr<ProfileGrid>, kNumMovementProfiles> Profiles_;
+  std::unique_ptr<std::mutex> ProfilesMutex_ = std::make_unique<std::mutex>();
+  std::array<std::unique_ptr<const LandmarkTable>, kNumMovementProfiles> Landmarks_;
+
+  // Union-find over the walkable tiles, separate for every layer. A tile turned unwalkable stays
+  // in its component unless that may split it, then the layer is relabelled.
+  std::vector<uint32_t> ComponentParent_;
+  std::vector<uint8_t> ComponentRank_;
+
+  // Portals are rare, a bit per tile keeps the lookups off the hot path.
+  std::vector<Portal> Portals_;
+  std::vector<bool> HasPortal_;
+
+  Revision Revision_ = 0;
+  // Journal_[I] was recorded at revision JournalStart_ + I + 1.
+  Revision JournalStart_ = 0;
+  std::deque<size_t> Journal_;
+};
+
+} // namespace NotAGame
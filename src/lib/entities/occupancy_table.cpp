@@ -0,0 +1,81 @@
+#include "entities/occupancy_table.h"
+
+#include <algorithm>
+
+namespace NotAGame {
+
+OccupancyTable::OccupancyTable(Dims3D Size) noexcept
+    : Size_{Size}, IsCovered_(size_t{Size.Width} * Size.Height * Size.LayersCount, 0),
+      Sums_(size_t{Size.Width + 1} * (Size.Height + 1) * Size.LayersCount, 0) {}
+
+void OccupancyTable::Occupy(Dim Layer, Coord Origin, Dims2D Extent) noexcept {
+  for (Dim Y = Origin.Y; Y < Origin.Y + Extent.Height; ++Y) {
+    const size_t Row = (size_t{Layer} * Size_.Height + Y) * Size_.Width;
+    std::fill_n(IsCovered_.begin() + Row + Origin.X, Extent.Width, 1);
+  }
+  Pending_.push_back(Pending{.Layer = Layer, .Origin = Origin, .Extent = Extent});
+  if (Pending_.size() >= kMaxPending) {
+    Flush();
+  }
+}
+
+Size OccupancyTable::CountOccupied(Dim Layer, Coord Origin, Dims2D Extent) const noexcept {
+  const Dim X1 = Origin.X + Extent.Width, Y1 = Origin.Y + Extent.Height;
+  Size Count = GetSum(Layer, X1, Y1) - GetSum(Layer, Origin.X, Y1) - GetSum(Layer, X1, Origin.Y) +
+               GetSum(Layer, Origin.X, Origin.Y);
+  for (const auto &P : Pending_) {
+    if (P.Layer != Layer) {
+      continue;
+    }
+    const Dim MinX = std::max(Origin.X, P.Origin.X);
+    const Dim MaxX = std::min(X1, P.Origin.X + P.Extent.Width);
+    const Dim MinY = std::max(Origin.Y, P.Origin.Y);
+    const Dim MaxY = std::min(Y1, P.Origin.Y + P.Extent.Height);
+    if (MinX < MaxX && MinY < MaxY) {
+      Count += (MaxX - MinX) * (MaxY - MinY);
+    }
+  }
+  return Count;
+}
+
+std::vector<Coord> OccupancyTable::FindFreePositions(Dim Layer, Dims2D Extent) noexcept {
+  std::vector<Coord> Positions;
+  if (!IsOnMap(Coord{0, 0}, Extent)) {
+    return Positions;
+  }
+  Flush();
+  for (Dim Y = 0; Y + Extent.Height <= Size_.Height; ++Y) {
+    for (Dim X = 0; X + Extent.Width <= Size_.Width; ++X) {
+      if (!CountOccupied(Layer, Coord{X, Y}, Extent)) {
+        Positions.push_back(Coord{X, Y});
+      }
+    }
+  }
+  return Positions;
+}
+
+void OccupancyTable::Flush() noexcept {
+  std::vector<bool> IsDirty(Size_.LayersCount, false);
+  for (const auto &P : Pending_) {
+    IsDirty[P.Layer] = true;
+  }
+  Pending_.clear();
+
+  const size_t Stride = Size_.Width + 1;
+  for (Dim Layer = 0; Layer < Size_.LayersCount; ++Layer) {
+    if (!IsDirty[Layer]) {
+      continue;
+    }
+    auto *Sums = Sums_.data() + Layer * Stride * (Size_.Height + 1);
+    const auto *Covered = IsCovered_.data() + size_t{Layer} * Size_.Width * Size_.Height;
+    for (Dim Y = 0; Y < Size_.Height; ++Y) {
+      uint32_t RowSum = 0;
+      for (Dim X = 0; X < Size_.Width; ++X) {
+        RowSum += Covered[size_t{Y} * Size_.Width + X];
+        Sums[(Y + 1) * Stride + X + 1] = Sums[Y * Stride + X + 1] + RowSum;
+      }
+    }
+  }
+}
+
+} // namespace NotAGame
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "util/types.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace NotAGame {
+
+// The tiles covered by map objects, with a summed-area table per layer: the number of covered
+// tiles of any rectangle is four lookups. Objects never overlap, so a new object only adds its
+// own area. Rebuilding the tables is a pass over the layer, so new objects are first kept aside
+// and counted one by one, the tables are rebuilt once enough of them pile up.
+class OccupancyTable {
+public:
+  OccupancyTable() noexcept : OccupancyTable{Dims3D{0, 0, 0}} {}
+  explicit OccupancyTable(Dims3D Size) noexcept;
+
+  // The rectangle must be on the map and free.
+  void Occupy(Dim Layer, Coord Origin, Dims2D Extent) noexcept;
+
+  // Rectangles sticking out of the map are never free.
+  bool IsFree(Dim Layer, Coord Origin, Dims2D Extent) const noexcept {
+    return IsOnMap(Origin, Extent) && !CountOccupied(Layer, Origin, Extent);
+  }
+  // The rectangle must be on the map.
+  Size CountOccupied(Dim Layer, Coord Origin, Dims2D Extent) const noexcept;
+
+  // Top-left tiles of all the free positions of a footprint, row by row.
+  std::vector<Coord> FindFreePositions(Dim Layer, Dims2D Extent) noexcept;
+
+private:
+  struct Pending {
+    Dim Layer;
+    Coord Origin;
+    Dims2D Extent;
+  };
+
+  // Enough to keep the queries cheap, few enough rebuilds for a map full of objects.
+  static constexpr size_t kMaxPending = 64;
+
+  bool IsOnMap(Coord Origin, Dims2D Extent) const noexcept {
+    return Extent.Width && Extent.Height && Origin.X <= Size_.Width &&
+           Extent.Width <= Size_.Width - Origin.X && Origin.Y <= Size_.Height &&
+           Extent.Height <= Size_.Height - Origin.Y;
+  }
+
+  // Covered tiles of [0, X) x [0, Y).
+  uint32_t GetSum(Dim Layer, Dim X, Dim Y) const noexcept {
+    return Sums_[(size_t{Layer} * (Size_.Height + 1) + Y) * (Size_.Width + 1) + X];
+  }
+
+  void Flush() noexcept;
+
+  Dims3D Size_;
+  // A byte per tile, row-major. The tables are built from it.
+  std::vector<uint8_t> IsCovered_;
+  // (Width + 1) x (Height + 1) per layer, the first row and column are zeros.
+  std::vector<uint32_t> Sums_;
+  std::vector<Pending> Pending_;
+};
+
+} // namespace NotAGame
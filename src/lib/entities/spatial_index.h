@@ -0,0 +1,200 @@
+#pragma once
+
+#include "util/id.h"
+#include "util/types.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace NotAGame {
+
+// Uniform grid of buckets over the map for the things standing on it: squads, map objects. A thing
+// is kept in the bucket of its top-left tile, so moving it touches at most two buckets and a query
+// only visits the buckets around the area it asks for. Buckets hold a handful of entries, the
+// lookups inside them are linear.
+//
+// Distances are counted in steps over the 8-connected map, that is max(|dx|, |dy|), up to the
+// closest tile of a thing.
+template <typename T> class SpatialIndex {
+public:
+  static constexpr Dim kBucketShift = 4;
+  static constexpr Dim kBucketSide = Dim{1} << kBucketShift;
+
+  struct Entry {
+    Id<T> Item;
+    Coord3D Position;
+    Dims2D Extent;
+  };
+
+  SpatialIndex() noexcept : SpatialIndex{Dims3D{0, 0, 0}} {}
+  explicit SpatialIndex(Dims3D MapSize) noexcept
+      : BucketsPerRow_{(MapSize.Width + kBucketSide - 1) >> kBucketShift},
+        BucketsPerColumn_{(MapSize.Height + kBucketSide - 1) >> kBucketShift},
+        Buckets_(size_t{BucketsPerRow_} * BucketsPerColumn_ * MapSize.LayersCount) {}
+
+  size_t GetNumEntries() const noexcept { return NumEntries_; }
+
+  void Insert(Id<T> Item, Coord3D Position, Dims2D Extent = Dims2D{1, 1}) noexcept {
+    Buckets_[GetBucket(Position)].push_back(
+        Entry{.Item = Item, .Position = Position, .Extent = Extent});
+    MaxExtent_.Width = std::max(MaxExtent_.Width, Extent.Width);
+    MaxExtent_.Height = std::max(MaxExtent_.Height, Extent.Height);
+    ++NumEntries_;
+  }
+
+  // Returns false if the item is not at the position.
+  bool Remove(Id<T> Item, Coord3D Position) noexcept {
+    auto &Bucket = Buckets_[GetBucket(Position)];
+    const auto It = Find(Bucket, Item, Position);
+    if (It == Bucket.end()) {
+      return false;
+    }
+    *It = Bucket.back();
+    Bucket.pop_back();
+    --NumEntries_;
+    return true;
+  }
+
+  bool Move(Id<T> Item, Coord3D From, Coord3D To) noexcept {
+    auto &Bucket = Buckets_[GetBucket(From)];
+    const auto It = Find(Bucket, Item, From);
+    if (It == Bucket.end()) {
+      return false;
+    }
+    if (GetBucket(From) == GetBucket(To)) {
+      It->Position = To;
+      return true;
+    }
+    const auto Extent = It->Extent;
+    *It = Bucket.back();
+    Bucket.pop_back();
+    Buckets_[GetBucket(To)].push_back(Entry{.Item = Item, .Position = To, .Extent = Extent});
+    return true;
+  }
+
+  // The entries covering at least one tile of the rectangle, in no particular order.
+  template <typename Fn>
+  void ForEachInRect(Dim Layer, Coord Min, Dims2D Extent, Fn &&Func) const noexcept {
+    if (!Extent.Width || !Extent.Height || !BucketsPerRow_ || !BucketsPerColumn_) {
+      return;
+    }
+    const uint64_t MaxX = uint64_t{Min.X} + Extent.Width - 1;
+    const uint64_t MaxY = uint64_t{Min.Y} + Extent.Height - 1;
+    // Things further up or left may reach into the rectangle.
+    const Dim FromX = (Min.X - std::min(Min.X, MaxExtent_.Width - 1)) >> kBucketShift;
+    const Dim FromY = (Min.Y - std::min(Min.Y, MaxExtent_.Height - 1)) >> kBucketShift;
+    const auto ToX =
+        static_cast<Dim>(std::min<uint64_t>(MaxX >> kBucketShift, BucketsPerRow_ - 1));
+    const auto ToY =
+        static_cast<Dim>(std::min<uint64_t>(MaxY >> kBucketShift, BucketsPerColumn_ - 1));
+    for (Dim BY = FromY; BY <= ToY; ++BY) {
+      for (Dim BX = FromX; BX <= ToX; ++BX) {
+        for (const auto &E : Buckets_[GetBucket(Layer, BX, BY)]) {
+          if (E.Position.X <= MaxX && uint64_t{E.Position.X} + E.Extent.Width > Min.X &&
+              E.Position.Y <= MaxY && uint64_t{E.Position.Y} + E.Extent.Height > Min.Y) {
+            Func(E);
+          }
+        }
+      }
+    }
+  }
+
+  // The entries at most Radius steps away from Center.
+  template <typename Fn>
+  void ForEachInRadius(Coord3D Center, Dim Radius, Fn &&Func) const noexcept {
+    const Coord Min{Center.X - std::min(Center.X, Radius), Center.Y - std::min(Center.Y, Radius)};
+    const auto Side = [&](Dim From, Dim To) {
+      return static_cast<Size>(std::min<uint64_t>(uint64_t{To} + Radius - From + 1, MAX_SIZE));
+    };
+    ForEachInRect(Center.Layer, Min, Dims2D{Side(Min.X, Center.X), Side(Min.Y, Center.Y)},
+                  std::forward<Fn>(Func));
+  }
+
+  // The closest entry accepted by the predicate within MaxRadius steps, ties go to the lowest
+  // item. Buckets are visited in rings around the one of Center until no closer entry can exist.
+  template <typename Pred>
+  std::optional<Entry> FindNearest(Coord3D Center, Dim MaxRadius,
+                                   Pred &&IsAccepted) const noexcept {
+    if (!BucketsPerRow_ || !BucketsPerColumn_) {
+      return std::nullopt;
+    }
+    std::optional<Entry> Best;
+    Dim BestDistance = MaxRadius;
+    auto Visit = [&](int64_t BX, int64_t BY) {
+      if (BX < 0 || BY < 0 || BX >= BucketsPerRow_ || BY >= BucketsPerColumn_) {
+        return;
+      }
+      for (const auto &E : Buckets_[GetBucket(Center.Layer, BX, BY)]) {
+        const auto Distance = GetDistance(Center, E);
+        if (Distance > BestDistance ||
+            (Best && Distance == BestDistance && E.Item.GetValue() > Best->Item.GetValue())) {
+          continue;
+        }
+        if (IsAccepted(E)) {
+          Best = E;
+          BestDistance = Distance;
+        }
+      }
+    };
+
+    const int64_t CX = Center.X >> kBucketShift, CY = Center.Y >> kBucketShift;
+    const int64_t NumRings = std::max(BucketsPerRow_, BucketsPerColumn_);
+    const int64_t Reach = std::max(MaxExtent_.Width, MaxExtent_.Height) - 1;
+    for (int64_t Ring = 0; Ring <= NumRings; ++Ring) {
+      // The top-left tiles in the ring are at least this far from Center.
+      if (Ring > 0 && (Ring - 1) * kBucketSide + 1 - Reach > BestDistance) {
+        break;
+      }
+      for (int64_t BX = CX - Ring; BX <= CX + Ring; ++BX) {
+        Visit(BX, CY - Ring);
+        if (Ring > 0) {
+          Visit(BX, CY + Ring);
+        }
+      }
+      for (int64_t BY = CY - Ring + 1; BY < CY + Ring; ++BY) {
+        Visit(CX - Ring, BY);
+        Visit(CX + Ring, BY);
+      }
+    }
+    return Best;
+  }
+
+  static Dim GetDistance(Coord3D From, const Entry &E) noexcept {
+    auto Axis = [](Dim Value, Dim Start, Size Extent) -> Dim {
+      if (Value < Start) {
+        return Start - Value;
+      }
+      return Value - Start < Extent ? 0 : Value - (Start + Extent - 1);
+    };
+    return std::max(Axis(From.X, E.Position.X, E.Extent.Width),
+                    Axis(From.Y, E.Position.Y, E.Extent.Height));
+  }
+
+private:
+  using EntryList = std::vector<Entry>;
+
+  size_t GetBucket(Dim Layer, int64_t BX, int64_t BY) const noexcept {
+    return (size_t{Layer} * BucketsPerColumn_ + static_cast<size_t>(BY)) * BucketsPerRow_ +
+           static_cast<size_t>(BX);
+  }
+  size_t GetBucket(Coord3D Position) const noexcept {
+    return GetBucket(Position.Layer, Position.X >> kBucketShift, Position.Y >> kBucketShift);
+  }
+
+  static typename EntryList::iterator Find(EntryList &B, Id<T> Item, Coord3D Position) noexcept {
+    return std::find_if(B.begin(), B.end(), [&](const Entry &E) {
+      return E.Item == Item && E.Position == Position;
+    });
+  }
+
+  Dim BucketsPerRow_;
+  Dim BucketsPerColumn_;
+  std::vector<EntryList> Buckets_;
+  Dims2D MaxExtent_{1, 1};
+  size_t NumEntries_ = 0;
+};
+
+} // namespace NotAGame
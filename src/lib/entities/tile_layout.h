@@ -0,0 +1,159 @@
+#pragma once
+
+#include "util/types.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace NotAGame {
+
+// Order of the tiles of a layer in memory. Layers always follow each other.
+enum class TileLayout : uint8_t {
+  RowMajor,   // Rows one after another.
+  Chunked,    // 16x16 chunks, rows of chunks one after another and row-major inside a chunk.
+  Morton,     // Z-order curve, the plane is padded to powers of two.
+  PowerOfTwo, // Rows one after another, the width and the height are padded to powers of two.
+};
+
+// Conversion between the coordinates and the indices of the tiles for a layout. The blocked
+// layouts keep the tiles close on the map close in memory, so neighbourhood scans hit fewer cache
+// lines, at the price of padding the layers and of a few more operations per conversion.
+class TileIndexer {
+public:
+  static constexpr Dim kChunkShift = 4;
+  static constexpr Dim kChunkSide = Dim{1} << kChunkShift;
+  static constexpr Dim kChunkMask = kChunkSide - 1;
+
+  TileIndexer(Dims3D Size, TileLayout Layout) noexcept : Size_{Size}, Layout_{Layout} {
+    switch (Layout_) {
+    case TileLayout::RowMajor:
+      PlaneSize_ = size_t{Size.Width} * Size.Height;
+      break;
+    case TileLayout::Chunked: {
+      ChunksPerRow_ = (Size.Width + kChunkMask) >> kChunkShift;
+      const size_t ChunksPerColumn = (Size.Height + kChunkMask) >> kChunkShift;
+      PlaneSize_ = size_t{ChunksPerRow_} * ChunksPerColumn * kChunkSide * kChunkSide;
+      break;
+    }
+    case TileLayout::Morton: {
+      const auto WidthBits = GetPaddedBits(Size.Width);
+      const auto HeightBits = GetPaddedBits(Size.Height);
+      // The curve covers a square of the smaller side, the rest of the bits of the longer side
+      // pick the square.
+      InterleavedBits_ = static_cast<Dim>(std::min(WidthBits, HeightBits));
+      IsWide_ = WidthBits >= HeightBits;
+      PlaneSize_ = size_t{1} << (WidthBits + HeightBits);
+      break;
+    }
+    case TileLayout::PowerOfTwo:
+      WidthBits_ = GetPaddedBits(Size.Width);
+      PlaneBits_ = WidthBits_ + GetPaddedBits(Size.Height);
+      PlaneSize_ = size_t{1} << PlaneBits_;
+      break;
+    }
+  }
+
+  TileLayout GetLayout() const noexcept { return Layout_; }
+  Dims3D GetSize() const noexcept { return Size_; }
+
+  // Padding included.
+  size_t GetPlaneSize() const noexcept { return PlaneSize_; }
+  size_t GetNumTiles() const noexcept { return PlaneSize_ * Size_.LayersCount; }
+
+  size_t ToIndex(Coord3D Coord) const noexcept {
+    const size_t First = PlaneSize_ * Coord.Layer;
+    switch (Layout_) {
+    case TileLayout::RowMajor:
+      return First + size_t{Coord.Y} * Size_.Width + Coord.X;
+    case TileLayout::Chunked: {
+      const size_t Chunk =
+          size_t{Coord.Y >> kChunkShift} * ChunksPerRow_ + (Coord.X >> kChunkShift);
+      return First + (Chunk << (2 * kChunkShift)) + ((Coord.Y & kChunkMask) << kChunkShift) +
+             (Coord.X & kChunkMask);
+    }
+    case TileLayout::Morton: {
+      const Dim Mask = (Dim{1} << InterleavedBits_) - 1;
+      const auto Square = (Coord.X >> InterleavedBits_) | (Coord.Y >> InterleavedBits_);
+      return First + (SpreadBits(Coord.X & Mask) | SpreadBits(Coord.Y & Mask) << 1 |
+                      uint64_t{Square} << (2 * InterleavedBits_));
+    }
+    case TileLayout::PowerOfTwo:
+      return size_t{Coord.Layer} << PlaneBits_ | size_t{Coord.Y} << WidthBits_ | Coord.X;
+    }
+    return 0;
+  }
+
+  // Padding tiles give coordinates out of the map.
+  Coord3D ToCoord(size_t Index) const noexcept {
+    if (Layout_ == TileLayout::PowerOfTwo) {
+      const size_t InPlane = Index & (PlaneSize_ - 1);
+      return Coord3D{static_cast<Dim>(InPlane & ((size_t{1} << WidthBits_) - 1)),
+                     static_cast<Dim>(InPlane >> WidthBits_),
+                     static_cast<Dim>(Index >> PlaneBits_)};
+    }
+    const auto Layer = static_cast<Dim>(Index / PlaneSize_);
+    const size_t InPlane = Index - PlaneSize_ * Layer;
+    switch (Layout_) {
+    case TileLayout::RowMajor:
+      return Coord3D{static_cast<Dim>(InPlane % Size_.Width),
+                     static_cast<Dim>(InPlane / Size_.Width), Layer};
+    case TileLayout::Chunked: {
+      const size_t Chunk = InPlane >> (2 * kChunkShift);
+      const auto Local = static_cast<Dim>(InPlane);
+      const auto ChunkX = static_cast<Dim>(Chunk % ChunksPerRow_);
+      const auto ChunkY = static_cast<Dim>(Chunk / ChunksPerRow_);
+      return Coord3D{ChunkX << kChunkShift | (Local & kChunkMask),
+                     ChunkY << kChunkShift | (Local >> kChunkShift & kChunkMask), Layer};
+    }
+    case TileLayout::Morton: {
+      const auto Square = static_cast<Dim>(InPlane >> (2 * InterleavedBits_)) << InterleavedBits_;
+      const size_t Curve = InPlane & ((size_t{1} << (2 * InterleavedBits_)) - 1);
+      const auto X = static_cast<Dim>(CompactBits(Curve));
+      const auto Y = static_cast<Dim>(CompactBits(Curve >> 1));
+      return IsWide_ ? Coord3D{X | Square, Y, Layer} : Coord3D{X, Y | Square, Layer};
+    }
+    case TileLayout::PowerOfTwo:
+      break; // Shifts and masks only, done above.
+    }
+    return Coord3D{};
+  }
+
+private:
+  // Bits of the side padded to a power of two.
+  static Dim GetPaddedBits(Dim Side) noexcept {
+    return static_cast<Dim>(std::bit_width(std::max<Dim>(Side, 1) - 1));
+  }
+
+  // Moves bit I of Value to bit 2 * I.
+  static constexpr uint64_t SpreadBits(uint64_t Value) noexcept {
+    Value &= 0xFFFFFFFF;
+    Value = (Value | Value << 16) & 0x0000FFFF0000FFFF;
+    Value = (Value | Value << 8) & 0x00FF00FF00FF00FF;
+    Value = (Value | Value << 4) & 0x0F0F0F0F0F0F0F0F;
+    Value = (Value | Value << 2) & 0x3333333333333333;
+    return (Value | Value << 1) & 0x5555555555555555;
+  }
+
+  // Moves bit 2 * I of Value to bit I, the odd bits are dropped.
+  static constexpr uint64_t CompactBits(uint64_t Value) noexcept {
+    Value &= 0x5555555555555555;
+    Value = (Value | Value >> 1) & 0x3333333333333333;
+    Value = (Value | Value >> 2) & 0x0F0F0F0F0F0F0F0F;
+    Value = (Value | Value >> 4) & 0x00FF00FF00FF00FF;
+    Value = (Value | Value >> 8) & 0x0000FFFF0000FFFF;
+    return (Value | Value >> 16) & 0x00000000FFFFFFFF;
+  }
+
+  Dims3D Size_;
+  TileLayout Layout_;
+  size_t PlaneSize_ = 0;
+  Dim ChunksPerRow_ = 0;
+  Dim InterleavedBits_ = 0;
+  bool IsWide_ = true;
+  Dim WidthBits_ = 0;
+  Dim PlaneBits_ = 0;
+};
+
+} // namespace NotAGame
@@ -4,6 +4,7 @@
 //#include "entities/components.h"
 #include "entities/effect.h"
 #include "entities/inventory.h"
+#include "entities/movement.h"
 #include "entities/resource.h"
 #include "ui/icon.h"
 #include "util/id.h"
@@ -209,6 +210,7 @@ struct LeaderData {
   SizeTrait Leadership;
   SizeTrait Steps;
   SizeTrait ViewRange;
+  MovementProfile Movement = kBaseMovement;
 
   Inventory Items;
   SmallVector<Skill, 8> Skills;
@@ -0,0 +1,84 @@
+#include "entities/global_map.h"
+
+#include <unordered_set>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+class TestGlobalMap : public ::testing::TestWithParam<TileLayout> {};
+
+TEST_P(TestGlobalMap, IndexRoundTrip) {
+  for (const Dims3D Size : {Dims3D{1, 1, 1}, Dims3D{16, 16, 1}, Dims3D{37, 5, 3},
+                            Dims3D{5, 37, 2}, Dims3D{64, 17, 2}, Dims3D{100, 3, 4},
+                            Dims3D{3, 100, 4}}) {
+    const GlobalMap Map{Size.LayersCount, Size.Width, Size.Height, GetParam()};
+    std::unordered_set<size_t> Indices;
+    for (Dim Layer = 0; Layer < Size.LayersCount; ++Layer) {
+      for (Dim Y = 0; Y < Size.Height; ++Y) {
+        for (Dim X = 0; X < Size.Width; ++X) {
+          const Coord3D Coord{X, Y, Layer};
+          const auto Index = Map.Coord3DToIndex(Coord);
+          EXPECT_EQ(Map.IndexToCoord3D(Index), Coord);
+          EXPECT_GE(Index, Map.GetFirstIndex(Layer));
+          EXPECT_LT(Index - Map.GetFirstIndex(Layer), Map.GetTerrainIds(Layer).size());
+          EXPECT_TRUE(Indices.insert(Index).second);
+        }
+      }
+    }
+  }
+}
+
+TEST_P(TestGlobalMap, Columns) {
+  GlobalMap Map{2, 20, 18, GetParam()};
+  Map.SetTerrain(Coord3D{17, 3, 1}, 2);
+  Map.SetSquad(Coord3D{4, 16, 0}, Id<Squad>{7});
+  Map.GetTile(Coord3D{4, 16, 0}).Owner_ = 3;
+
+  size_t NumSquads = 0;
+  for (Dim Layer = 0; Layer < 2; ++Layer) {
+    const auto Terrains = Map.GetTerrainIds(Layer);
+    const auto Squads = Map.GetSquadIds(Layer);
+    for (size_t I = 0; I < Squads.size(); ++I) {
+      const auto Coord = Map.IndexToCoord3D(Map.GetFirstIndex(Layer) + I);
+      if (Squads[I].IsValid()) {
+        EXPECT_EQ(Coord, (Coord3D{4, 16, 0}));
+        ++NumSquads;
+      }
+      if (Terrains[I] == 2) {
+        EXPECT_EQ(Coord, (Coord3D{17, 3, 1}));
+      }
+    }
+  }
+  EXPECT_EQ(NumSquads, 1);
+
+  const auto &ConstMap = Map;
+  const auto Tile = ConstMap.GetTile(0, 4, 16);
+  EXPECT_EQ(Tile.Squad_, Id<Squad>{7});
+  EXPECT_EQ(Tile.Owner_, Id<Player>{3});
+  EXPECT_EQ(Tile.VisibilityFlags, 1);
+}
+
+// Every tile of the storage is either a tile of the map, counted once, or padding off the map.
+TEST_P(TestGlobalMap, Padding) {
+  for (const Dims3D Size : {Dims3D{33, 7, 3}, Dims3D{7, 33, 2}, Dims3D{32, 16, 2}}) {
+    const GlobalMap Map{Size.LayersCount, Size.Width, Size.Height, GetParam()};
+    size_t NumTiles = 0;
+    for (Dim Layer = 0; Layer < Size.LayersCount; ++Layer) {
+      const auto First = Map.GetFirstIndex(Layer);
+      for (size_t I = 0; I < Map.GetTerrainIds(Layer).size(); ++I) {
+        const auto Coord = Map.IndexToCoord3D(First + I);
+        if (Map.IsValid(Coord)) {
+          EXPECT_EQ(Coord.Layer, Layer);
+          EXPECT_EQ(Map.Coord3DToIndex(Coord), First + I);
+          ++NumTiles;
+        }
+      }
+    }
+    EXPECT_EQ(NumTiles, size_t{Size.Width} * Size.Height * Size.LayersCount);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Layouts, TestGlobalMap,
+                         ::testing::Values(TileLayout::RowMajor, TileLayout::Chunked,
+                                           TileLayout::Morton, TileLayout::PowerOfTwo));
@@ -0,0 +1,122 @@
+#include "entities/components.h"
+#include "entities/global_map.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+namespace {
+
+MapObject MakeWall(Coord3D Pos, Dims2D Size) {
+  return MapObject{Named{"wall", "Wall", "wall"}, MapObject::Other, Pos, Size, std::nullopt, false,
+                   true};
+}
+
+Size CountOwned(const GlobalMap &Map, PlayerId Player) {
+  Size Count = 0;
+  for (Dim Y = 0; Y < Map.GetHeight(); ++Y) {
+    for (Dim X = 0; X < Map.GetWidth(); ++X) {
+      Count += Map.GetTile(0, X, Y).Owner_ == Player;
+    }
+  }
+  return Count;
+}
+
+} // namespace
+
+TEST(TestLandPropagation, RingByRing) {
+  GlobalMap Map{1, 20, 20};
+  LandPropagationSystem Propagation{2};
+  const auto Origin = Propagation.AddComponentAndPropagate(
+      Map, LandPropagation{.Player = 1,
+                           .TilesPerTurn = 5,
+                           .Origin = Coord3D{8, 8, 0},
+                           .OriginSize = Dims2D{2, 2}});
+  EXPECT_EQ(Origin.ComponentId, 0);
+  EXPECT_EQ(Origin.Tiles.size(), 4);
+  EXPECT_EQ(CountOwned(Map, 1), 4);
+
+  // The first ring around the origin is 12 tiles, the next turns fill it before going further.
+  std::vector<Coord3D> Gained;
+  for (size_t Turn = 0; Turn < 3; ++Turn) {
+    const auto Tiles = Propagation.Propagate(Map, 1);
+    EXPECT_EQ(Tiles.size(), 5);
+    Gained.insert(Gained.end(), Tiles.begin(), Tiles.end());
+  }
+  for (size_t I = 0; I < 12; ++I) {
+    const auto Coord = Gained[I];
+    EXPECT_TRUE(Coord.X >= 7 && Coord.X <= 10 && Coord.Y >= 7 && Coord.Y <= 10);
+    EXPECT_EQ(Map.GetTile(Coord).Owner_, 1);
+  }
+  EXPECT_EQ(CountOwned(Map, 1), 4 + 15);
+  EXPECT_EQ(CountOwned(Map, 0), 0);
+
+  // Other players have nothing to propagate.
+  EXPECT_TRUE(Propagation.Propagate(Map, 0).empty());
+}
+
+TEST(TestLandPropagation, Barriers) {
+  GlobalMap Map{1, 20, 10};
+  // A wall across the map with a gap at the bottom.
+  ASSERT_TRUE(Map.AddObject("wall", MakeWall(Coord3D{10, 0, 0}, Dims2D{1, 9})).IsSuccess());
+  LandPropagationSystem Propagation{3};
+  Propagation.AddComponentAndPropagate(Map, LandPropagation{.Player = 1,
+                                                            .TilesPerTurn = 7,
+                                                            .Origin = Coord3D{2, 2, 0},
+                                                            .OriginSize = Dims2D{1, 1}});
+  // Land of another player in the gap.
+  Propagation.AddComponentAndPropagate(Map, LandPropagation{.Player = 2,
+                                                            .TilesPerTurn = 0,
+                                                            .Origin = Coord3D{10, 9, 0},
+                                                            .OriginSize = Dims2D{1, 1}});
+
+  size_t NumTurns = 0;
+  while (!Propagation.Propagate(Map, 1).empty()) {
+    ++NumTurns;
+  }
+  // Everything left of the wall, nothing behind it.
+  EXPECT_EQ(CountOwned(Map, 1), 10 * 10);
+  EXPECT_EQ(NumTurns, (10 * 10 - 1 + 6) / 7);
+  for (Dim Y = 0; Y < 10; ++Y) {
+    EXPECT_FALSE(Map.GetTile(0, 11, Y).Owner_.IsValid());
+  }
+  EXPECT_EQ(Map.GetTile(0, 10, 9).Owner_, 2);
+}
+
+TEST(TestLandPropagation, Capture) {
+  GlobalMap Map{1, 12, 12};
+  LandPropagationSystem Propagation{3};
+  Propagation.AddComponentAndPropagate(Map, LandPropagation{.Player = 1,
+                                                            .TilesPerTurn = 10,
+                                                            .Origin = Coord3D{0, 0, 0},
+                                                            .OriginSize = Dims2D{1, 1}});
+  const auto Town = Propagation
+                        .AddComponentAndPropagate(Map, LandPropagation{.Player = 1,
+                                                                       .TilesPerTurn = 3,
+                                                                       .Origin = Coord3D{6, 6, 0},
+                                                                       .OriginSize = Dims2D{2, 2}})
+                        .Tiles;
+  EXPECT_EQ(Town.size(), 4);
+
+  // Sources of a player share their land, every tile is gained once.
+  auto Gained = Propagation.Propagate(Map, 1);
+  EXPECT_EQ(Gained.size(), 10 + 3);
+  std::sort(Gained.begin(), Gained.end(), [](Coord3D A, Coord3D B) {
+    return std::pair{A.Y, A.X} < std::pair{B.Y, B.X};
+  });
+  EXPECT_EQ(std::adjacent_find(Gained.begin(), Gained.end(),
+                               [](Coord3D A, Coord3D B) { return A.X == B.X && A.Y == B.Y; }),
+            Gained.end());
+
+  // The town changes hands: its origin goes to the new owner, which spreads out of it.
+  const auto Captured = Propagation.ChangeOwner(Map, 1, 2);
+  EXPECT_EQ(Captured.Tiles.size(), 4);
+  EXPECT_EQ(Map.GetTile(0, 7, 7).Owner_, 2);
+  while (!Propagation.Propagate(Map, 1).empty()) {
+  }
+  EXPECT_EQ(CountOwned(Map, 1) + 4, 12 * 12);
+  EXPECT_TRUE(Propagation.Propagate(Map, 2).empty());
+}
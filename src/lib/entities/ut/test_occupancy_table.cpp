@@ -0,0 +1,86 @@
+#include "entities/global_map.h"
+#include "entities/occupancy_table.h"
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+TEST(TestOccupancyTable, MatchesScan) {
+  const Dims3D MapSize{41, 29, 2};
+  OccupancyTable Table{MapSize};
+  std::vector<bool> IsCovered(MapSize.Width * MapSize.Height * MapSize.LayersCount, false);
+  auto CountCovered = [&](Dim Layer, Coord Origin, Dims2D Extent) {
+    Size Count = 0;
+    for (Dim Y = Origin.Y; Y < Origin.Y + Extent.Height; ++Y) {
+      for (Dim X = Origin.X; X < Origin.X + Extent.Width; ++X) {
+        Count += IsCovered[(Layer * MapSize.Height + Y) * MapSize.Width + X];
+      }
+    }
+    return Count;
+  };
+
+  // Enough objects for the tables to be rebuilt a few times.
+  std::mt19937 Random{3};
+  size_t NumPlaced = 0;
+  for (size_t Attempt = 0; Attempt < 2000; ++Attempt) {
+    const Dims2D Extent{static_cast<Size>(Random() % 4 + 1), static_cast<Size>(Random() % 3 + 1)};
+    const Coord Origin{static_cast<Dim>(Random() % (MapSize.Width - Extent.Width + 1)),
+                       static_cast<Dim>(Random() % (MapSize.Height - Extent.Height + 1))};
+    const Dim Layer = Random() % MapSize.LayersCount;
+    ASSERT_EQ(Table.CountOccupied(Layer, Origin, Extent), CountCovered(Layer, Origin, Extent));
+    if (!Table.IsFree(Layer, Origin, Extent)) {
+      continue;
+    }
+    Table.Occupy(Layer, Origin, Extent);
+    for (Dim Y = Origin.Y; Y < Origin.Y + Extent.Height; ++Y) {
+      for (Dim X = Origin.X; X < Origin.X + Extent.Width; ++X) {
+        IsCovered[(Layer * MapSize.Height + Y) * MapSize.Width + X] = true;
+      }
+    }
+    ++NumPlaced;
+  }
+  EXPECT_GT(NumPlaced, 128);
+
+  for (Dim Layer = 0; Layer < MapSize.LayersCount; ++Layer) {
+    const Dims2D Extent{2, 3};
+    std::vector<Coord> Expected;
+    for (Dim Y = 0; Y + Extent.Height <= MapSize.Height; ++Y) {
+      for (Dim X = 0; X + Extent.Width <= MapSize.Width; ++X) {
+        if (!CountCovered(Layer, Coord{X, Y}, Extent)) {
+          Expected.push_back(Coord{X, Y});
+        }
+      }
+    }
+    const auto Found = Table.FindFreePositions(Layer, Extent);
+    ASSERT_EQ(Found.size(), Expected.size());
+    for (size_t I = 0; I < Found.size(); ++I) {
+      EXPECT_EQ(Found[I].X, Expected[I].X);
+      EXPECT_EQ(Found[I].Y, Expected[I].Y);
+    }
+  }
+}
+
+TEST(TestOccupancyTable, MapObjects) {
+  GlobalMap Map{1, 10, 4};
+  auto Make = [](Coord3D Pos, Dims2D Size) {
+    return MapObject{Named{"hut", "Hut", "hut"}, MapObject::Other, Pos, Size, std::nullopt, false,
+                     false};
+  };
+  // Wider than the map is high, it fits only along the rows.
+  EXPECT_TRUE(Map.CanPlaceObject(0, 2, 0, Make(Coord3D{2, 0, 0}, Dims2D{6, 2})));
+  EXPECT_FALSE(Map.CanPlaceObject(0, 5, 0, Make(Coord3D{5, 0, 0}, Dims2D{6, 2})));
+  ASSERT_TRUE(Map.AddObject("hall", Make(Coord3D{2, 0, 0}, Dims2D{6, 2})).IsSuccess());
+  EXPECT_FALSE(Map.AddObject("hut", Make(Coord3D{7, 1, 0}, Dims2D{2, 2})).IsSuccess());
+  EXPECT_TRUE(Map.AddObject("shed", Make(Coord3D{8, 1, 0}, Dims2D{2, 2})).IsSuccess());
+
+  const auto Free = Map.FindFreePositions(0, Dims2D{2, 2});
+  // Left of the first one on the top rows, and the bottom rows up to the second one.
+  ASSERT_EQ(Free.size(), 9);
+  EXPECT_EQ(Free[1].X, 0);
+  EXPECT_EQ(Free[1].Y, 1);
+  EXPECT_EQ(Free.back().X, 6);
+  EXPECT_EQ(Free.back().Y, 2);
+}
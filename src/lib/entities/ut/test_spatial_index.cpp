@@ -0,0 +1,125 @@
+#include "entities/global_map.h"
+#include "entities/spatial_index.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+namespace {
+
+struct Thing {};
+using Index = SpatialIndex<Thing>;
+
+std::vector<Id<Thing>::value_type> Sorted(std::vector<Id<Thing>::value_type> Items) {
+  std::sort(Items.begin(), Items.end());
+  return Items;
+}
+
+} // namespace
+
+TEST(TestSpatialIndex, MatchesScan) {
+  const Dims3D MapSize{70, 45, 2};
+  Index Things{MapSize};
+  std::vector<Index::Entry> All;
+  std::mt19937 Random{7};
+  for (Size I = 0; I < 300; ++I) {
+    const Dims2D Extent{static_cast<Size>(Random() % 3 + 1), static_cast<Size>(Random() % 2 + 1)};
+    const Coord3D Position{static_cast<Dim>(Random() % (MapSize.Width - Extent.Width + 1)),
+                           static_cast<Dim>(Random() % (MapSize.Height - Extent.Height + 1)),
+                           static_cast<Dim>(Random() % MapSize.LayersCount)};
+    All.push_back(Index::Entry{.Item = I, .Position = Position, .Extent = Extent});
+    Things.Insert(I, Position, Extent);
+  }
+  // Some of them move around.
+  for (size_t I = 0; I < All.size(); I += 3) {
+    auto &E = All[I];
+    const Coord3D To{std::min<Dim>(E.Position.X + 17, MapSize.Width - E.Extent.Width),
+                     E.Position.Y / 2, E.Position.Layer};
+    ASSERT_TRUE(Things.Move(E.Item, E.Position, To));
+    E.Position = To;
+  }
+  EXPECT_EQ(Things.GetNumEntries(), All.size());
+
+  for (Size Query = 0; Query < 100; ++Query) {
+    const Coord3D Center{static_cast<Dim>(Random() % MapSize.Width),
+                         static_cast<Dim>(Random() % MapSize.Height), Query % 2};
+    const Dim Radius = Random() % 20;
+    std::vector<Id<Thing>::value_type> Expected, Found;
+    std::optional<Index::Entry> Nearest;
+    for (const auto &E : All) {
+      if (E.Position.Layer != Center.Layer || E.Item % 2) {
+        continue;
+      }
+      const auto Distance = Index::GetDistance(Center, E);
+      if (Distance <= Radius) {
+        Expected.push_back(E.Item);
+      }
+      const auto Best = Nearest ? Index::GetDistance(Center, *Nearest) : Radius + 1;
+      if (Distance < Best || (Distance == Best && E.Item < Nearest->Item)) {
+        Nearest = E;
+      }
+    }
+    Things.ForEachInRadius(Center, Radius, [&](const Index::Entry &E) {
+      if (E.Item % 2 == 0) {
+        Found.push_back(E.Item);
+      }
+    });
+    EXPECT_EQ(Sorted(Found), Sorted(Expected));
+
+    const auto Result =
+        Things.FindNearest(Center, Radius, [](const Index::Entry &E) { return E.Item % 2 == 0; });
+    ASSERT_EQ(Result.has_value(), Nearest.has_value());
+    if (Result) {
+      EXPECT_EQ(Result->Item, Nearest->Item);
+    }
+  }
+}
+
+TEST(TestSpatialIndex, Rect) {
+  Index Things{Dims3D{40, 40, 1}};
+  Things.Insert(0, Coord3D{14, 14, 0}, Dims2D{4, 4}); // Spans four buckets.
+  Things.Insert(1, Coord3D{30, 2, 0});
+  std::vector<Id<Thing>::value_type> Found;
+  auto Collect = [&](const Index::Entry &E) { Found.push_back(E.Item); };
+
+  Things.ForEachInRect(0, Coord{17, 17}, Dims2D{1, 1}, Collect);
+  EXPECT_EQ(Found, (std::vector<Id<Thing>::value_type>{0}));
+  Found.clear();
+  Things.ForEachInRect(0, Coord{18, 0}, Dims2D{20, 20}, Collect);
+  EXPECT_EQ(Found, (std::vector<Id<Thing>::value_type>{1}));
+  Found.clear();
+  Things.ForEachInRect(0, Coord{0, 0}, Dims2D{40, 40}, Collect);
+  EXPECT_EQ(Sorted(Found), (std::vector<Id<Thing>::value_type>{0, 1}));
+
+  EXPECT_TRUE(Things.Remove(0, Coord3D{14, 14, 0}));
+  EXPECT_FALSE(Things.Remove(0, Coord3D{14, 14, 0}));
+  Found.clear();
+  Things.ForEachInRect(0, Coord{0, 0}, Dims2D{40, 40}, Collect);
+  EXPECT_EQ(Found, (std::vector<Id<Thing>::value_type>{1}));
+}
+
+TEST(TestSpatialIndex, FollowsMap) {
+  GlobalMap Map{1, 50, 50};
+  const auto &Squads = Map.GetSquadIndex();
+  Map.SetSquad(Coord3D{3, 3, 0}, Id<Squad>{0});
+  Map.SetSquad(Coord3D{40, 3, 0}, Id<Squad>{1});
+  Map.MoveSquad(Id<Squad>{0}, Coord3D{3, 3, 0}, Coord3D{38, 4, 0});
+  EXPECT_EQ(Squads.GetNumEntries(), 2);
+  EXPECT_FALSE(Map.GetTile(Coord3D{3, 3, 0}).Squad_.IsValid());
+  EXPECT_EQ(Map.GetTile(Coord3D{38, 4, 0}).Squad_, Id<Squad>{0});
+
+  const auto Nearest = Squads.FindNearest(Coord3D{41, 3, 0}, 10, [](const auto &) { return true; });
+  ASSERT_TRUE(Nearest);
+  EXPECT_EQ(Nearest->Item, Id<Squad>{1});
+  size_t NumNear = 0;
+  Squads.ForEachInRadius(Coord3D{39, 3, 0}, 1, [&](const auto &) { ++NumNear; });
+  EXPECT_EQ(NumNear, 2);
+
+  Map.SetSquad(Coord3D{40, 3, 0}, NullId);
+  EXPECT_EQ(Squads.GetNumEntries(), 1);
+  EXPECT_FALSE(Squads.FindNearest(Coord3D{3, 3, 0}, 20, [](const auto &) { return true; }));
+}
@@ -0,0 +1,305 @@
+#include "entities/components.h"
+#include "entities/visibility.h"
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace NotAGame;
+
+TEST(TestVisibility, MatchesScan) {
+  // Rows of more than two words, and not a multiple of a word.
+  const Dims3D MapSize{150, 20, 2};
+  VisibilityMap Map{MapSize};
+  std::vector<bool> Expected(MapSize.Width * MapSize.Height * MapSize.LayersCount, false);
+  auto Offset = [&](Coord3D Coord) { return Linearize(Coord, MapSize); };
+
+  std::mt19937 Random{11};
+  for (size_t Step = 0; Step < 200; ++Step) {
+    const Dim Layer = Random() % MapSize.LayersCount;
+    const Dim X = Random() % (MapSize.Width + 10), Y = Random() % MapSize.Height;
+    const Dim Width = Random() % 140, Height = Random() % 8;
+    const bool Value = Random() % 3 != 0;
+
+    VisibilityDiff Diff;
+    Map.SetRegionAndDiff(Diff, Layer, X, Y, Width, Height, Value);
+    size_t NumFlipped = 0;
+    for (Dim IY = Y; IY < std::min(Y + Height, MapSize.Height); ++IY) {
+      for (Dim IX = X; IX < std::min(X + Width, MapSize.Width); ++IX) {
+        const auto Index = Offset(Coord3D{IX, IY, Layer});
+        NumFlipped += Expected[Index] != Value;
+        Expected[Index] = Value;
+      }
+    }
+    EXPECT_EQ(CountTiles(Diff), NumFlipped);
+    ForEachTile(Diff, [&](Coord3D Coord, bool IsVisible) {
+      EXPECT_EQ(IsVisible, Value);
+      EXPECT_EQ(Expected[Offset(Coord)], Value);
+    });
+  }
+
+  for (Dim Layer = 0; Layer < MapSize.LayersCount; ++Layer) {
+    for (Dim Y = 0; Y < MapSize.Height; ++Y) {
+      for (Dim X = 0; X < MapSize.Width; ++X) {
+        const Coord3D Coord{X, Y, Layer};
+        ASSERT_EQ(Map.IsVisible(Coord), Expected[Offset(Coord)]);
+      }
+      // Nothing past the end of the row.
+      EXPECT_EQ(Map.GetRow(Layer, Y).back() >> (MapSize.Width % VisibilityMap::kWordBits), 0);
+    }
+  }
+}
+
+TEST(TestVisibility, Ranges) {
+  VisibilitySystem Visibility{2, Dims3D{30, 30, 1}};
+  Visibility.AddComponent(VisibilityRange{.Player = 1,
+                                          .Origin = Coord3D{2, 10, 0},
+                                          .OriginSize = Dims2D{2, 2},
+                                          .Radius = 3});
+  Visibility.Reset(1);
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{0, 7, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{6, 14, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{7, 10, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{3, 15, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(0, Coord3D{3, 10, 0}));
+
+  const auto Diff = Visibility.HideRegion(1, 0, 0, 0, 30, 12);
+  EXPECT_EQ(CountTiles(Diff), 7 * 5);
+}
+
+TEST(TestVisibility, MovingObservers) {
+  const Dims3D MapSize{80, 40, 1};
+  VisibilitySystem Visibility{2, MapSize};
+  std::vector<Id<VisibilityRange>> Ranges;
+  for (Dim I = 0; I < 4; ++I) {
+    Ranges.push_back(Visibility
+                         .AddComponent(VisibilityRange{.Player = 1,
+                                                       .Origin = Coord3D{10 + 5 * I, 10, 0},
+                                                       .OriginSize = Dims2D{1, 1},
+                                                       .Radius = 4})
+                         .ComponentId);
+  }
+  auto Snapshot = [&] {
+    std::vector<bool> Tiles;
+    for (Dim Y = 0; Y < MapSize.Height; ++Y) {
+      for (Dim X = 0; X < MapSize.Width; ++X) {
+        Tiles.push_back(Visibility.IsVisible(1, Coord3D{X, Y, 0}));
+      }
+    }
+    return Tiles;
+  };
+
+  // A step to the right uncovers a column, the one left behind is still seen by the next range.
+  auto Before = Snapshot();
+  const auto Diff = Visibility.MoveComponent(Ranges[3], Coord3D{26, 10, 0});
+  EXPECT_EQ(CountTiles(Diff), 9);
+  ForEachTile(Diff, [&](Coord3D Coord, bool IsVisible) {
+    EXPECT_TRUE(IsVisible);
+    EXPECT_EQ(Coord.X, 30);
+    Before[Coord.Y * MapSize.Width + Coord.X] = IsVisible;
+  });
+  EXPECT_EQ(Snapshot(), Before);
+
+  // Moving around ends up where counting from scratch does.
+  std::mt19937 Random{5};
+  for (size_t Step = 0; Step < 100; ++Step) {
+    const auto Range = Ranges[Random() % Ranges.size()];
+    Before = Snapshot();
+    const auto StepDiff = Visibility.MoveComponent(
+        Range, Coord3D{static_cast<Dim>(Random() % MapSize.Width),
+                       static_cast<Dim>(Random() % MapSize.Height), 0});
+    ForEachTile(StepDiff, [&](Coord3D Coord, bool IsVisible) {
+      auto &&Tile = Before[Coord.Y * MapSize.Width + Coord.X];
+      EXPECT_NE(Tile, IsVisible);
+      Tile = IsVisible;
+    });
+    EXPECT_EQ(Snapshot(), Before);
+  }
+  const auto Moved = Snapshot();
+  Visibility.Reset(1);
+  EXPECT_EQ(Snapshot(), Moved);
+
+  for (const auto Range : Ranges) {
+    Visibility.RemoveComponent(Range);
+  }
+  EXPECT_EQ(Snapshot(), std::vector<bool>(MapSize.Width * MapSize.Height, false));
+}
+
+TEST(TestVisibility, Circles) {
+  const Dims3D MapSize{30, 30, 1};
+  VisibilitySystem Visibility{2, MapSize};
+  const auto Range = Visibility
+                         .AddComponent(VisibilityRange{.Player = 1,
+                                                       .Origin = Coord3D{10, 10, 0},
+                                                       .OriginSize = Dims2D{1, 1},
+                                                       .Radius = 3,
+                                                       .Mode = VisibilityMode::Circle})
+                         .ComponentId;
+  // Rows of 7, 7, 5 and 3 tiles away from the center.
+  EXPECT_EQ(Visibility.GetArea(Range).CountTiles(), 37);
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{13, 11, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{8, 12, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{13, 12, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{7, 7, 0}));
+
+  // Clipped to the map, a bigger origin stretches the rows.
+  Visibility.MoveComponent(Range, Coord3D{1, 0, 0});
+  EXPECT_EQ(Visibility.GetArea(Range).CountTiles(), 5 + 5 + 4 + 3);
+  const auto &Big = Visibility.AddComponent(VisibilityRange{.Player = 0,
+                                                            .Origin = Coord3D{10, 10, 0},
+                                                            .OriginSize = Dims2D{3, 2},
+                                                            .Radius = 3,
+                                                            .Mode = VisibilityMode::Circle});
+  EXPECT_EQ(Visibility.GetArea(Big.ComponentId).CountTiles(), 2 * 9 + 2 * (9 + 7 + 5));
+}
+
+TEST(TestVisibility, LineOfSight) {
+  const Dims3D MapSize{40, 40, 1};
+  VisibilitySystem Visibility{2, MapSize};
+  // A wall east of the range.
+  Visibility.SetOpaqueRegion(0, 14, 8, 1, 5, true);
+  const auto Range = Visibility
+                         .AddComponent(VisibilityRange{.Player = 1,
+                                                       .Origin = Coord3D{10, 10, 0},
+                                                       .OriginSize = Dims2D{1, 1},
+                                                       .Radius = 8,
+                                                       .Mode = VisibilityMode::LineOfSight})
+                         .ComponentId;
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{14, 10, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{15, 10, 0}));
+  EXPECT_FALSE(Visibility.IsVisible(1, Coord3D{17, 11, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{16, 15, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{6, 10, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(1, Coord3D{10, 18, 0}));
+
+  // Past the wall it sees what a circle sees.
+  Visibility.MoveComponent(Range, Coord3D{25, 25, 0});
+  CircleStencils Stencils;
+  const auto Circle = MakeCircleArea(Coord3D{25, 25, 0}, Dims2D{1, 1}, Stencils.Get(8), MapSize);
+  EXPECT_EQ(Visibility.GetArea(Range).CountTiles(), Circle.CountTiles());
+
+  // The origin never hides anything, even standing on opaque tiles.
+  Visibility.SetOpaqueRegion(0, 24, 24, 3, 3, true);
+  Visibility.AddComponent(VisibilityRange{.Player = 0,
+                                          .Origin = Coord3D{24, 24, 0},
+                                          .OriginSize = Dims2D{3, 3},
+                                          .Radius = 2,
+                                          .Mode = VisibilityMode::LineOfSight});
+  EXPECT_TRUE(Visibility.IsVisible(0, Coord3D{28, 25, 0}));
+  EXPECT_TRUE(Visibility.IsVisible(0, Coord3D{22, 23, 0}));
+}
+
+TEST(TestVisibility, MovingLinesOfSight) {
+  const Dims3D MapSize{60, 50, 1};
+  VisibilitySystem Visibility{2, MapSize};
+  std::mt19937 Random{7};
+  for (Dim Y = 0; Y < MapSize.Height; ++Y) {
+    for (Dim X = 0; X < MapSize.Width; ++X) {
+      Visibility.SetOpaqueRegion(0, X, Y, 1, 1, Random() % 6 == 0);
+    }
+  }
+  auto RandomCoord = [&] {
+    return Coord3D{static_cast<Dim>(Random() % MapSize.Width),
+                   static_cast<Dim>(Random() % MapSize.Height), 0};
+  };
+  std::vector<Id<VisibilityRange>> Ranges;
+  for (size_t I = 0; I < 6; ++I) {
+    Ranges.push_back(Visibility
+                         .AddComponent(VisibilityRange{.Player = 1,
+                                                       .Origin = RandomCoord(),
+                                                       .OriginSize = Dims2D{static_cast<Size>(1 + I % 2), 1},
+                                                       .Radius = 6,
+                                                       .Mode = VisibilityMode::LineOfSight})
+                         .ComponentId);
+  }
+  auto Snapshot = [&] {
+    std::vector<bool> Tiles;
+    for (Dim Y = 0; Y < MapSize.Height; ++Y) {
+      for (Dim X = 0; X < MapSize.Width; ++X) {
+        Tiles.push_back(Visibility.IsVisible(1, Coord3D{X, Y, 0}));
+      }
+    }
+    return Tiles;
+  };
+
+  for (size_t Step = 0; Step < 100; ++Step) {
+    const auto Range = Ranges[Random() % Ranges.size()];
+    auto Before = Snapshot();
+    const auto Diff = Visibility.MoveComponent(Range, RandomCoord());
+    ForEachTile(Diff, [&](Coord3D Coord, bool IsVisible) {
+      auto &&Tile = Before[Coord.Y * MapSize.Width + Coord.X];
+      EXPECT_NE(Tile, IsVisible);
+      Tile = IsVisible;
+    });
+    EXPECT_EQ(Snapshot(), Before);
+  }
+  // Casting again from the same places sees the same tiles.
+  const auto Moved = Snapshot();
+  Visibility.Reset(1);
+  EXPECT_EQ(Snapshot(), Moved);
+}
+
+TEST(TestVisibility, Teams) {
+  const Dims3D MapSize{100, 30, 1};
+  VisibilitySystem Visibility{3, MapSize};
+  std::mt19937 Random{13};
+  auto RandomCoord = [&] {
+    return Coord3D{static_cast<Dim>(Random() % MapSize.Width),
+                   static_cast<Dim>(Random() % MapSize.Height), 0};
+  };
+  std::vector<Id<VisibilityRange>> Ranges;
+  for (Size I = 0; I < 9; ++I) {
+    Ranges.push_back(Visibility
+                         .AddComponent(VisibilityRange{.Player = I % 3,
+                                                       .Origin = RandomCoord(),
+                                                       .OriginSize = Dims2D{1, 1},
+                                                       .Radius = 5,
+                                                       .Mode = VisibilityMode::Circle})
+                         .ComponentId);
+  }
+  // Every team is the OR of its players, row by row.
+  auto ExpectMerged = [&] {
+    for (Size Team = 0; Team < 3; ++Team) {
+      for (Dim Y = 0; Y < MapSize.Height; ++Y) {
+        const auto Row = Visibility.GetTeamVisibility(Team).GetRow(0, Y);
+        for (size_t Word = 0; Word < Row.size(); ++Word) {
+          uint64_t Expected = 0;
+          for (Size Player = 0; Player < 3; ++Player) {
+            if (Visibility.GetTeam(Player) == Team) {
+              Expected |= Visibility.GetVisibility(Player).GetRow(0, Y)[Word];
+            }
+          }
+          ASSERT_EQ(Row[Word], Expected);
+        }
+      }
+    }
+  };
+  ExpectMerged();
+
+  Visibility.SetTeam(1, 0);
+  ExpectMerged();
+  for (size_t Step = 0; Step < 200; ++Step) {
+    const auto Range = Ranges[Random() % Ranges.size()];
+    switch (Random() % 8) {
+    case 0:
+      Visibility.ChangeOwner(Range, Random() % 3);
+      break;
+    case 1:
+      Visibility.HideRegion(Random() % 3, 0, Random() % MapSize.Width, 0, 20, MapSize.Height);
+      break;
+    default:
+      Visibility.MoveComponent(Range, RandomCoord());
+    }
+    ExpectMerged();
+  }
+
+  // Leaving a team only takes the player's tiles away from it.
+  Visibility.SetTeam(1, 2);
+  ExpectMerged();
+  Visibility.SetTeam(0, 1);
+  ExpectMerged();
+  EXPECT_EQ(Visibility.GetTeam(0), 1);
+  Visibility.Reset(2);
+  ExpectMerged();
+}
@@ -0,0 +1,263 @@
+#include "entities/visibility.h"
+
+#include <array>
+#include <cassert>
+
+namespace NotAGame {
+
+namespace {
+
+// The spans of A outside of B. The spans of a row of B are walked once for all the spans of the
+// same row of A, the cost is the number of spans of both.
+template <typename Fn>
+void ForEachDifference(const VisibilityArea &A, const VisibilityArea &B, Fn &&Func) noexcept {
+  if (A.Layer != B.Layer) {
+    for (const auto &Span : A.Spans) {
+      Func(Span);
+    }
+    return;
+  }
+  size_t First = 0;
+  for (const auto &Span : A.Spans) {
+    while (First < B.Spans.size() && (B.Spans[First].Y < Span.Y ||
+                                       (B.Spans[First].Y == Span.Y && B.Spans[First].X1 <= Span.X0))) {
+      ++First;
+    }
+    Dim X = Span.X0;
+    for (size_t I = First; I < B.Spans.size() && B.Spans[I].Y == Span.Y && B.Spans[I].X0 < Span.X1;
+         ++I) {
+      if (X < B.Spans[I].X0) {
+        Func(VisibilitySpan{Span.Y, X, B.Spans[I].X0});
+      }
+      X = std::max(X, B.Spans[I].X1);
+    }
+    if (X < Span.X1) {
+      Func(VisibilitySpan{Span.Y, X, Span.X1});
+    }
+  }
+}
+
+// Num / Den, Den is positive.
+struct Slope {
+  int64_t Num;
+  int64_t Den;
+};
+
+bool IsLess(Slope A, Slope B) noexcept { return A.Num * B.Den < B.Num * A.Den; }
+
+// From the coordinates of an octant to the offsets on the map.
+struct Octant {
+  int64_t XX;
+  int64_t XY;
+  int64_t YX;
+  int64_t YY;
+};
+
+constexpr std::array<Octant, 8> kOctants{{{1, 0, 0, 1},
+                                          {0, 1, 1, 0},
+                                          {0, -1, 1, 0},
+                                          {-1, 0, 0, 1},
+                                          {-1, 0, 0, -1},
+                                          {0, -1, -1, 0},
+                                          {0, 1, -1, 0},
+                                          {1, 0, 0, -1}}};
+
+// Lights the tiles seen from the center of the origin in the bounding box of the stencil around
+// the origin. Row J of an octant is the tiles at J from the center along the main axis, the
+// columns from the diagonal to the axis. A run of opaque tiles casts a shadow on the next rows:
+// the rows past it are scanned again between the slopes left open around it.
+class ShadowCaster {
+public:
+  ShadowCaster(Coord3D Origin, Dims2D OriginSize, Size Radius, const VisibilityMap &Opaque) noexcept
+      : Origin_{Origin}, OriginSize_{OriginSize}, Opaque_{Opaque},
+        CenterX_{Origin.X + (OriginSize.Width - 1) / 2},
+        CenterY_{Origin.Y + (OriginSize.Height - 1) / 2}, BoxX_{int64_t{Origin.X} - Radius},
+        BoxY_{int64_t{Origin.Y} - Radius}, BoxWidth_{OriginSize.Width + 2 * int64_t{Radius}},
+        BoxHeight_{OriginSize.Height + 2 * int64_t{Radius}},
+        Range_{Radius + std::max(OriginSize.Width, OriginSize.Height) / 2},
+        IsLit_(BoxWidth_ * BoxHeight_, 0) {}
+
+  void Cast() noexcept {
+    Light(CenterX_, CenterY_);
+    for (const auto &Octant : kOctants) {
+      CastOctant(1, Slope{1, 1}, Slope{0, 1}, Octant);
+    }
+  }
+
+  bool IsLit(Dim X, Dim Y) const noexcept { return IsLit_[(Y - BoxY_) * BoxWidth_ + X - BoxX_]; }
+
+private:
+  void Light(int64_t X, int64_t Y) noexcept {
+    if (X >= BoxX_ && X < BoxX_ + BoxWidth_ && Y >= BoxY_ && Y < BoxY_ + BoxHeight_) {
+      IsLit_[(Y - BoxY_) * BoxWidth_ + X - BoxX_] = 1;
+    }
+  }
+
+  bool IsOpaque(int64_t X, int64_t Y) const noexcept {
+    const auto MapSize = Opaque_.GetMapSize();
+    if (X < 0 || Y < 0 || X >= MapSize.Width || Y >= MapSize.Height) {
+      return true;
+    }
+    if (X >= Origin_.X && X < Origin_.X + OriginSize_.Width && Y >= Origin_.Y &&
+        Y < Origin_.Y + OriginSize_.Height) {
+      return false;
+    }
+    return Opaque_.IsVisible(Coord3D{static_cast<Dim>(X), static_cast<Dim>(Y), Origin_.Layer});
+  }
+
+  void CastOctant(int64_t FirstRow, Slope Start, Slope End, const Octant &Octant) noexcept {
+    if (IsLess(Start, End)) {
+      return;
+    }
+    Slope NextStart = Start;
+    for (int64_t Row = FirstRow; Row <= Range_; ++Row) {
+      bool IsBlocked = false;
+      for (int64_t Column = Row; Column >= 0; --Column) {
+        // The slopes of the far and near corners of the tile.
+        const Slope Left{2 * Column + 1, 2 * Row - 1};
+        const Slope Right{2 * Column - 1, 2 * Row + 1};
+        if (IsLess(Start, Right)) {
+          continue;
+        }
+        if (IsLess(Left, End)) {
+          break;
+        }
+        const int64_t X = CenterX_ - Column * Octant.XX - Row * Octant.XY;
+        const int64_t Y = CenterY_ - Column * Octant.YX - Row * Octant.YY;
+        Light(X, Y);
+        const bool IsTileOpaque = IsOpaque(X, Y);
+        if (IsBlocked) {
+          if (IsTileOpaque) {
+            NextStart = Right;
+            continue;
+          }
+          IsBlocked = false;
+          Start = NextStart;
+        } else if (IsTileOpaque && Row < Range_) {
+          IsBlocked = true;
+          CastOctant(Row + 1, Start, Left, Octant);
+          NextStart = Right;
+        }
+      }
+      if (IsBlocked) {
+        break;
+      }
+    }
+  }
+
+  Coord3D Origin_;
+  Dims2D OriginSize_;
+  const VisibilityMap &Opaque_;
+  int64_t CenterX_;
+  int64_t CenterY_;
+  int64_t BoxX_;
+  int64_t BoxY_;
+  int64_t BoxWidth_;
+  int64_t BoxHeight_;
+  // Rows of an octant to reach the corners of the box.
+  int64_t Range_;
+  std::vector<uint8_t> IsLit_;
+};
+
+} // namespace
+
+std::span<const Dim> CircleStencils::Get(Size Radius) noexcept {
+  if (Radius >= Stencils_.size()) {
+    Stencils_.resize(Radius + 1);
+  }
+  auto &Stencil = Stencils_[Radius];
+  if (Stencil.empty()) {
+    const uint64_t Limit = uint64_t{Radius} * (Radius + 1);
+    Dim Dx = Radius;
+    for (Dim Dy = 0; Dy <= Radius; ++Dy) {
+      while (uint64_t{Dx} * Dx + uint64_t{Dy} * Dy > Limit) {
+        --Dx;
+      }
+      Stencil.push_back(Dx);
+    }
+  }
+  return Stencil;
+}
+
+VisibilityArea MakeCircleArea(Coord3D Origin, Dims2D OriginSize, std::span<const Dim> Stencil,
+                              Dims3D MapSize) noexcept {
+  VisibilityArea Area{.Layer = Origin.Layer, .Spans = {}};
+  const Dim Radius = Stencil.size() - 1;
+  const Dim LastY = Origin.Y + OriginSize.Height - 1;
+  const Dim Y0 = Origin.Y - std::min(Origin.Y, Radius);
+  const Dim Y1 = std::min(LastY + 1 + Radius, MapSize.Height);
+  for (Dim Y = Y0; Y < Y1; ++Y) {
+    const Dim Half = Stencil[Y < Origin.Y ? Origin.Y - Y : Y > LastY ? Y - LastY : 0];
+    const Dim X0 = Origin.X - std::min(Origin.X, Half);
+    const Dim X1 = std::min(Origin.X + OriginSize.Width + Half, MapSize.Width);
+    if (X0 < X1) {
+      Area.Spans.push_back(VisibilitySpan{Y, X0, X1});
+    }
+  }
+  return Area;
+}
+
+VisibilityArea CastLineOfSight(Coord3D Origin, Dims2D OriginSize, std::span<const Dim> Stencil,
+                               const VisibilityMap &Opaque) noexcept {
+  const auto Circle = MakeCircleArea(Origin, OriginSize, Stencil, Opaque.GetMapSize());
+  ShadowCaster Caster{Origin, OriginSize, static_cast<Size>(Stencil.size() - 1), Opaque};
+  Caster.Cast();
+
+  VisibilityArea Area{.Layer = Origin.Layer, .Spans = {}};
+  for (const auto &Span : Circle.Spans) {
+    for (Dim X = Span.X0; X < Span.X1;) {
+      if (!Caster.IsLit(X, Span.Y)) {
+        ++X;
+        continue;
+      }
+      const Dim X0 = X;
+      while (X < Span.X1 && Caster.IsLit(X, Span.Y)) {
+        ++X;
+      }
+      Area.Spans.push_back(VisibilitySpan{Span.Y, X0, X});
+    }
+  }
+  return Area;
+}
+
+void ObservedVisibility::MoveObserver(VisibilityDiff &Diff, const VisibilityArea &From,
+                                      const VisibilityArea &To) noexcept {
+  // The two parts are disjoint, a tile shows up in the diff at most once.
+  ForEachDifference(To, From,
+                    [&](VisibilitySpan Span) { UpdateCounts(Diff, To.Layer, Span, true); });
+  ForEachDifference(From, To,
+                    [&](VisibilitySpan Span) { UpdateCounts(Diff, From.Layer, Span, false); });
+}
+
+void ObservedVisibility::UpdateCounts(VisibilityDiff &Diff, Dim Layer, VisibilitySpan Span,
+                                      bool IsAdded) noexcept {
+  constexpr Dim kWordBits = VisibilityMap::kWordBits;
+  auto *Counts = Counts_.data() + GetOffset(Layer, 0, Span.Y);
+  for (Dim Word = Span.X0 / kWordBits; Word * kWordBits < Span.X1; ++Word) {
+    const Dim First = std::max(Span.X0, Word * kWordBits);
+    const Dim Last = std::min(Span.X1, (Word + 1) * kWordBits);
+    // The tiles whose count leaves or reaches zero.
+    uint64_t Mask = 0;
+    for (Dim X = First; X < Last; ++X) {
+      if (IsAdded) {
+        assert(Counts[X] != UINT8_MAX);
+        Mask |= uint64_t{Counts[X]++ == 0} << (X % kWordBits);
+      } else {
+        assert(Counts[X] != 0);
+        Mask |= uint64_t{--Counts[X] == 0} << (X % kWordBits);
+      }
+    }
+    if (!Mask) {
+      continue;
+    }
+    if (const auto Flipped = Map_.UpdateWord(Layer, Span.Y, Word, Mask, IsAdded)) {
+      Diff.push_back(VisibilityChange{.Layer = Layer,
+                                      .Y = Span.Y,
+                                      .FirstX = Word * kWordBits,
+                                      .Mask = Flipped,
+                                      .IsVisible = IsAdded});
+    }
+  }
+}
+
+} // namespace NotAGame
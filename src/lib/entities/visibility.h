@@ -0,0 +1,267 @@
+#pragma once
+
+#include "util/types.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace NotAGame {
+
+// Tiles of a row flipped by a visibility update, 64 at a time: bit I of Mask is the tile
+// FirstX + I. All the tiles of a change flipped the same way.
+struct VisibilityChange {
+  Dim Layer;
+  Dim Y;
+  Dim FirstX;
+  uint64_t Mask;
+  bool IsVisible;
+};
+
+using VisibilityDiff = std::vector<VisibilityChange>;
+
+template <typename Fn> void ForEachTile(const VisibilityDiff &Diff, Fn &&Func) noexcept {
+  for (const auto &Change : Diff) {
+    for (auto Mask = Change.Mask; Mask; Mask &= Mask - 1) {
+      const auto X = Change.FirstX + static_cast<Dim>(std::countr_zero(Mask));
+      Func(Coord3D{X, Change.Y, Change.Layer}, Change.IsVisible);
+    }
+  }
+}
+
+inline size_t CountTiles(const VisibilityDiff &Diff) noexcept {
+  size_t NumTiles = 0;
+  for (const auto &Change : Diff) {
+    NumTiles += std::popcount(Change.Mask);
+  }
+  return NumTiles;
+}
+
+// Visible tiles of one player, a bit per tile. Every row starts on a new word, so a region is
+// updated a word per row and 64 tiles at a time, and its diff comes out of the same words.
+class VisibilityMap {
+public:
+  static constexpr Dim kWordBits = 64;
+
+  VisibilityMap() noexcept : VisibilityMap{Dims3D{0, 0, 0}} {}
+  explicit VisibilityMap(Dims3D MapSize) noexcept
+      : MapSize_{MapSize}, WordsPerRow_{(MapSize.Width + kWordBits - 1) / kWordBits},
+        Words_(size_t{WordsPerRow_} * MapSize.Height * MapSize.LayersCount, 0) {}
+
+  Dims3D GetMapSize() const noexcept { return MapSize_; }
+
+  bool IsVisible(Coord3D Coord) const noexcept {
+    const auto Word = Words_[GetRowStart(Coord.Layer, Coord.Y) + Coord.X / kWordBits];
+    return Word >> (Coord.X % kWordBits) & 1;
+  }
+
+  // Bits past the width of the map are always clear.
+  std::span<const uint64_t> GetRow(Dim Layer, Dim Y) const noexcept {
+    return {Words_.data() + GetRowStart(Layer, Y), WordsPerRow_};
+  }
+
+  void Clear() noexcept { std::fill(Words_.begin(), Words_.end(), 0); }
+
+  // Sets the tiles visible on the other map too. Maps must be the same size.
+  void Merge(const VisibilityMap &Other) noexcept {
+    std::transform(Words_.begin(), Words_.end(), Other.Words_.begin(), Words_.begin(),
+                   [](uint64_t Bits, uint64_t OtherBits) { return Bits | OtherBits; });
+  }
+
+  // Sets or clears the masked bits of a word of a row, returns the ones that flipped.
+  uint64_t UpdateWord(Dim Layer, Dim Y, Dim Word, uint64_t Mask, bool Value) noexcept {
+    auto &Bits = Words_[GetRowStart(Layer, Y) + Word];
+    const uint64_t Old = Bits;
+    Bits = Value ? Old | Mask : Old & ~Mask;
+    return Old ^ Bits;
+  }
+
+  // Regions are clipped to the map.
+  void SetRegion(Dim Layer, Dim X, Dim Y, Dim Width, Dim Height, bool Value) noexcept {
+    UpdateRegion<false>(nullptr, Layer, X, Y, Width, Height, Value);
+  }
+  // Same, and appends the flipped tiles to Diff.
+  void SetRegionAndDiff(VisibilityDiff &Diff, Dim Layer, Dim X, Dim Y, Dim Width, Dim Height,
+                        bool Value) noexcept {
+    UpdateRegion<true>(&Diff, Layer, X, Y, Width, Height, Value);
+  }
+
+private:
+  size_t GetRowStart(Dim Layer, Dim Y) const noexcept {
+    return (size_t{Layer} * MapSize_.Height + Y) * WordsPerRow_;
+  }
+
+  template <bool WithDiff>
+  void UpdateRegion(VisibilityDiff *Diff, Dim Layer, Dim X, Dim Y, Dim Width, Dim Height,
+                    bool Value) noexcept;
+
+  Dims3D MapSize_;
+  Size WordsPerRow_;
+  std::vector<uint64_t> Words_;
+};
+
+template <bool WithDiff>
+void VisibilityMap::UpdateRegion(VisibilityDiff *Diff, Dim Layer, Dim X, Dim Y, Dim Width,
+                                 Dim Height, bool Value) noexcept {
+  if (X >= MapSize_.Width || Y >= MapSize_.Height) {
+    return;
+  }
+  Width = std::min(Width, MapSize_.Width - X);
+  Height = std::min(Height, MapSize_.Height - Y);
+  if (!Width || !Height) {
+    return;
+  }
+
+  const Dim FirstWord = X / kWordBits, LastWord = (X + Width - 1) / kWordBits;
+  const uint64_t FirstMask = ~uint64_t{0} << (X % kWordBits);
+  const uint64_t LastMask = ~uint64_t{0} >> (kWordBits - 1 - (X + Width - 1) % kWordBits);
+  for (Dim Row = Y; Row < Y + Height; ++Row) {
+    for (Dim Word = FirstWord; Word <= LastWord; ++Word) {
+      uint64_t Mask = ~uint64_t{0};
+      if (Word == FirstWord) {
+        Mask &= FirstMask;
+      }
+      if (Word == LastWord) {
+        Mask &= LastMask;
+      }
+      const uint64_t Flipped = UpdateWord(Layer, Row, Word, Mask, Value);
+      if constexpr (WithDiff) {
+        if (Flipped) {
+          Diff->push_back(VisibilityChange{.Layer = Layer,
+                                           .Y = Row,
+                                           .FirstX = Word * kWordBits,
+                                           .Mask = Flipped,
+                                           .IsVisible = Value});
+        }
+      }
+    }
+  }
+}
+
+// A rectangle of tiles on a layer.
+struct VisibilityRegion {
+  Dim Layer;
+  Dim X;
+  Dim Y;
+  Dim Width;
+  Dim Height;
+};
+
+// Tiles [X0, X1) of a row.
+struct VisibilitySpan {
+  Dim Y;
+  Dim X0;
+  Dim X1;
+};
+
+// The tiles seen by an observer, a few spans per row. Spans are sorted by row then column, they
+// are never empty and never overlap.
+struct VisibilityArea {
+  Dim Layer = 0;
+  std::vector<VisibilitySpan> Spans;
+
+  static VisibilityArea FromRegion(VisibilityRegion Region) noexcept {
+    VisibilityArea Area{.Layer = Region.Layer, .Spans = {}};
+    if (Region.Width) {
+      for (Dim Y = Region.Y; Y < Region.Y + Region.Height; ++Y) {
+        Area.Spans.push_back(VisibilitySpan{Y, Region.X, Region.X + Region.Width});
+      }
+    }
+    return Area;
+  }
+
+  size_t CountTiles() const noexcept {
+    size_t NumTiles = 0;
+    for (const auto &Span : Spans) {
+      NumTiles += Span.X1 - Span.X0;
+    }
+    return NumTiles;
+  }
+};
+
+enum class VisibilityMode : uint8_t {
+  // The square around the origin.
+  Rectangle,
+  // The tiles within the radius of a tile of the origin.
+  Circle,
+  // Same, without the tiles hidden behind opaque ones.
+  LineOfSight,
+};
+
+// Half-widths of the rows of a disc: row Dy of a disc of radius R spans [-Stencil[Dy], Stencil[Dy]]
+// for Dy up to R. A tile is in the disc when Dx^2 + Dy^2 <= R * (R + 1), which rounds the disc
+// the same way in every direction.
+class CircleStencils {
+public:
+  std::span<const Dim> Get(Size Radius) noexcept;
+
+private:
+  std::vector<std::vector<Dim>> Stencils_;
+};
+
+// The tiles within a stencil of any tile of the origin, clipped to the map. A stencil of radius 0
+// is the origin itself.
+VisibilityArea MakeCircleArea(Coord3D Origin, Dims2D OriginSize, std::span<const Dim> Stencil,
+                              Dims3D MapSize) noexcept;
+
+// Same, without the tiles hidden from the center of the origin by opaque tiles, found by recursive
+// shadowcasting over the 8 octants. Opaque tiles are seen, the ones behind them are not, the
+// origin never hides anything. Slopes are compared as fractions of integers, the same tiles are
+// seen on any platform.
+VisibilityArea CastLineOfSight(Coord3D Origin, Dims2D OriginSize, std::span<const Dim> Stencil,
+                               const VisibilityMap &Opaque) noexcept;
+
+// Visibility of a player from its observers: the number of observers seeing every tile, a tile
+// is visible while there is at least one. Moving an observer only touches the tiles it stops or
+// starts seeing, and the diff is exact whatever the other observers see.
+//
+// At most 255 observers of a player may see the same tile. Regions set directly on the map
+// override the observers until the count of a tile drops to zero or rises from it.
+class ObservedVisibility {
+public:
+  ObservedVisibility() noexcept : ObservedVisibility{Dims3D{0, 0, 0}} {}
+  explicit ObservedVisibility(Dims3D MapSize) noexcept
+      : Map_{MapSize}, Counts_(size_t{MapSize.Width} * MapSize.Height * MapSize.LayersCount, 0) {}
+
+  const VisibilityMap &GetMap() const noexcept { return Map_; }
+  VisibilityMap &GetMap() noexcept { return Map_; }
+
+  uint8_t GetNumObservers(Coord3D Coord) const noexcept {
+    return Counts_[GetOffset(Coord.Layer, Coord.X, Coord.Y)];
+  }
+
+  // Areas must be on the map.
+  void AddObserver(VisibilityDiff &Diff, const VisibilityArea &Area) noexcept {
+    for (const auto &Span : Area.Spans) {
+      UpdateCounts(Diff, Area.Layer, Span, true);
+    }
+  }
+  void RemoveObserver(VisibilityDiff &Diff, const VisibilityArea &Area) noexcept {
+    for (const auto &Span : Area.Spans) {
+      UpdateCounts(Diff, Area.Layer, Span, false);
+    }
+  }
+  void MoveObserver(VisibilityDiff &Diff, const VisibilityArea &From,
+                    const VisibilityArea &To) noexcept;
+
+  // Forgets all the observers.
+  void Clear() noexcept {
+    Map_.Clear();
+    std::fill(Counts_.begin(), Counts_.end(), 0);
+  }
+
+private:
+  size_t GetOffset(Dim Layer, Dim X, Dim Y) const noexcept {
+    const auto Size = Map_.GetMapSize();
+    return (size_t{Layer} * Size.Height + Y) * Size.Width + X;
+  }
+
+  void UpdateCounts(VisibilityDiff &Diff, Dim Layer, VisibilitySpan Span, bool IsAdded) noexcept;
+
+  VisibilityMap Map_;
+  std::vector<uint8_t> Counts_;
+};
+
+} // namespace NotAGame
@@ -36,7 +36,28 @@ void LoadDim2DSettings(Settings &S, const Value &V) noexcept {
 template <typename Value> Terrain LoadTerrain(const Value &V) noexcept {
   auto &&Named = LoadNamed(V);
   auto BaseCost = V["cost"].GetUint();
-  return Terrain{std::move(Named), BaseCost};
+  const auto *KindDoc = FindMemberPtr(V, "kind");
+  if (!KindDoc) {
+    return Terrain{std::move(Named), BaseCost};
+  }
+
+  auto Kind = GetString(*KindDoc);
+  if (Kind == "plain") {
+    return Terrain{std::move(Named), BaseCost, TerrainKind::Ground, GroundKind::Plain};
+  }
+  if (Kind == "road") {
+    return Terrain{std::move(Named), BaseCost, TerrainKind::Ground, GroundKind::Road};
+  }
+  if (Kind == "forest") {
+    return Terrain{std::move(Named), BaseCost, TerrainKind::Ground, GroundKind::Forest};
+  }
+  if (Kind == "water") {
+    return Terrain{std::move(Named), BaseCost, TerrainKind::Water};
+  }
+  if (Kind == "relief") {
+    return Terrain{std::move(Named), BaseCost, TerrainKind::Relief};
+  }
+  LogUnreachable() << "Unknown terrain kind: " << Kind;
 }
 
 template <typename Settings, typename Value> Settings LoadTownSettings(const Value &V) noexcept {
@@ -269,6 +290,15 @@ private:
       LD.Leadership.SetValue(0);
       LD.Steps = (*LeaderDataDoc)["move_points"].GetUint();
       LD.ViewRange = (*LeaderDataDoc)["view_range"].GetUint();
+      if (const auto *PerksDoc = FindMemberPtr(*LeaderDataDoc, "movement_perks")) {
+        for (const auto &PerkDoc : PerksDoc->GetArray()) {
+          const auto Perk = ParseMovementPerk(PerkDoc.GetString());
+          if (!Perk) {
+            LogUnreachable() << "Unknown movement perk: " << PerkDoc.GetString();
+          }
+          LD.Movement |= *Perk;
+        }
+      }
       // TODO LD.Perks
       U.LeaderDataId = M.LeaderPresets_.AddObject(std::string{Name}, std::move(LD));
     }
@@ -5,11 +5,13 @@
 #include "game/mod.h"
 #include "util/types.h"
 
+#include "engine/path.h"
 #include "engine/player.h"
 #include "engine/player_state.h"
 
 #include <cstdint>
 #include <deque>
+#include <map>
 #include <span>
 #include <string>
 #include <unordered_map>
@@ -82,6 +84,9 @@ struct PlayerGameState {
   Resources ResourcesGained;
   std::unordered_set<Id<Building>> Buildings;
   SpellBook Spells;
+  // Long marches, continued at the start of every turn of the player. Ordered by squad, squads
+  // block each other, so the order they move in must not depend on hashing.
+  std::map<Id<Squad>, Path> MoveOrders;
   // std::unordered_set<Id<MapObjectPtr>> Towns_;
   //  std::unordered_set<Id<Squad>> Squads_;
 };
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 namespace NotAGame::Utils {
@@ -16,7 +17,7 @@ public:
     typedef std::random_access_iterator_tag iterator_category;
     typedef T value_type;
     typedef T *pointer;
-    typedef T &reference;
+    typedef std::conditional_t<std::is_const_v<ParentT>, const T &, T &> reference;
     typedef std::ptrdiff_t difference_type;
 
     explicit Iterator(ParentT *Parent = nullptr, size_t Idx = 0) noexcept
@@ -43,7 +44,7 @@ public:
     }
 
     Iterator operator-(difference_type n) noexcept { return Iterator{Parent_, Idx_ - n}; }
-    T &operator[](difference_type n) const noexcept { return *Iterator{Parent_, Idx_ + n}; }
+    reference operator[](difference_type n) const noexcept { return *Iterator{Parent_, Idx_ + n}; }
 
     difference_type operator-(Iterator Rhs) const noexcept { return Idx_ - Rhs.Idx_; }
 
@@ -53,12 +54,7 @@ public:
       return Iter;
     }
 
-    const T &operator*() const noexcept {
-      assert(Parent_);
-      return (*Parent_)[Idx_];
-    }
-
-    T &operator*() noexcept {
+    reference operator*() const noexcept {
       assert(Parent_);
       return (*Parent_)[Idx_];
     }
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NotAGame::Utils {
+
+// Fixed set of worker threads for data-parallel batches. Workers live as long as the pool, so
+// their thread-local buffers survive between batches.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t NumThreads = std::thread::hardware_concurrency()) noexcept {
+    // The calling thread takes part in every batch.
+    const size_t NumWorkers = std::max<size_t>(NumThreads, 1) - 1;
+    Workers_.reserve(NumWorkers);
+    for (size_t I = 0; I < NumWorkers; ++I) {
+      Workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard Lock{Mutex_};
+      IsStopping_ = true;
+    }
+    WakeUp_.notify_all();
+    for (auto &Worker : Workers_) {
+      Worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t GetNumThreads() const noexcept { return Workers_.size() + 1; }
+
+  // Calls Func(I) for every I in [0, Count) and waits for all of them. Items are handed out one
+  // by one, so uneven items are balanced between the threads.
+  template <typename Fn> void ParallelFor(size_t Count, Fn &&Func) noexcept {
+    if (Count <= 1 || Workers_.empty()) {
+      for (size_t I = 0; I < Count; ++I) {
+        Func(I);
+      }
+      return;
+    }
+
+    std::lock_guard BatchLock{BatchMutex_};
+    std::atomic<size_t> Next{0};
+    auto Drain = [&] {
+      for (size_t I = Next++; I < Count; I = Next++) {
+        Func(I);
+      }
+    };
+
+    {
+      std::lock_guard Lock{Mutex_};
+      Task_ = Drain;
+      Pending_ = Workers_.size();
+      ++Generation_;
+    }
+    WakeUp_.notify_all();
+    Drain();
+
+    std::unique_lock Lock{Mutex_};
+    Done_.wait(Lock, [this] { return Pending_ == 0; });
+    Task_ = nullptr;
+  }
+
+  static ThreadPool &GetDefault() noexcept {
+    static ThreadPool Pool;
+    return Pool;
+  }
+
+private:
+  void WorkerLoop() noexcept {
+    size_t SeenGeneration = 0;
+    while (true) {
+      std::function<void()> Task;
+      {
+        std::unique_lock Lock{Mutex_};
+        WakeUp_.wait(Lock, [&] { return IsStopping_ || Generation_ != SeenGeneration; });
+        if (IsStopping_) {
+          return;
+        }
+        SeenGeneration = Generation_;
+        Task = Task_;
+      }
+
+      Task();
+
+      std::lock_guard Lock{Mutex_};
+      if (--Pending_ == 0) {
+        Done_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> Workers_;
+
+  // Batches are not reentrant, concurrent callers are serialized.
+  std::mutex BatchMutex_;
+
+  std::mutex Mutex_;
+  std::condition_variable WakeUp_;
+  std::condition_variable Done_;
+  std::function<void()> Task_;
+  size_t Generation_ = 0;
+  size_t Pending_ = 0;
+  bool IsStopping_ = false;
+};
+
+} // namespace NotAGame::Utils
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <limits>
@@ -48,11 +50,18 @@ inline constexpr Size Linearize(Coord3D C, Dims3D Size) noexcept {
 
 template <typename T, std::size_t N> using SmallVector = boost::container::small_vector<T, N>;
 
-inline SmallVector<Coord3D, 8> GetPlaneNeighboors(Coord3D Coord) noexcept {
-  auto [X, Y, Z] = Coord;
-  return {Coord3D{X - 1, Y - 1, Z}, Coord3D{X, Y - 1, Z},    Coord3D{X + 1, Y - 1, Z},
-          Coord3D{X - 1, Y, Z},     Coord3D{X + 1, Y, Z},    Coord3D{X - 1, Y + 1, Z},
-          Coord3D{X, Y + 1, Z},     Coord3D{X + 1, Y + 1, Z}};
+// Steps to the 8 neighbours of a tile, row by row.
+inline constexpr std::array<std::array<int, 2>, 8> kPlaneSteps = {
+    {{-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}}};
+
+// Coordinates off the map wrap around, callers check them with GlobalMap::IsValid. Hot loops
+// should rather walk the navigation grid, which needs no checks.
+inline constexpr std::array<Coord3D, 8> GetPlaneNeighboors(Coord3D Coord) noexcept {
+  std::array<Coord3D, 8> Neighboors;
+  for (size_t I = 0; I < kPlaneSteps.size(); ++I) {
+    Neighboors[I] = Coord3D{Coord.X + kPlaneSteps[I][0], Coord.Y + kPlaneSteps[I][1], Coord.Layer};
+  }
+  return Neighboors;
 }
 
 template <typename T> class IteratorRange {
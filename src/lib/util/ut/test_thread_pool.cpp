@@ -0,0 +1,30 @@
+#include "util/thread_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <numeric>
+
+using namespace NotAGame::Utils;
+
+TEST(ThreadPool, SingleThread) {
+  ThreadPool Pool{1};
+  EXPECT_EQ(Pool.GetNumThreads(), 1);
+  std::vector<int> Values(10, 0);
+  Pool.ParallelFor(Values.size(), [&](size_t I) { Values[I] = I; });
+  for (size_t I = 0; I < Values.size(); ++I) {
+    EXPECT_EQ(Values[I], I);
+  }
+}
+
+TEST(ThreadPool, EveryItemOnce) {
+  ThreadPool Pool{4};
+  EXPECT_EQ(Pool.GetNumThreads(), 4);
+  for (size_t Count : {0, 1, 3, 1000}) {
+    std::vector<std::atomic<int>> Hits(Count);
+    Pool.ParallelFor(Count, [&](size_t I) { ++Hits[I]; });
+    for (const auto &Hit : Hits) {
+      EXPECT_EQ(Hit, 1);
+    }
+  }
+}